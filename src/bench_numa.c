@@ -0,0 +1,255 @@
+/* tensor/bench_numa.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Measures the bandwidth (GB/s read + written) of tensor_add and
+ * tensor_scale in all the threads, on tensors whose data was placed on
+ * the NUMA nodes:
+ *   - by a single thread, which puts all the pages on its own node,
+ *     as tensor_calloc did before it worked in parallel,
+ *   - by all the threads (TENSOR_NUMA_FIRST_TOUCH), each page near the
+ *     thread that works with it,
+ *   - in turns on all the nodes (TENSOR_NUMA_INTERLEAVE),
+ *   - all on node 0 (TENSOR_NUMA_BIND).
+ *
+ * With libnuma, it also counts the pages on each node, and the pages
+ * of each thread's share of the data that are not on the node of the
+ * thread: the remote accesses of each pass. (The threads take the
+ * parts of an operation as they become free, so which thread gets
+ * which part can change, and this count is an estimate.)
+ *
+ * Build with "make bench_numa" and run as
+ *   ./bench_numa [dimension] [passes]
+ * (rank 2 tensors), with TENSOR_NUM_THREADS set to one thread per
+ * core of the machine.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#if defined(HAVE_NUMAIF_H) && defined(HAVE_MBIND)
+#define USE_NUMA 1
+#include <numaif.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#include "tensor.h"
+#include "tensor_internal.h"
+
+#define MAX_NODES 64
+
+
+static double
+seconds (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+
+#ifdef USE_NUMA
+/*
+ * Node of the processor the calling thread runs on.
+ */
+static int
+current_node (void)
+{
+  unsigned int cpu, node;
+
+  if (syscall (SYS_getcpu, &cpu, &node, NULL) != 0)
+    return -1;
+
+  return (int) node;
+}
+
+
+/*
+ * Counts the pages of t on each node in count, and returns how many
+ * of them are not on the node given for their part in part_node (the
+ * parts being equal shares of the data).
+ */
+static size_t
+count_pages (const tensor * t, size_t parts, const int * part_node,
+             size_t * count)
+{
+  const size_t page = (size_t) sysconf (_SC_PAGESIZE);
+  const size_t first = ((size_t) t->data + page - 1) / page;
+  const size_t last = ((size_t) t->data + t->size * sizeof (double)) / page;
+  const size_t n = (last > first) ? last - first : 0;
+  void ** pages = (void **) malloc (n * sizeof (void *));
+  int * status = (int *) malloc (n * sizeof (int));
+  size_t i, remote = 0;
+
+  for (i = 0; i < MAX_NODES; i++)
+    count[i] = 0;
+
+  for (i = 0; i < n; i++)
+    pages[i] = (void *) ((first + i) * page);
+
+  if (n > 0 && move_pages (0, n, pages, NULL, status, 0) == 0)
+    for (i = 0; i < n; i++)
+      {
+        if (status[i] >= 0 && status[i] < MAX_NODES)
+          count[status[i]]++;
+        if (status[i] != part_node[i * parts / n])
+          remote++;
+      }
+
+  free (pages);
+  free (status);
+
+  return remote;
+}
+
+
+/* Node of each part of the job, written by the thread that does it */
+typedef struct
+{
+  size_t n;
+  int * node;
+} node_job;
+
+
+static void
+node_part (void * arg, size_t begin, size_t end)
+{
+  node_job * job = (node_job *) arg;
+  const int node = current_node ();
+  size_t i;
+
+  for (i = begin; i < end; i++)
+    job->node[i] = node;
+}
+#endif
+
+
+static void
+report (const char * name, const tensor * t, double seconds, int passes)
+{
+  /* add reads two tensors and writes one, scale reads and writes one */
+  double bytes = 5.0 * passes * t->size * sizeof (double);
+
+  printf ("%-26s %8.3f s  %7.2f GB/s\n", name, seconds,
+          bytes / seconds / 1e9);
+}
+
+
+/*
+ * A new rank 2 tensor of the given dimension, initialized with the
+ * given policy by the given number of threads.
+ */
+static tensor *
+new_tensor (size_t dimension, int policy, int threads)
+{
+  const int all = tensor_get_num_threads ();
+  tensor * t = tensor_alloc (2, dimension);
+
+  tensor_set_numa_policy (t, policy, 0);
+
+  tensor_set_num_threads (threads);
+  tensor_set_all (t, 1.0);
+  tensor_set_num_threads (all);
+
+  return t;
+}
+
+
+int
+main (int argc, char * argv[])
+{
+  static const struct
+  {
+    const char * name;
+    int policy, threads;  /* threads 0: all */
+  }
+  cases[] =
+    {
+      { "one thread first touch", TENSOR_NUMA_FIRST_TOUCH, 1 },
+      { "parallel first touch", TENSOR_NUMA_FIRST_TOUCH, 0 },
+      { "interleave", TENSOR_NUMA_INTERLEAVE, 0 },
+      { "bind to node 0", TENSOR_NUMA_BIND, 0 }
+    };
+
+  size_t dimension = (argc > 1) ? atoi (argv[1]) : 4096;
+  int passes = (argc > 2) ? atoi (argv[2]) : 10;
+  const int threads = tensor_get_num_threads ();
+  size_t c;
+  int p;
+
+  printf ("%d passes over rank 2, dimension %lu tensors (%.1f MB each), "
+          "in %d threads\n", passes, (unsigned long) dimension,
+          dimension * dimension * sizeof (double) / 1e6, threads);
+
+  for (c = 0; c < sizeof (cases) / sizeof (cases[0]); c++)
+    {
+      tensor * a = new_tensor (dimension, cases[c].policy,
+                               cases[c].threads ? cases[c].threads : threads);
+      tensor * b = new_tensor (dimension, cases[c].policy,
+                               cases[c].threads ? cases[c].threads : threads);
+      double t0, t1;
+
+      t0 = seconds ();
+      for (p = 0; p < passes; p++)
+        {
+          tensor_add (a, b);
+          tensor_scale (a, 0.5);
+        }
+      t1 = seconds ();
+      report (cases[c].name, a, t1 - t0, passes);
+
+#ifdef USE_NUMA
+      {
+        int part_node[1024];
+        size_t count[MAX_NODES];
+        size_t i, remote, total = 0;
+        node_job job;
+
+        /* One part per thread, as tensor_add splits the rows */
+        job.n = (threads < 1024) ? threads : 1024;
+        job.node = part_node;
+        tensor_parallel_for (job.n, 1, node_part, &job);
+
+        remote = count_pages (a, job.n, part_node, count);
+
+        printf ("  pages per node:");
+        for (i = 0; i < MAX_NODES; i++)
+          {
+            total += count[i];
+            if (count[i] > 0)
+              printf (" %lu: %lu", (unsigned long) i,
+                      (unsigned long) count[i]);
+          }
+        printf ("; remote for their part: %lu (%.1f%%)\n",
+                (unsigned long) remote,
+                total > 0 ? 100.0 * remote / total : 0.0);
+      }
+#endif
+
+      tensor_free (a);
+      tensor_free (b);
+    }
+
+  return 0;
+}
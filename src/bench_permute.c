@@ -0,0 +1,158 @@
+/* tensor/bench_permute.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Measures the bandwidth (GB/s read + written) of an index permutation
+ * done with:
+ *   - the per-element algorithm that tensor_swap_indices used to have
+ *     (one base change per element, scattered writes),
+ *   - a chain of tensor_swap_indices calls,
+ *   - a single tensor_permute call.
+ *
+ * Build with "make bench_permute" and run as
+ *   ./bench_permute [rank] [dimension]
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "tensor.h"
+
+
+static double
+seconds (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+
+  return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+
+/*
+ * dest = src with indices reversed, one element at a time.
+ */
+static void
+reverse_naive (tensor * dest, const tensor * src)
+{
+  size_t pos, k;
+  size_t * digits = (size_t *) malloc (src->rank * sizeof (size_t));
+  size_t * reversed = (size_t *) malloc (src->rank * sizeof (size_t));
+
+  for (pos = 0; pos < src->size; pos++)
+    {
+      position2index (src->rank, src->dimension, pos, digits);
+
+      for (k = 0; k < src->rank; k++)
+        reversed[k] = digits[src->rank - 1 - k];
+
+      dest->data[index2position (src->rank, src->dimension, reversed)] =
+        src->data[pos];
+    }
+
+  free (digits);
+  free (reversed);
+}
+
+
+static void
+report (const char * name, const tensor * t, double t0, double t1)
+{
+  double bytes = 2.0 * t->size * sizeof (double);
+
+  printf ("%-28s %8.3f s  %7.2f GB/s\n", name, t1 - t0,
+          bytes / (t1 - t0) / 1e9);
+}
+
+
+int
+main (int argc, char * argv[])
+{
+  unsigned int rank = (argc > 1) ? atoi (argv[1]) : 4;
+  size_t dimension = (argc > 2) ? atoi (argv[2]) : 48;
+  size_t perm[TENSOR_MAX_RANK];
+  unsigned int k;
+  size_t i;
+  double t0, t1;
+  tensor * src, * dest;
+
+  if (rank > TENSOR_MAX_RANK)
+    {
+      fprintf (stderr, "bench_permute: the rank can be at most %d\n",
+               TENSOR_MAX_RANK);
+      return 1;
+    }
+
+  src = tensor_alloc (rank, dimension);
+  dest = tensor_alloc (rank, dimension);
+
+  for (i = 0; i < src->size; i++)
+    src->data[i] = i;
+
+  printf ("reversing the indices of a rank %u, dimension %lu tensor "
+          "(%.1f MB)\n", rank, (unsigned long) dimension,
+          src->size * sizeof (double) / 1e6);
+
+  /* Per-element base conversion */
+  t0 = seconds ();
+  reverse_naive (dest, src);
+  t1 = seconds ();
+  report ("per-element (old algorithm)", src, t0, t1);
+
+  /* Chain of swap_indices */
+  t0 = seconds ();
+  {
+    tensor * t = tensor_copy (src);
+
+    for (k = 0; k < rank / 2; k++)
+      {
+        tensor * tt = tensor_swap_indices (t, k, rank - 1 - k);
+        tensor_free (t);
+        t = tt;
+      }
+    tensor_memcpy (dest, t);
+    tensor_free (t);
+  }
+  t1 = seconds ();
+  report ("tensor_swap_indices chain", src, t0, t1);
+
+  /* One pass */
+  for (k = 0; k < rank; k++)
+    perm[k] = rank - 1 - k;
+
+  t0 = seconds ();
+  tensor_permute (dest, src, perm);
+  t1 = seconds ();
+  report ("tensor_permute", src, t0, t1);
+
+  /* For reference, a plain copy */
+  t0 = seconds ();
+  tensor_memcpy (dest, src);
+  t1 = seconds ();
+  report ("tensor_memcpy", src, t0, t1);
+
+  tensor_free (src);
+  tensor_free (dest);
+
+  return 0;
+}
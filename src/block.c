@@ -0,0 +1,444 @@
+/* tensor/block.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Reference counted blocks of memory for the data of tensors (see
+ * tensor_block.h).
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(HAVE_NUMAIF_H) && defined(HAVE_MBIND)
+#define USE_NUMA 1
+#include <numaif.h>
+#include <unistd.h>
+#endif
+#include <gsl/gsl_errno.h>
+#include "tensor.h"
+#include "tensor_utilities.h"
+
+/*
+ * The count can change from several threads at once, when they work
+ * with copies of the same tensor.
+ */
+#if defined(__GNUC__)
+#define COUNT_UP(n) __sync_add_and_fetch (&(n), 1)
+#define COUNT_DOWN(n) __sync_sub_and_fetch (&(n), 1)
+#else
+#define COUNT_UP(n) (++(n))
+#define COUNT_DOWN(n) (--(n))
+#endif
+
+/* Nodes a policy can name, and the words of a mask of them */
+#define NUMA_MAX_NODES 1024
+#define NUMA_MASK_WORDS (NUMA_MAX_NODES / (8 * sizeof (unsigned long)))
+
+/* For the blocks with TENSOR_NUMA_DEFAULT */
+static int numa_policy = TENSOR_NUMA_FIRST_TOUCH;
+static int numa_node = 0;
+
+
+/*
+ * Space before the data for the struct, keeping the data aligned.
+ */
+static size_t
+block_offset (size_t align)
+{
+  return (sizeof (tensor_block) + align - 1) / align * align;
+}
+
+
+/*
+ * Allocates a block with size bytes of data, aligned to align bytes
+ * (a power of two), used by one tensor.
+ */
+tensor_block *
+tensor_block_alloc (size_t size, size_t align)
+{
+  const size_t offset = block_offset (align);
+  tensor_block * b;
+  void * p;
+
+#ifdef HAVE_POSIX_MEMALIGN
+  if (align < sizeof (void *) ||
+      posix_memalign (&p, align, offset + size) != 0)
+    p = malloc (offset + size);
+#else
+  p = malloc (offset + size);
+#endif
+
+  if (p == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for block",
+                     GSL_ENOMEM, 0);
+    }
+
+  b = (tensor_block *) p;
+  b->refcount = 1;
+  b->size = size;
+  b->align = align;
+  b->data = (char *) p + offset;
+  b->flags = 0;
+  b->offset = 0;
+  b->numa_policy = TENSOR_NUMA_DEFAULT;
+  b->numa_node = 0;
+  b->numa_applied = TENSOR_NUMA_FIRST_TOUCH;
+
+  return b;
+}
+
+
+/*
+ * Allocates a new block with the same data (and NUMA policy) as b.
+ */
+tensor_block *
+tensor_block_copy (const tensor_block * b)
+{
+  tensor_block * c = tensor_block_alloc (b->size, b->align);
+
+  if (c == 0)
+    return NULL;
+
+  c->numa_policy = b->numa_policy;
+  c->numa_node = b->numa_node;
+  tensor_block_numa_apply (c);
+
+  memcpy (c->data, b->data, b->size);
+
+  return c;
+}
+
+
+/*
+ * Block with the first size bytes of the file at path as its data.
+ *
+ * With TENSOR_MMAP_WRITE the file is created or made longer if needed,
+ * and what is written into the data goes to the file; otherwise the
+ * file must have size bytes already, and the block is read-only.
+ * Without mmap() (HAVE_MMAP), only read-only blocks can be made, by
+ * reading the file into memory.
+ */
+tensor_block *
+tensor_block_mmap (const char * path, size_t size, int mode)
+{
+#ifdef HAVE_MMAP
+  const int writable = (mode & TENSOR_MMAP_WRITE) != 0;
+  tensor_block * b;
+  struct stat st;
+  void * p;
+  int fd;
+
+  if (size == 0)
+    {
+      GSL_ERROR_VAL ("can not map an empty block", GSL_EINVAL, 0);
+    }
+
+  fd = open (path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+
+  if (fd < 0)
+    {
+      GSL_ERROR_VAL ("can not open file to map", GSL_EFAILED, 0);
+    }
+
+  if (fstat (fd, &st) != 0)
+    {
+      close (fd);
+      GSL_ERROR_VAL ("can not get the size of the file to map",
+                     GSL_EFAILED, 0);
+    }
+
+  if ((size_t) st.st_size < size)
+    {
+      if (!writable)
+        {
+          close (fd);
+          GSL_ERROR_VAL ("file is too short for the tensor", GSL_EBADLEN, 0);
+        }
+
+      if (ftruncate (fd, (off_t) size) != 0)
+        {
+          close (fd);
+          GSL_ERROR_VAL ("can not extend the file to map", GSL_EFAILED, 0);
+        }
+    }
+
+  p = mmap (NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+            MAP_SHARED, fd, 0);
+
+  /* The mapping stays after the file is closed */
+  close (fd);
+
+  if (p == MAP_FAILED)
+    {
+      GSL_ERROR_VAL ("failed to map file", GSL_EFAILED, 0);
+    }
+
+#ifdef HAVE_MADVISE
+  if (mode & TENSOR_MMAP_SEQUENTIAL)
+    madvise (p, size, MADV_SEQUENTIAL);
+  else if (mode & TENSOR_MMAP_RANDOM)
+    madvise (p, size, MADV_RANDOM);
+#endif
+
+  b = (tensor_block *) malloc (sizeof (tensor_block));
+
+  if (b == 0)
+    {
+      munmap (p, size);
+      GSL_ERROR_VAL ("failed to allocate space for block", GSL_ENOMEM, 0);
+    }
+
+  b->refcount = 1;
+  b->size = size;
+  b->align = TENSOR_ALIGN;  /* of the copies; the mapping has pages */
+  b->data = p;
+  b->flags = writable ? TENSOR_BLOCK_MAPPED
+                   : TENSOR_BLOCK_MAPPED | TENSOR_BLOCK_READ_ONLY;
+  b->offset = 0;
+  b->numa_policy = TENSOR_NUMA_DEFAULT;
+  b->numa_node = 0;
+  b->numa_applied = TENSOR_NUMA_FIRST_TOUCH;
+
+  return b;
+#else
+  tensor_block * b;
+  FILE * stream;
+
+  if (mode & TENSOR_MMAP_WRITE)
+    {
+      GSL_ERROR_VAL ("files can not be mapped for writing", GSL_EUNIMPL, 0);
+    }
+
+  stream = fopen (path, "rb");
+
+  if (stream == 0)
+    {
+      GSL_ERROR_VAL ("can not open file to map", GSL_EFAILED, 0);
+    }
+
+  b = tensor_block_alloc (size, TENSOR_ALIGN);
+
+  if (b != 0 && fread (b->data, 1, size, stream) != size)
+    {
+      free (b);
+      fclose (stream);
+      GSL_ERROR_VAL ("file is too short for the tensor", GSL_EBADLEN, 0);
+    }
+
+  fclose (stream);
+
+  return b;
+#endif
+}
+
+
+/*
+ * Counts one more tensor that uses b.
+ */
+void
+tensor_block_share (tensor_block * b)
+{
+  COUNT_UP (b->refcount);
+}
+
+
+/*
+ * Marks b as written through pointers into it (if it is not NULL), so
+ * that it is never shared with copies (see TENSOR_BLOCK_SHAREABLE).
+ */
+void
+tensor_block_expose (tensor_block * b)
+{
+  if (b != NULL)
+    b->flags |= TENSOR_BLOCK_EXPOSED;
+}
+
+
+/*
+ * Counts one tensor less that uses b, and frees it if it was the last.
+ */
+void
+tensor_block_release (tensor_block * b)
+{
+  if (COUNT_DOWN (b->refcount) != 0)
+    return;
+
+#ifdef HAVE_MMAP
+  if (b->flags & TENSOR_BLOCK_MAPPED)
+    munmap ((char *) b->data - b->offset, b->offset + b->size);
+#endif
+
+  free (b);
+}
+
+
+/*
+ * Checks a NUMA policy and its node (for TENSOR_NUMA_BIND).
+ */
+static int
+numa_check (int policy, int node, int allow_default)
+{
+  if (policy < (allow_default ? TENSOR_NUMA_DEFAULT : TENSOR_NUMA_FIRST_TOUCH)
+      || policy > TENSOR_NUMA_BIND)
+    {
+      GSL_ERROR ("unknown NUMA policy", GSL_EINVAL);
+    }
+
+  if (policy == TENSOR_NUMA_BIND && (node < 0 || node >= NUMA_MAX_NODES))
+    {
+      GSL_ERROR ("NUMA node out of range", GSL_EINVAL);
+    }
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Policy (TENSOR_NUMA_...) for where the pages of the data of b go,
+ * the next time it is initialized (see tensor_block_numa_apply).
+ */
+int
+tensor_block_set_numa_policy (tensor_block * b, int policy, int node)
+{
+  int status = numa_check (policy, node, 1);
+
+  if (status)
+    return status;
+
+  b->numa_policy = policy;
+  b->numa_node = node;
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Gives the system the NUMA policy of b for its data, before it is
+ * written by tensor_set_zero and the like. The pages not written yet
+ * go to their nodes when they are first written, and those that are
+ * already somewhere else are moved.
+ *
+ * Only the pages that are entirely inside the data are placed, and
+ * never those of a mapping (they belong to its file or shared memory
+ * object). A policy the system can not follow is only a hint lost:
+ * without mbind() (HAVE_MBIND) all the policies do nothing.
+ */
+void
+tensor_block_numa_apply (tensor_block * b)
+{
+  int policy = b->numa_policy;
+  int node = b->numa_node;
+
+  if (policy == TENSOR_NUMA_DEFAULT)
+    {
+      policy = numa_policy;
+      node = numa_node;
+    }
+
+  /* Nothing to undo */
+  if (policy == TENSOR_NUMA_FIRST_TOUCH &&
+      b->numa_applied == TENSOR_NUMA_FIRST_TOUCH)
+    return;
+
+  if (b->flags & TENSOR_BLOCK_MAPPED)
+    return;
+
+#ifdef USE_NUMA
+  {
+    const size_t page = (size_t) sysconf (_SC_PAGESIZE);
+    const size_t first = (size_t) b->data;
+    const size_t last = first + b->size;
+    char * start = (char *) b->data + (page - first % page) % page;
+    char * end = (char *) b->data + b->size - last % page;
+    unsigned long mask[NUMA_MASK_WORDS];
+    size_t i;
+
+    if (end > start)
+      {
+        for (i = 0; i < NUMA_MASK_WORDS; i++)
+          mask[i] = 0;
+
+        switch (policy)
+          {
+          case TENSOR_NUMA_INTERLEAVE:
+            /* All the nodes the process can use */
+            if (get_mempolicy (NULL, mask, NUMA_MAX_NODES, NULL,
+                               MPOL_F_MEMS_ALLOWED) != 0)
+              mask[0] = ~0UL;
+            mbind (start, end - start, MPOL_INTERLEAVE, mask,
+                   NUMA_MAX_NODES + 1, MPOL_MF_MOVE);
+            break;
+          case TENSOR_NUMA_BIND:
+            mask[node / (8 * sizeof (unsigned long))] =
+              1UL << (node % (8 * sizeof (unsigned long)));
+            mbind (start, end - start, MPOL_BIND, mask,
+                   NUMA_MAX_NODES + 1, MPOL_MF_MOVE);
+            break;
+          default:
+            mbind (start, end - start, MPOL_DEFAULT, NULL, 0, 0);
+          }
+      }
+  }
+#else
+  (void) node;
+#endif
+
+  b->numa_applied = policy;
+}
+
+
+/*
+ * Policy for the data of the tensors that have TENSOR_NUMA_DEFAULT
+ * (all of them, unless they were given one of their own), and its
+ * node if it is TENSOR_NUMA_BIND.
+ */
+int
+tensor_set_default_numa_policy (int policy, int node)
+{
+  int status = numa_check (policy, node, 0);
+
+  if (status)
+    return status;
+
+  numa_policy = policy;
+  numa_node = node;
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * The policy set by tensor_set_default_numa_policy(), at first
+ * TENSOR_NUMA_FIRST_TOUCH.
+ */
+int
+tensor_get_default_numa_policy (void)
+{
+  return numa_policy;
+}
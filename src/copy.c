@@ -20,6 +20,9 @@
 #include "tensor.h"
 #include <gsl/gsl_errno.h>
 
+/* Elements swapped at once by tensor_swap() */
+#define SWAP_CHUNK 256
+
 #define BASE_COMPLEX_DOUBLE
 #include "templates_on.h"
 #include "copy_source.c"
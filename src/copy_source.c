@@ -32,7 +32,22 @@ FUNCTION (tensor, memcpy) (TYPE (tensor) * dest, const TYPE (tensor) * src)
       GSL_ERROR ("tensor sizes are different", GSL_EBADLEN);
     }
 
-  memcpy(dest->data, src->data, sizeof(BASE) * src->size);
+  /* A copy of src has its data already */
+  if (dest->block != NULL && dest->block == src->block)
+    return GSL_SUCCESS;
+
+  if (FUNCTION(tensor, unshare) (dest))
+    return GSL_ENOMEM;
+
+  {
+    const size_t rows = TENSOR_ROWS2(dest, src);
+    const size_t n = src->size / rows;
+    size_t r;
+
+    for (r = 0; r < rows; r++)
+      memcpy(dest->data + r * dest->tda, src->data + r * src->tda,
+             sizeof(BASE) * n);
+  }
 
   return GSL_SUCCESS;
 }
@@ -49,19 +64,81 @@ FUNCTION (tensor, swap) (TYPE (tensor) * t1, TYPE (tensor) * t2)
       GSL_ERROR ("tensor sizes are different", GSL_EBADLEN);
     }
 
+  /* Copies of each other have the same contents already */
+  if (t1->block != NULL && t1->block == t2->block)
+    return GSL_SUCCESS;
+
+  if (FUNCTION(tensor, unshare) (t1) || FUNCTION(tensor, unshare) (t2))
+    return GSL_ENOMEM;
+
   {
-    size_t i, j;
-    size_t n = t1->size;
+    const size_t rows = TENSOR_ROWS2(t1, t2);
+    const size_t n = t1->size / rows;
+    ATOMIC tmp[SWAP_CHUNK];
+    size_t i, r;
 
-    for (i = 0; i < n; i++)
+    /* In pieces that fit in tmp, through memcpy() */
+    for (r = 0; r < rows; r++)
       {
-        ATOMIC tmp = t1->data[i];
-	  
-        t1->data[i] = t2->data[i];
+        ATOMIC * const x1 = t1->data + r * t1->tda;
+        ATOMIC * const x2 = t2->data + r * t2->tda;
+
+        for (i = 0; i < n; i += SWAP_CHUNK)
+          {
+            const size_t len = (n - i < SWAP_CHUNK) ? n - i : SWAP_CHUNK;
 
-        t2->data[i] = tmp;
+            memcpy(tmp, x1 + i, sizeof(ATOMIC) * len);
+            memcpy(x1 + i, x2 + i, sizeof(ATOMIC) * len);
+            memcpy(x2 + i, tmp, sizeof(ATOMIC) * len);
+          }
       }
   }
 
   return GSL_SUCCESS;
 }
+
+
+/*
+ * Interchanges the data of tensors t1 and t2, which is the same as
+ * interchanging their values but takes no time if both own their
+ * data: only the pointers to it (and the layout of its rows) change
+ * places, so views of t1 see the values of t2 afterwards. Tensors in
+ * a workspace, which have no block, are swapped element by element.
+ */
+int
+FUNCTION (tensor, swap_data) (TYPE (tensor) * t1, TYPE (tensor) * t2)
+{
+  ATOMIC * data;
+  tensor_block * block;
+  size_t tda, stride;
+  unsigned int k;
+
+  if (t1->rank != t2->rank || t1->dimension != t2->dimension)
+    {
+      GSL_ERROR ("tensor sizes are different", GSL_EBADLEN);
+    }
+
+  if (t1->block == NULL || t2->block == NULL)
+    return FUNCTION (tensor, swap) (t1, t2);
+
+  data = t1->data;
+  t1->data = t2->data;
+  t2->data = data;
+
+  block = t1->block;
+  t1->block = t2->block;
+  t2->block = block;
+
+  tda = t1->tda;
+  t1->tda = t2->tda;
+  t2->tda = tda;
+
+  for (k = 0; k < t1->rank; k++)
+    {
+      stride = t1->stride[k];
+      t1->stride[k] = t2->stride[k];
+      t2->stride[k] = stride;
+    }
+
+  return GSL_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/* tensor/cpu.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Choice of the instruction set for the vectorized kernels.
+ *
+ * It is the best one that the processor supports, unless the
+ * environment variable TENSOR_ISA (or tensor_set_isa()) asks for a
+ * less capable one, which is handy to compare them. Asking for one
+ * that the processor does not support gives the best it does.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gsl/gsl_errno.h>
+#include "tensor.h"
+#include "tensor_internal.h"
+
+static const char * const isa_names[] =
+  {"generic", "sse2", "avx2", "avx512"};
+
+static int isa_level = -1;  /* not chosen yet */
+
+
+/*
+ * Best instruction set that the processor (and the operating system,
+ * which must save the wider registers) supports. Without run-time
+ * dispatch, it is the one the library was compiled for.
+ */
+static int
+isa_detect (void)
+{
+#ifdef TENSOR_DISPATCH
+  __builtin_cpu_init ();
+
+  if (__builtin_cpu_supports ("avx512f") &&
+      __builtin_cpu_supports ("avx512bw"))
+    return TENSOR_ISA_AVX512;
+  if (__builtin_cpu_supports ("avx2"))
+    return TENSOR_ISA_AVX2;
+  if (__builtin_cpu_supports ("sse2"))
+    return TENSOR_ISA_SSE2;
+#elif defined(__AVX512F__) && defined(__AVX512BW__)
+  return TENSOR_ISA_AVX512;
+#elif defined(__AVX2__)
+  return TENSOR_ISA_AVX2;
+#elif defined(__SSE2__)
+  return TENSOR_ISA_SSE2;
+#endif
+
+  return TENSOR_ISA_GENERIC;
+}
+
+
+static int
+isa_from_name (const char * name)
+{
+  int level;
+
+  for (level = TENSOR_ISA_GENERIC; level <= TENSOR_ISA_AVX512; level++)
+    if (strcmp (name, isa_names[level]) == 0)
+      return level;
+
+  return -1;
+}
+
+
+static void
+isa_init (void)
+{
+  int best = isa_detect ();
+#ifdef TENSOR_DISPATCH
+  const char * env = getenv ("TENSOR_ISA");
+  int wanted = (env != NULL) ? isa_from_name (env) : -1;
+
+  isa_level = (wanted >= 0 && wanted < best) ? wanted : best;
+#else
+  isa_level = best;
+#endif
+}
+
+
+#ifdef __GNUC__
+/* Choose when the library is loaded, before any thread can race */
+static void isa_init_at_load (void) __attribute__ ((constructor));
+
+static void
+isa_init_at_load (void)
+{
+  if (isa_level < 0)
+    isa_init ();
+}
+#endif
+
+
+int
+tensor_isa_level (void)
+{
+  if (isa_level < 0)
+    isa_init ();
+
+  return isa_level;
+}
+
+
+/*
+ * Name of the instruction set in use: "generic", "sse2", "avx2" or
+ * "avx512".
+ */
+const char *
+tensor_get_isa (void)
+{
+  return isa_names[tensor_isa_level ()];
+}
+
+
+/*
+ * Uses the given instruction set from now on. It is an error to ask
+ * for one that the processor does not support (or, without run-time
+ * dispatch, any other than the one the library was compiled for).
+ */
+int
+tensor_set_isa (const char * name)
+{
+  const int level = isa_from_name (name);
+
+  if (level < 0)
+    {
+      GSL_ERROR ("unknown instruction set", GSL_EINVAL);
+    }
+
+#ifdef TENSOR_DISPATCH
+  if (level > isa_detect ())
+#else
+  if (level != isa_detect ())
+#endif
+    {
+      GSL_ERROR ("instruction set not supported by this processor",
+                 GSL_EUNSUP);
+    }
+
+  isa_level = level;
+
+  return GSL_SUCCESS;
+}
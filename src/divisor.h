@@ -0,0 +1,137 @@
+/* tensor/divisor.h
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Division by a number that stays the same for many divisions, like
+ * the dimension of a tensor when positions are decoded into indices.
+ *
+ * divisor_init() prepares a "divisor" once, and then
+ * divisor_quotient() divides with a multiplication and a shift
+ * instead of a division instruction (see T. Granlund and
+ * P. L. Montgomery, "Division by invariant integers using
+ * multiplication", 1994), or with just a shift for powers of two.
+ * Without an integer type twice as wide as size_t, the division
+ * instruction is used.
+ */
+
+#ifndef __DIVISOR_H__
+#define __DIVISOR_H__
+
+#include <stdint.h>
+
+#if SIZE_MAX == 0xffffffffffffffffULL && defined(__SIZEOF_INT128__)
+#define DIVISOR_WIDE unsigned __int128
+#define DIVISOR_BITS 64
+#elif SIZE_MAX == 0xffffffffUL
+#define DIVISOR_WIDE unsigned long long
+#define DIVISOR_BITS 32
+#endif
+
+typedef struct
+{
+  size_t d;
+  size_t magic;        /* 0 if d is a power of two */
+  unsigned int shift;
+  int add;             /* the magic number has one bit more than size_t */
+} divisor;
+
+
+static inline void
+divisor_init (divisor * div, size_t d)
+{
+  unsigned int l = 0;  /* floor(log2(d)) */
+
+  while ((d >> l) > 1)
+    l++;
+
+  div->d = d;
+  div->shift = l;
+  div->add = 0;
+  div->magic = 0;
+
+  if ((d & (d - 1)) == 0)
+    return;
+
+#ifdef DIVISOR_WIDE
+  {
+    /* 2^(BITS+l) / d, which fits in size_t since d > 2^l */
+    const DIVISOR_WIDE num = (DIVISOR_WIDE) 1 << (DIVISOR_BITS + l);
+    size_t m = (size_t) (num / d);
+    const size_t rem = (size_t) (num % d);
+
+    if (d - rem >= ((size_t) 1 << l))
+      {
+        /* The magic number needs BITS+1 bits: keep the lower ones */
+        const size_t twice_rem = rem + rem;
+
+        m += m;
+        if (twice_rem >= d || twice_rem < rem)
+          m++;
+        div->add = 1;
+      }
+
+    div->magic = m + 1;
+  }
+#else
+  div->magic = 1;
+#endif
+}
+
+
+static inline size_t
+divisor_quotient (size_t n, const divisor * div)
+{
+  if (div->magic == 0)
+    return n >> div->shift;
+
+#ifdef DIVISOR_WIDE
+  {
+    const size_t q = (size_t) (((DIVISOR_WIDE) div->magic * n) >> DIVISOR_BITS);
+
+    if (div->add)
+      return (((n - q) >> 1) + q) >> div->shift;
+
+    return q >> div->shift;
+  }
+#else
+  return n / div->d;
+#endif
+}
+
+
+/*
+ * Same as position2index(), with the base already prepared.
+ */
+static inline void
+divisor_digits (unsigned int n_digits, const divisor * base, size_t n,
+                size_t * digits)
+{
+  unsigned int i;
+
+  for (i = 0; i < n_digits; i++)
+    {
+      const size_t q = divisor_quotient (n, base);
+
+      digits[i] = n - q * base->d;
+      n = q;
+    }
+}
+
+#endif /* __DIVISOR_H__ */
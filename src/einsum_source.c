@@ -0,0 +1,454 @@
+/* tensor/einsum_source.c
+ * 
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#include "gemm_source.c"
+
+/*
+ * Returns t with its indices permuted so that index k of the result
+ * is index perm[k] of t. If perm is the identity (and t has no padding)
+ * it returns t itself, otherwise a new tensor that the caller must free
+ * (or NULL).
+ */
+static TYPE(tensor) *
+FUNCTION(einsum, permuted) (TYPE(tensor) * t, const size_t * perm)
+{
+  TYPE(tensor) * tt;
+  unsigned int k;
+
+  for (k = 0; k < t->rank; k++)
+    if (perm[k] != k)
+      break;
+
+  if (k == t->rank && TENSOR_CONTIGUOUS(t))
+    return t;
+
+  tt = FUNCTION(tensor, alloc) (t->rank, t->dimension);
+  if (tt == NULL)
+    return NULL;
+
+  FUNCTION(tensor, permute) (tt, t, perm);
+
+  return tt;
+}
+
+
+/*
+ * Reduces a single term before it meets the others: contracts the
+ * labels it repeats (as in "ii->") and sums over the labels that
+ * appear nowhere else (neither in other terms nor in the output).
+ *
+ * On success it replaces *t (freeing it if owned) and the labels.
+ */
+static int
+FUNCTION(einsum, reduce) (TYPE(tensor) ** t, int * owned, char * labels,
+                          unsigned long long elsewhere)
+{
+  size_t pairs[TENSOR_MAX_RANK];
+  size_t perm[TENSOR_MAX_RANK];
+  char new_labels[TENSOR_MAX_RANK + 1];
+  unsigned int rank = (*t)->rank;
+  unsigned int i, j, npairs, n_keep, n_sum;
+  int used[TENSOR_MAX_RANK];
+  TYPE(tensor) * tt;
+
+  /* Repeated labels */
+  for (i = 0; i < rank; i++)
+    used[i] = 0;
+
+  npairs = 0;
+  n_keep = 0;
+  for (i = 0; i < rank; i++)
+    {
+      if (used[i])
+        continue;
+
+      for (j = i + 1; j < rank; j++)
+        if (labels[j] == labels[i])
+          {
+            /* A label three times, or a diagonal used elsewhere */
+            if (used[i] ||
+                (elsewhere & (1ULL << einsum_label_bit (labels[i]))))
+              return GSL_EUNIMPL;
+            pairs[2*npairs] = i;
+            pairs[2*npairs + 1] = j;
+            npairs++;
+            used[i] = used[j] = 1;
+          }
+
+      if (!used[i])
+        new_labels[n_keep++] = labels[i];
+    }
+
+  if (npairs > 0)
+    {
+      tt = FUNCTION(tensor, contract_many) (*t, pairs, npairs);
+      if (tt == NULL)
+        return GSL_ENOMEM;
+
+      if (*owned)
+        FUNCTION(tensor, free) (*t);
+      *t = tt;
+      *owned = 1;
+      rank = n_keep;
+      for (i = 0; i < rank; i++)
+        labels[i] = new_labels[i];
+      labels[rank] = '\0';
+    }
+
+  /* Labels to sum over: move them to the back and add up each block */
+  n_keep = 0;
+  for (i = 0; i < rank; i++)
+    if (elsewhere & (1ULL << einsum_label_bit (labels[i])))
+      {
+        new_labels[n_keep] = labels[i];
+        perm[n_keep++] = i;
+      }
+
+  n_sum = rank - n_keep;
+  if (n_sum > 0)
+    {
+      TYPE(tensor) * moved;
+      size_t block, pos, x;
+
+      j = n_keep;
+      for (i = 0; i < rank; i++)
+        if (!(elsewhere & (1ULL << einsum_label_bit (labels[i]))))
+          perm[j++] = i;
+
+      moved = FUNCTION(einsum, permuted) (*t, perm);
+      tt = FUNCTION(tensor, alloc) (n_keep, (*t)->dimension);
+      if (moved == NULL || tt == NULL)
+        {
+          if (moved != NULL && moved != *t)
+            FUNCTION(tensor, free) (moved);
+          if (tt != NULL)
+            FUNCTION(tensor, free) (tt);
+          return GSL_ENOMEM;
+        }
+
+      block = moved->size / tt->size;
+      for (pos = 0; pos < tt->size; pos++)
+        {
+          const ATOMIC * const src = moved->data + pos * block;
+          ATOMIC sum = 0;
+
+          for (x = 0; x < block; x++)
+            sum += src[x];
+
+          tt->data[pos] = sum;
+        }
+
+      if (moved != *t)
+        FUNCTION(tensor, free) (moved);
+      if (*owned)
+        FUNCTION(tensor, free) (*t);
+      *t = tt;
+      *owned = 1;
+      for (i = 0; i < n_keep; i++)
+        labels[i] = new_labels[i];
+      labels[n_keep] = '\0';
+    }
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Contracts two terms a and b (with labels la and lb) into a new
+ * tensor, stored in *c with its labels in lc. Labels in keep are
+ * still needed afterwards (by other terms or by the output).
+ *
+ * Shared labels that are kept become batch indices and the others
+ * are summed over, so with the operands permuted to
+ *   a -> [batch, free a, summed]  and  b -> [batch, summed, free b]
+ * the result [batch, free a, free b] is a batch of matrix products.
+ */
+static int
+FUNCTION(einsum, pair) (TYPE(tensor) * a, const char * la,
+                        TYPE(tensor) * b, const char * lb,
+                        unsigned long long keep,
+                        TYPE(tensor) ** c, char * lc)
+{
+  const size_t dimension = a->dimension;
+  const unsigned long long ma = einsum_mask (la), mb = einsum_mask (lb);
+  const unsigned long long shared = ma & mb;
+  size_t perm_a[TENSOR_MAX_RANK], perm_b[TENSOR_MAX_RANK];
+  unsigned int i, j, n_batch, n_free_a, n_free_b, n_sum, rank_c;
+  size_t n_batches, m, n, k, x;
+  TYPE(tensor) * aa;
+  TYPE(tensor) * bb;
+
+  n_batch = einsum_count (shared & keep);
+  n_sum = einsum_count (shared & ~keep);
+  n_free_a = a->rank - n_batch - n_sum;
+  n_free_b = b->rank - n_batch - n_sum;
+  rank_c = n_batch + n_free_a + n_free_b;
+
+  if (rank_c > TENSOR_MAX_RANK)
+    return GSL_EINVAL;
+
+  /* a -> [batch, free a, summed], and the labels of the result */
+  j = 0;
+  for (i = 0; i < a->rank; i++)
+    if (shared & keep & (1ULL << einsum_label_bit (la[i])))
+      {
+        lc[j] = la[i];
+        perm_a[j++] = i;
+      }
+  for (i = 0; i < a->rank; i++)
+    if (!(shared & (1ULL << einsum_label_bit (la[i]))))
+      {
+        lc[j] = la[i];
+        perm_a[j++] = i;
+      }
+  for (i = 0; i < a->rank; i++)
+    if (shared & ~keep & (1ULL << einsum_label_bit (la[i])))
+      perm_a[j++] = i;
+
+  /* b -> [batch, summed, free b], shared labels in the order of a */
+  for (j = 0; j < n_batch + n_sum; j++)
+    {
+      const char label = la[perm_a[j < n_batch ? j : j + n_free_a]];
+
+      for (i = 0; lb[i] != label; i++)
+        ;
+      perm_b[j] = i;
+    }
+  for (i = 0; i < b->rank; i++)
+    if (!(shared & (1ULL << einsum_label_bit (lb[i]))))
+      {
+        lc[n_batch + n_free_a + (j - n_batch - n_sum)] = lb[i];
+        perm_b[j++] = i;
+      }
+  lc[rank_c] = '\0';
+
+  aa = FUNCTION(einsum, permuted) (a, perm_a);
+  bb = FUNCTION(einsum, permuted) (b, perm_b);
+  *c = FUNCTION(tensor, alloc) (rank_c, dimension);
+
+  if (aa == NULL || bb == NULL || *c == NULL)
+    {
+      if (aa != NULL && aa != a)
+        FUNCTION(tensor, free) (aa);
+      if (bb != NULL && bb != b)
+        FUNCTION(tensor, free) (bb);
+      if (*c != NULL)
+        FUNCTION(tensor, free) (*c);
+      return GSL_ENOMEM;
+    }
+
+  n_batches = quick_pow (dimension, n_batch);
+  m = quick_pow (dimension, n_free_a);
+  n = quick_pow (dimension, n_free_b);
+  k = quick_pow (dimension, n_sum);
+
+  for (x = 0; x < n_batches; x++)
+    FUNCTION(tensor, gemm) (m, n, k, aa->data + x * m * k,
+                            bb->data + x * k * n, (*c)->data + x * m * n);
+
+  if (aa != a)
+    FUNCTION(tensor, free) (aa);
+  if (bb != b)
+    FUNCTION(tensor, free) (bb);
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Einstein summation over the n tensors, as described by spec. For
+ * example "ij,jk->ik" is a matrix product, "ii->" a trace, "ijk->kji"
+ * a permutation and "abc,cd,de->abe" a chain of contractions.
+ *
+ * The terms are contracted two at a time, in the order that
+ * einsum_path() finds cheapest, and each pairwise contraction is
+ * done as a (batched) matrix product. No index of the full product
+ * of all the tensors is ever built.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, einsum) (const char * spec, size_t n,
+                          TYPE(tensor) * const tensors[])
+{
+  unsigned int * ranks;
+  char output[TENSOR_MAX_RANK + 1];
+  char * label_space;
+  char ** labels;
+  size_t * path;
+  TYPE(tensor) ** terms;
+  int * owned;
+  TYPE(tensor) * result = NULL;
+  size_t perm[TENSOR_MAX_RANK];
+  size_t k, i, j, n_terms = 0;
+  int status = GSL_SUCCESS;
+
+  if (n == 0)
+    {
+      GSL_ERROR_NULL ("einsum needs at least one tensor", GSL_EINVAL);
+    }
+
+  for (k = 1; k < n; k++)
+    if (tensors[k]->dimension != tensors[0]->dimension)
+      {
+        GSL_ERROR_NULL ("tensors must have same underlying dimension",
+                        GSL_EBADLEN);
+      }
+
+  ranks = (unsigned int *) malloc (n * sizeof (unsigned int));
+  label_space = (char *) malloc (n * (TENSOR_MAX_RANK + 1));
+  labels = (char **) malloc (n * sizeof (char *));
+  path = (size_t *) malloc (2 * n * sizeof (size_t));
+  terms = (TYPE(tensor) **) malloc (n * sizeof (TYPE(tensor) *));
+  owned = (int *) malloc (n * sizeof (int));
+
+  if (ranks == NULL || label_space == NULL || labels == NULL ||
+      path == NULL || terms == NULL || owned == NULL)
+    {
+      status = GSL_ENOMEM;
+      goto end;
+    }
+
+  for (k = 0; k < n; k++)
+    {
+      ranks[k] = tensors[k]->rank;
+      labels[k] = label_space + k * (TENSOR_MAX_RANK + 1);
+      terms[k] = tensors[k];
+      owned[k] = 0;
+    }
+  n_terms = n;
+
+  if (einsum_parse (spec, n, ranks, labels, output) != GSL_SUCCESS)
+    {
+      status = GSL_EINVAL;
+      goto end;
+    }
+
+  /* Reduce each term on its own first */
+  for (k = 0; k < n; k++)
+    {
+      unsigned long long elsewhere = einsum_mask (output);
+
+      for (i = 0; i < n; i++)
+        if (i != k)
+          elsewhere |= einsum_mask (labels[i]);
+
+      status = FUNCTION(einsum, reduce) (&terms[k], &owned[k], labels[k],
+                                         elsewhere);
+      if (status)
+        goto end;
+    }
+
+  /* Then contract them two at a time */
+  status = einsum_path (n, labels, output, tensors[0]->dimension, path);
+  if (status)
+    goto end;
+
+  for (; n_terms > 1; n_terms--)
+    {
+      const size_t a = path[2 * (n - n_terms)];
+      const size_t b = path[2 * (n - n_terms) + 1];
+      unsigned long long keep = einsum_mask (output);
+      char lc[TENSOR_MAX_RANK + 1];
+      TYPE(tensor) * c;
+
+      for (i = 0; i < n_terms; i++)
+        if (i != a && i != b)
+          keep |= einsum_mask (labels[i]);
+
+      status = FUNCTION(einsum, pair) (terms[a], labels[a],
+                                       terms[b], labels[b], keep, &c, lc);
+      if (status)
+        goto end;
+
+      if (owned[a])
+        FUNCTION(tensor, free) (terms[a]);
+      if (owned[b])
+        FUNCTION(tensor, free) (terms[b]);
+
+      /* Remove terms a and b (a < b) and append c, reusing label space */
+      {
+        char * la = labels[a];
+        char * lb = labels[b];
+
+        for (i = b; i + 1 < n_terms; i++)
+          {
+            terms[i] = terms[i+1];
+            owned[i] = owned[i+1];
+            labels[i] = labels[i+1];
+          }
+        for (i = a; i + 1 < n_terms - 1; i++)
+          {
+            terms[i] = terms[i+1];
+            owned[i] = owned[i+1];
+            labels[i] = labels[i+1];
+          }
+        terms[n_terms - 2] = c;
+        owned[n_terms - 2] = 1;
+        labels[n_terms - 2] = la;
+        labels[n_terms - 1] = lb;
+        for (i = 0; (la[i] = lc[i]) != '\0'; i++)
+          ;
+      }
+    }
+
+  /* Finally put the indices in the order of the output */
+  for (i = 0; output[i] != '\0'; i++)
+    {
+      for (j = 0; labels[0][j] != output[i]; j++)
+        ;
+      perm[i] = j;
+    }
+
+  result = FUNCTION(einsum, permuted) (terms[0], perm);
+  if (result == terms[0] && !owned[0])
+    result = FUNCTION(tensor, copy) (terms[0]);
+  if (result == NULL)
+    status = GSL_ENOMEM;
+  if (result != terms[0] && owned[0])
+    FUNCTION(tensor, free) (terms[0]);
+  n_terms = 0;
+
+ end:
+  for (k = 0; k < n_terms; k++)
+    if (owned[k])
+      FUNCTION(tensor, free) (terms[k]);
+
+  free (ranks);
+  free (label_space);
+  free (labels);
+  free (path);
+  free (terms);
+  free (owned);
+
+  if (status == GSL_EUNIMPL)
+    {
+      GSL_ERROR_NULL ("einsum supports only traces of repeated labels",
+                      GSL_EUNIMPL);
+    }
+  else if (status == GSL_EINVAL)
+    {
+      GSL_ERROR_NULL ("bad einsum specification", GSL_EINVAL);
+    }
+  else if (status)
+    {
+      GSL_ERROR_NULL ("no memory for einsum", GSL_ENOMEM);
+    }
+
+  return result;
+}
@@ -23,18 +23,30 @@
  * Reads the (binary stored) contents of a tensor from a stream.
  *
  * The tensor must be properly allocated before calling to this function.
+ * The elements are stored one after the other, without the padding of
+ * the rows of an aligned tensor, so it can be read from a file written
+ * with any other tensor of the same size.
  */
 int
 FUNCTION(tensor, fread) (FILE * stream, TYPE(tensor) * t)
 {
-  size_t n = t->size;
-  ATOMIC * data = t->data;
+  const size_t rows = TENSOR_ROWS(t);
+  const size_t n = TENSOR_ROW_LENGTH(t);
+  size_t r;
 
-  size_t items = fread(data, sizeof(ATOMIC), n, stream);
+  if (FUNCTION(tensor, unshare) (t))
+    return GSL_ENOMEM;
 
-  if (items != n)
+  for (r = 0; r < rows; r++)
     {
-      GSL_ERROR ("fread failed", GSL_EFAILED);
+      ATOMIC * data = t->data + r * t->tda;
+
+      size_t items = fread(data, sizeof(ATOMIC), n, stream);
+
+      if (items != n)
+        {
+          GSL_ERROR ("fread failed", GSL_EFAILED);
+        }
     }
 
   return GSL_SUCCESS;
@@ -47,14 +59,20 @@ FUNCTION(tensor, fread) (FILE * stream, TYPE(tensor) * t)
 int
 FUNCTION(tensor, fwrite) (FILE * stream, const TYPE(tensor) * t)
 {
-  size_t n = t->size;
-  ATOMIC * data = t->data;
-
-  size_t items = fwrite(data, sizeof(ATOMIC), n, stream);
+  const size_t rows = TENSOR_ROWS(t);
+  const size_t n = TENSOR_ROW_LENGTH(t);
+  size_t r;
 
-  if (items != n)
+  for (r = 0; r < rows; r++)
     {
-      GSL_ERROR ("fwrite failed", GSL_EFAILED);
+      ATOMIC * data = t->data + r * t->tda;
+
+      size_t items = fwrite(data, sizeof(ATOMIC), n, stream);
+
+      if (items != n)
+        {
+          GSL_ERROR ("fwrite failed", GSL_EFAILED);
+        }
     }
 
   return GSL_SUCCESS;
@@ -66,32 +84,36 @@ int
 FUNCTION(tensor, fprintf) (FILE * stream, const TYPE(tensor) * t,
                            const char *format)
 {
-  size_t i;
-  size_t n = t->size ;
-
-  ATOMIC * data = t->data;
+  const size_t rows = TENSOR_ROWS(t);
+  const size_t n = TENSOR_ROW_LENGTH(t);
+  size_t i, r;
 
   int status = 0;
 
-  for (i = 0; i < n; i++)
+  for (r = 0; r < rows; r++)
     {
+      ATOMIC * data = t->data + r * t->tda;
+
+      for (i = 0; i < n; i++)
+        {
 #if defined(BASE_COMPLEX_DOUBLE)
-      status = fprintf(stream, format, creal(data[i]));
-      status = putc(' ', stream);
-      status = fprintf(stream, format, cimag(data[i]));
+          status = fprintf(stream, format, creal(data[i]));
+          status = putc(' ', stream);
+          status = fprintf(stream, format, cimag(data[i]));
 #else
-      status = fprintf(stream, format, data[i]);
+          status = fprintf(stream, format, data[i]);
 #endif
-      if (status < 0)
-        {
-          GSL_ERROR ("fprintf failed", GSL_EFAILED);
-        }
+          if (status < 0)
+            {
+              GSL_ERROR ("fprintf failed", GSL_EFAILED);
+            }
       
-      status = putc ('\n', stream);
+          status = putc ('\n', stream);
 
-      if (status == EOF)
-        {
-          GSL_ERROR ("putc failed", GSL_EFAILED);
+          if (status == EOF)
+            {
+              GSL_ERROR ("putc failed", GSL_EFAILED);
+            }
         }
     }
 
@@ -102,30 +124,37 @@ FUNCTION(tensor, fprintf) (FILE * stream, const TYPE(tensor) * t,
 int
 FUNCTION(tensor, fscanf) (FILE * stream, TYPE(tensor) * t)
 {
-  size_t i;
-  size_t n = t->size;
-
-  ATOMIC * data = t->data;
+  const size_t rows = TENSOR_ROWS(t);
+  const size_t n = TENSOR_ROW_LENGTH(t);
+  size_t i, r;
 
   int status = 0;
 
-  for (i = 0; i < n; i++)
+  if (FUNCTION(tensor, unshare) (t))
+    return GSL_ENOMEM;
+
+  for (r = 0; r < rows; r++)
     {
+      ATOMIC * data = t->data + r * t->tda;
+
+      for (i = 0; i < n; i++)
+        {
 #if defined(BASE_COMPLEX_DOUBLE)
-      ATOMIC_IO tmp1;
-      ATOMIC_IO tmp2;
-      status = fscanf(stream, IN_FORMAT, &tmp1);
-      status = fscanf(stream, IN_FORMAT, &tmp2);
-      *(&data[i]) = tmp1;
-      *(&(double)data[i]+1) = tmp2;
+          ATOMIC_IO tmp1;
+          ATOMIC_IO tmp2;
+          status = fscanf(stream, IN_FORMAT, &tmp1);
+          status = fscanf(stream, IN_FORMAT, &tmp2);
+          *(&data[i]) = tmp1;
+          *(&(double)data[i]+1) = tmp2;
 #else
-      ATOMIC_IO tmp;
-      status = fscanf(stream, IN_FORMAT, &tmp) ;
-      data[i] = tmp;
+          ATOMIC_IO tmp;
+          status = fscanf(stream, IN_FORMAT, &tmp) ;
+          data[i] = tmp;
 #endif
 
-      if (status != 1)
-        GSL_ERROR ("fscanf failed", GSL_EFAILED);
+          if (status != 1)
+            GSL_ERROR ("fscanf failed", GSL_EFAILED);
+        }
     }
 
   return GSL_SUCCESS;
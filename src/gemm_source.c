@@ -0,0 +1,71 @@
+/* tensor/gemm_source.c
+ * 
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * C = A * B for row-major matrices A (m x k) and B (k x n).
+ *
+ * This is shared by the functions that reduce tensor operations to
+ * matrix products (tensordot, einsum), so it is included in their
+ * source files rather than compiled on its own.
+ *
+ * It goes to the BLAS for the types it knows about, and is a plain
+ * loop (in the cache-friendly i-k-j order) for the rest.
+ */
+static void
+FUNCTION(tensor, gemm) (size_t m, size_t n, size_t k,
+                        const ATOMIC * A, const ATOMIC * B, ATOMIC * C)
+{
+  size_t i, j, l;
+
+#if defined(BASE_DOUBLE) || defined(BASE_FLOAT) || defined(BASE_COMPLEX_DOUBLE)
+  if (m <= INT_MAX && n <= INT_MAX && k <= INT_MAX)
+    {
+#if defined(BASE_DOUBLE)
+      cblas_dgemm (CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                   (int) m, (int) n, (int) k, 1.0, A, (int) k, B, (int) n,
+                   0.0, C, (int) n);
+#elif defined(BASE_FLOAT)
+      cblas_sgemm (CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                   (int) m, (int) n, (int) k, 1.0f, A, (int) k, B, (int) n,
+                   0.0f, C, (int) n);
+#else
+      const ATOMIC one = 1.0, zero = 0.0;
+      cblas_zgemm (CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                   (int) m, (int) n, (int) k, &one, A, (int) k, B, (int) n,
+                   &zero, C, (int) n);
+#endif
+      return;
+    }
+#endif
+
+  for (i = 0; i < m * n; i++)
+    C[i] = 0;
+
+  for (i = 0; i < m; i++)
+    for (l = 0; l < k; l++)
+      {
+        const ATOMIC a_il = A[i * k + l];
+        const ATOMIC * b_l = B + l * n;
+        ATOMIC * c_i = C + i * n;
+
+        for (j = 0; j < n; j++)
+          c_i[j] += a_il * b_l[j];
+      }
+}
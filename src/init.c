@@ -20,6 +20,12 @@
 #include <gsl/gsl_errno.h>
 #include "tensor.h"
 
+/* Bytes for the struct of a tensor of the given rank and its strides */
+#define HEADER_SIZE(rank) (sizeof (TYPE(tensor)) + (rank) * sizeof (size_t))
+
+/* Alignment of the data of tensors not from tensor_alloc_aligned() */
+#define DATA_ALIGN 16
+
 #define BASE_COMPLEX_DOUBLE
 #include "templates_on.h"
 #include "init_source.c"
@@ -23,20 +23,49 @@
  * the gsl/matrix directory
  */
 
-#include "tensor_utilities.h"
+#include "tensor_internal.h"
 
-#include <string.h>  /* to use memcpy() */
 
 
 /* ------ Allocation ------ */
 
 /*
- * Allocate memory for a tensor and return a pointer to it.
+ * Fills in the struct of a tensor, with its strides just after it,
+ * for rows that start tda elements apart.
  */
-TYPE(tensor) *
-FUNCTION(tensor, alloc) (const unsigned int rank, const size_t dimension)
+static void
+FUNCTION(tensor, init_header) (TYPE(tensor) * t, const unsigned int rank,
+                               const size_t dimension, const size_t n,
+                               const size_t tda)
 {
-  size_t n;
+  unsigned int i;
+  size_t stride;
+
+  t->rank = rank;
+  t->dimension = dimension;
+  t->size = n;
+  t->tda = tda;
+  t->stride = (size_t *) (t + 1);
+  t->shm_write = NULL;
+
+  stride = 1;
+  for (i = rank; i > 0; i--)
+    {
+      t->stride[i-1] = stride;
+      stride = (i == rank) ? tda : stride * dimension;
+    }
+}
+
+
+/*
+ * Allocates a tensor whose rows start tda elements apart, in a block
+ * with the data aligned to align bytes.
+ */
+static TYPE(tensor) *
+FUNCTION(tensor, alloc_block) (const unsigned int rank, const size_t dimension,
+                               const size_t tda, const size_t align)
+{
+  size_t n, length;
   TYPE(tensor) * t;
 
   if (dimension == 0)
@@ -45,7 +74,7 @@ FUNCTION(tensor, alloc) (const unsigned int rank, const size_t dimension)
 		     GSL_EINVAL, 0);
     }
   
-  t = (TYPE(tensor) *) malloc (sizeof (TYPE(tensor)));
+  t = (TYPE(tensor) *) malloc (HEADER_SIZE (rank));
 
   if (t == 0)
     {
@@ -54,17 +83,69 @@ FUNCTION(tensor, alloc) (const unsigned int rank, const size_t dimension)
     }
 
   n = quick_pow(dimension, rank);
-  t->data = (ATOMIC *) malloc (n * sizeof (ATOMIC));
+  length = (rank > 1) ? (n / dimension) * tda : n;
 
-  if (t->data == 0)
+  t->block = tensor_block_alloc (length * sizeof (ATOMIC), align);
+
+  if (t->block == 0)
     {
+      free (t);
       GSL_ERROR_VAL ("failed to allocate space for data",
 		     GSL_ENOMEM, 0);
     }
 
-  t->rank = rank;
-  t->dimension = dimension;
-  t->size = n;
+  t->data = (ATOMIC *) t->block->data;
+
+  FUNCTION(tensor, init_header) (t, rank, dimension, n, tda);
+
+  return t;
+}
+
+
+/*
+ * Allocate memory for a tensor and return a pointer to it.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, alloc) (const unsigned int rank, const size_t dimension)
+{
+  return FUNCTION(tensor, alloc_block) (rank, dimension, dimension,
+                                        DATA_ALIGN);
+}
+
+
+/*
+ * Same as tensor_alloc, but the memory comes from the workspace w,
+ * or from the heap if w is NULL.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, alloc_ws) (const unsigned int rank, const size_t dimension,
+                            tensor_workspace * w)
+{
+  size_t n;
+  TYPE(tensor) * t;
+
+  if (w == NULL)
+    return FUNCTION(tensor, alloc) (rank, dimension);
+
+  if (dimension == 0)
+    {
+      GSL_ERROR_VAL ("tensor dimension must be positive integer",
+		     GSL_EINVAL, 0);
+    }
+
+  t = (TYPE(tensor) *) tensor_workspace_get (w, HEADER_SIZE (rank));
+
+  if (t == 0)
+    return NULL;
+
+  n = quick_pow(dimension, rank);
+  t->data = (ATOMIC *) tensor_workspace_get (w, n * sizeof (ATOMIC));
+  t->block = NULL;
+
+  if (t->data == 0)
+    return NULL;
+
+  FUNCTION(tensor, init_header) (t, rank, dimension, n, dimension);
 
   return t;
 }
@@ -76,19 +157,235 @@ FUNCTION(tensor, alloc) (const unsigned int rank, const size_t dimension)
 TYPE(tensor) *
 FUNCTION(tensor, calloc) (const unsigned int rank, const size_t dimension)
 {
-  size_t i;
+  return FUNCTION(tensor, calloc_ws) (rank, dimension, NULL);
+}
+
+
+/*
+ * Same as tensor_alloc, but with the data aligned to TENSOR_ALIGN
+ * bytes, and the rows too: each one is followed by the padding that
+ * its dimension elements need to fill whole blocks of TENSOR_ALIGN
+ * bytes (unless that is not a whole number of elements).
+ */
+TYPE(tensor) *
+FUNCTION(tensor, alloc_aligned) (const unsigned int rank,
+                                 const size_t dimension)
+{
+  const size_t per_block = TENSOR_ALIGN / sizeof (ATOMIC);
+  size_t tda = dimension;
+
+  if (rank > 1 && TENSOR_ALIGN % sizeof (ATOMIC) == 0)
+    tda = (dimension + per_block - 1) / per_block * per_block;
+
+  return FUNCTION(tensor, alloc_block) (rank, dimension, tda, TENSOR_ALIGN);
+}
+
+
+/*
+ * Tensor whose data is the file at path, mapped into memory: the
+ * dimension^rank elements one after the other, as tensor_fwrite()
+ * writes them. mode is TENSOR_MMAP_READ or TENSOR_MMAP_WRITE, plus
+ * TENSOR_MMAP_SEQUENTIAL or TENSOR_MMAP_RANDOM to say how the data
+ * will be read (see tensor_block_mmap()).
+ *
+ * The pages of the file are only read when they are used. Writes into
+ * a tensor mapped for reading go to a copy of the data in memory.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, mmap) (const char * path, const unsigned int rank,
+                        const size_t dimension, const int mode)
+{
+  size_t n;
+  TYPE(tensor) * t;
+
+  if (dimension == 0)
+    {
+      GSL_ERROR_VAL ("tensor dimension must be positive integer",
+		     GSL_EINVAL, 0);
+    }
+
+  t = (TYPE(tensor) *) malloc (HEADER_SIZE (rank));
+
+  if (t == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for tensor struct",
+		     GSL_ENOMEM, 0);
+    }
+
+  n = quick_pow(dimension, rank);
+
+  t->block = tensor_block_mmap (path, n * sizeof (ATOMIC), mode);
+
+  if (t->block == 0)
+    {
+      free (t);
+      return NULL;
+    }
+
+  t->data = (ATOMIC *) t->block->data;
+
+  FUNCTION(tensor, init_header) (t, rank, dimension, n, dimension);
+
+  return t;
+}
+
+
+/*
+ * Tensor in the new POSIX shared memory object "name" (a name that
+ * starts with '/'), which other processes can use with
+ * tensor_shm_open(). Its elements are not initialized.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, shm_create) (const char * name, const unsigned int rank,
+                              const size_t dimension)
+{
   size_t n;
+  TYPE(tensor) * t;
 
-  TYPE(tensor) * t = FUNCTION(tensor, alloc) (rank, dimension);
+  if (dimension == 0)
+    {
+      GSL_ERROR_VAL ("tensor dimension must be positive integer",
+		     GSL_EINVAL, 0);
+    }
+
+  t = (TYPE(tensor) *) malloc (HEADER_SIZE (rank));
 
   if (t == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for tensor struct",
+		     GSL_ENOMEM, 0);
+    }
+
+  n = quick_pow(dimension, rank);
+
+  t->block = tensor_block_shm_create (name, NAME(tensor), rank, dimension,
+                                      n * sizeof (ATOMIC));
+
+  if (t->block == 0)
+    {
+      free (t);
+      return NULL;
+    }
+
+  t->data = (ATOMIC *) t->block->data;
+
+  FUNCTION(tensor, init_header) (t, rank, dimension, n, dimension);
+
+  return t;
+}
+
+
+/*
+ * Tensor in the shared memory object "name", made by another process
+ * with tensor_shm_create(), with the same data (not a copy of it).
+ * mode is TENSOR_MMAP_READ or TENSOR_MMAP_WRITE, as for tensor_mmap.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, shm_open) (const char * name, const int mode)
+{
+  const tensor_shm_header * h;
+  TYPE(tensor) * t;
+  tensor_block * b;
+
+  b = tensor_block_shm_open (name, NAME(tensor), sizeof (ATOMIC), mode);
+
+  if (b == 0)
     return NULL;
-  
-  /* initialize tensor to zero */
-  
-  n = t->size;
-  for (i = 0; i < n; i++)
-    t->data[i] = 0;
+
+  h = tensor_block_shm_header (b);
+
+  t = (TYPE(tensor) *) malloc (HEADER_SIZE (h->rank));
+
+  if (t == 0)
+    {
+      tensor_block_release (b);
+      GSL_ERROR_VAL ("failed to allocate space for tensor struct",
+		     GSL_ENOMEM, 0);
+    }
+
+  t->block = b;
+  t->data = (ATOMIC *) b->data;
+
+  FUNCTION(tensor, init_header) (t, h->rank, h->dimension,
+                                 quick_pow(h->dimension, h->rank),
+                                 h->dimension);
+
+  return t;
+}
+
+
+/*
+ * The sequence lock of a tensor in shared memory: a process writes
+ * between tensor_shm_write_begin and tensor_shm_write_end, and one
+ * that reads gets a version with tensor_shm_read_begin and reads
+ * again while tensor_shm_read_retry says the data changed. For a
+ * tensor that is not in shared memory they do nothing.
+ *
+ * The tensor keeps the header whose version write_begin changed, so
+ * that write_end always finishes the write on it.
+ */
+void
+FUNCTION(tensor, shm_write_begin) (TYPE(tensor) * t)
+{
+  tensor_shm_header * h = tensor_block_shm_header (t->block);
+
+  if (h == NULL)
+    return;
+
+  if (t->block->flags & TENSOR_BLOCK_READ_ONLY)
+    {
+      GSL_ERROR_VOID ("shared memory was opened only to read", GSL_EINVAL);
+    }
+
+  t->shm_write = h;
+  tensor_shm_header_write_begin (h);
+}
+
+
+void
+FUNCTION(tensor, shm_write_end) (TYPE(tensor) * t)
+{
+  if (t->shm_write == NULL)
+    return;
+
+  tensor_shm_header_write_end (t->shm_write);
+  t->shm_write = NULL;
+}
+
+
+unsigned long
+FUNCTION(tensor, shm_read_begin) (const TYPE(tensor) * t)
+{
+  const tensor_shm_header * h = tensor_block_shm_header (t->block);
+
+  return (h != NULL) ? tensor_shm_header_read_begin (h) : 0;
+}
+
+
+int
+FUNCTION(tensor, shm_read_retry) (const TYPE(tensor) * t,
+                                  unsigned long version)
+{
+  const tensor_shm_header * h = tensor_block_shm_header (t->block);
+
+  return (h != NULL) ? tensor_shm_header_read_retry (h, version) : 0;
+}
+
+
+/*
+ * Same as tensor_alloc_ws, but put all elements to 0.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, calloc_ws) (const unsigned int rank, const size_t dimension,
+                             tensor_workspace * w)
+{
+  TYPE(tensor) * t = FUNCTION(tensor, alloc_ws) (rank, dimension, w);
+
+  if (t == 0)
+    return NULL;
+
+  /* In parallel, so the pages go near the threads (see set_run) */
+  FUNCTION(tensor, set_zero) (t);
 
   return t;
 }
@@ -100,15 +397,63 @@ FUNCTION(tensor, calloc) (const unsigned int rank, const size_t dimension)
 TYPE(tensor) *
 FUNCTION(tensor, copy) (TYPE(tensor) * tt)
 {
-  TYPE(tensor) * t = FUNCTION(tensor, alloc) (tt->rank, tt->dimension);
+  return FUNCTION(tensor, copy_ws) (tt, NULL);
+}
+
+
+/*
+ * Copy from an existing tensor, into the workspace w.
+ *
+ * Unless w is given (or tt has no block), the copy shares the data of
+ * tt, which is only duplicated when one of them is written. Data that
+ * can be written without that check (see TENSOR_BLOCK_SHAREABLE) is
+ * duplicated right away.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, copy_ws) (const TYPE(tensor) * tt, tensor_workspace * w)
+{
+  TYPE(tensor) * t;
+
+  if (w == NULL && tt->block != NULL)
+    {
+      t = (TYPE(tensor) *) malloc (HEADER_SIZE (tt->rank));
+
+      if (t == 0)
+        {
+          GSL_ERROR_VAL ("failed to allocate space for tensor struct",
+                         GSL_ENOMEM, 0);
+        }
+
+      if (TENSOR_BLOCK_SHAREABLE(tt->block))
+        {
+          t->block = tt->block;
+          tensor_block_share (t->block);
+        }
+      else
+        {
+          /* Something may write into tt's block without unsharing it */
+          t->block = tensor_block_copy (tt->block);
+
+          if (t->block == 0)
+            {
+              free (t);
+              return NULL;
+            }
+        }
+
+      t->data = (ATOMIC *) t->block->data;
+
+      FUNCTION(tensor, init_header) (t, tt->rank, tt->dimension, tt->size,
+                                     tt->tda);
+      return t;
+    }
+
+  t = FUNCTION(tensor, alloc_ws) (tt->rank, tt->dimension, w);
 
   if (t == 0)
     return NULL;
   
-  t->rank = tt->rank;
-  t->dimension = tt->dimension;
-  t->size = tt->size;
-  memcpy(t->data, tt->data, sizeof(BASE) * tt->size);
+  FUNCTION(tensor, memcpy) (t, tt);
 
   return t;
 }
@@ -120,11 +465,59 @@ FUNCTION(tensor, copy) (TYPE(tensor) * tt)
 void
 FUNCTION(tensor, free) (TYPE(tensor) * t)
 {
-  free(t->data);
+  if (t->block != NULL)
+    tensor_block_release (t->block);
   free(t);
 }
 
 
+/*
+ * Gives t a block of its own, with a copy of the data, if it shares
+ * it with other tensors. This is done before writing into a tensor.
+ */
+int
+FUNCTION(tensor, unshare) (TYPE(tensor) * t)
+{
+  tensor_block * b;
+
+  if (!TENSOR_BLOCK_SHARED(t->block))
+    return GSL_SUCCESS;
+
+  b = tensor_block_copy (t->block);
+
+  if (b == 0)
+    {
+      GSL_ERROR ("failed to allocate space to unshare data", GSL_ENOMEM);
+    }
+
+  tensor_block_release (t->block);
+  t->block = b;
+  t->data = (ATOMIC *) b->data;
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Where the pages of the data of t (and of the copies that share it)
+ * go on a NUMA machine: policy is one of TENSOR_NUMA_... (see
+ * tensor_block.h), and node is the node for TENSOR_NUMA_BIND. It is
+ * followed the next time the data is initialized, by tensor_set_zero
+ * or tensor_set_all. Tensors that do not own their data (in a
+ * workspace, or of existing data) can not have a policy.
+ */
+int
+FUNCTION(tensor, set_numa_policy) (TYPE(tensor) * t, int policy, int node)
+{
+  if (t->block == NULL)
+    {
+      GSL_ERROR ("tensor does not own its data", GSL_EINVAL);
+    }
+
+  return tensor_block_set_numa_policy (t->block, policy, node);
+}
+
+
 
 /* ------ Conversions ------ */
 
@@ -141,6 +534,11 @@ FUNCTION (tensor, 2matrix) (TYPE (tensor) * t)
   if (t->rank != 2)
     GSL_ERROR_NULL("tensor of rank != 2", GSL_EINVAL);
 
+  /* The result is a way to write into t */
+  if (FUNCTION(tensor, unshare) (t))
+    return NULL;
+
+  tensor_block_expose (t->block);
 
   m = (TYPE (gsl_matrix) *) malloc (sizeof (TYPE (gsl_matrix)));
   if (m == 0)
@@ -154,7 +552,7 @@ FUNCTION (tensor, 2matrix) (TYPE (tensor) * t)
 #endif
   m->size1 = n;
   m->size2 = n;
-  m->tda = n;
+  m->tda = t->tda;
   m->block = NULL;  /* note that this is no problem because owner=0 */
   m->owner = 0;
 
@@ -174,6 +572,11 @@ FUNCTION (tensor, 2vector) (TYPE (tensor) * t)
   if (t->rank != 1)
     GSL_ERROR_NULL("tensor of rank != 1", GSL_EINVAL);
 
+  /* The result is a way to write into t */
+  if (FUNCTION(tensor, unshare) (t))
+    return NULL;
+
+  tensor_block_expose (t->block);
 
   v = (TYPE (gsl_vector) *) malloc (sizeof (TYPE (gsl_vector)));
   if (v == 0)
@@ -195,38 +598,187 @@ FUNCTION (tensor, 2vector) (TYPE (tensor) * t)
 
 
 
+/* ------ Tensors of existing data ------ */
+
+
+/*
+ * Tensor with the data at "data", rows tda elements apart (see
+ * tensor_alloc_aligned). The data still belongs to the caller:
+ * tensor_free() only frees the struct, and it is never copied when
+ * the tensor is copied or written.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, view_array_with_tda) (ATOMIC * data,
+                                       const unsigned int rank,
+                                       const size_t dimension,
+                                       const size_t tda)
+{
+  TYPE(tensor) * t;
+
+  if (dimension == 0)
+    {
+      GSL_ERROR_VAL ("tensor dimension must be positive integer",
+		     GSL_EINVAL, 0);
+    }
+
+  if (rank > 1 && tda < dimension)
+    {
+      GSL_ERROR_VAL ("tda must be at least the dimension",
+                     GSL_EINVAL, 0);
+    }
+
+  t = (TYPE(tensor) *) malloc (HEADER_SIZE (rank));
+
+  if (t == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for tensor struct",
+		     GSL_ENOMEM, 0);
+    }
+
+  t->data = data;
+  t->block = NULL;
+
+  FUNCTION(tensor, init_header) (t, rank, dimension,
+                                 quick_pow(dimension, rank),
+                                 (rank > 1) ? tda : dimension);
+
+  return t;
+}
+
+
+/*
+ * Tensor with the dimension^rank elements at "data", one after the
+ * other, which still belong to the caller.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, view_array) (ATOMIC * data, const unsigned int rank,
+                              const size_t dimension)
+{
+  return FUNCTION(tensor, view_array_with_tda) (data, rank, dimension,
+                                                dimension);
+}
+
+
+/*
+ * Rank 2 tensor with the elements of the square matrix m, which it
+ * shares. This is the reverse of tensor_2matrix.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, view_matrix) (TYPE (gsl_matrix) * m)
+{
+  if (m->size1 != m->size2)
+    GSL_ERROR_NULL("matrix is not square", GSL_EBADLEN);
+
+  return FUNCTION(tensor, view_array_with_tda) ((ATOMIC *) m->data, 2,
+                                                m->size1, m->tda);
+}
+
+
+/*
+ * Rank 1 tensor with the elements of vector v, which it shares. This
+ * is the reverse of tensor_2vector.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, view_vector) (TYPE (gsl_vector) * v)
+{
+  if (v->stride != 1)
+    GSL_ERROR_NULL("vector elements are not contiguous", GSL_EINVAL);
+
+  return FUNCTION(tensor, view_array) ((ATOMIC *) v->data, 1, v->size);
+}
+
+
+
 
 /* ------ Operations ------ */
 
 
+/* A tensor to fill with x: its rows or, if rows is 1, all its data */
+typedef struct
+{
+  ATOMIC * data;
+  size_t tda, rows, n;
+  BASE x;
+} TYPE(set_job);
+
+
 /*
- * t = 0  (all elements = 0)
+ * Puts x in the rows (or, if there is one, the elements) from begin to
+ * end - 1 of the job at arg, in one of the threads.
  */
-void
-FUNCTION(tensor, set_zero) (TYPE(tensor) * t)
+static void
+FUNCTION(tensor, set_part) (void * arg, size_t begin, size_t end)
 {
-  ATOMIC * const data = t->data;
-  size_t i, n;
+  const TYPE(set_job) * job = (const TYPE(set_job) *) arg;
+  const BASE x = job->x;
+  size_t i, r;
 
-  n = t->size;
+  if (job->rows == 1)
+    {
+      for (i = begin; i < end; i++)
+        *(BASE *) (job->data + i) = x;
+      return;
+    }
 
-  for (i = 0; i < n; i++)
+  for (r = begin; r < end; r++)
     {
-      *(BASE *) (data + i) = 0;
+      ATOMIC * const data = job->data + r * job->tda;
+
+      for (i = 0; i < job->n; i++)
+        *(BASE *) (data + i) = x;
     }
 }
 
 
+/*
+ * Puts x in all the elements of t, split among the threads.
+ *
+ * This is how new data is initialized, so it is where the pages get
+ * placed on the NUMA nodes: with the policy of the block, or (for
+ * TENSOR_NUMA_FIRST_TOUCH) each one near the thread that writes it,
+ * as later operations split the data in the same parts.
+ */
+static void
+FUNCTION(tensor, set_run) (TYPE(tensor) * t, BASE x)
+{
+  TYPE(set_job) job;
+
+  if (t->block != NULL)
+    tensor_block_numa_apply (t->block);
+
+  job.data = t->data;
+  job.tda = t->tda;
+  job.rows = TENSOR_ROWS(t);
+  job.n = TENSOR_ROW_LENGTH(t);
+  job.x = x;
+
+  tensor_parallel_for (PARALLEL_ITEMS(job.rows, job.n),
+                       PARALLEL_GRAIN(job.rows, job.n, PARALLEL_MIN_SET),
+                       FUNCTION(tensor, set_part), &job);
+}
+
+
+/*
+ * t = 0  (all elements = 0)
+ */
+void
+FUNCTION(tensor, set_zero) (TYPE(tensor) * t)
+{
+  if (FUNCTION(tensor, unshare) (t))
+    return;
+
+  FUNCTION(tensor, set_run) (t, 0);
+}
+
+
 /*
  * t_ijk = x  (for i,j,k = 0,1,...,dimension-1)
  */
 void
 FUNCTION(tensor, set_all) (TYPE(tensor) * t, BASE x)
 {
-  size_t i, n;
-  ATOMIC * const data = t->data;
+  if (FUNCTION(tensor, unshare) (t))
+    return;
 
-  n = t->size;
-  for (i = 0; i < n; i ++)
-    *(BASE *) (data + i) = x;
+  FUNCTION(tensor, set_run) (t, x);
 }
@@ -18,7 +18,22 @@
 
 #include <config.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <gsl/gsl_math.h>
 #include "tensor.h"
+#include "tensor_internal.h"
+#include "divisor.h"
+
+/* Elements (16 kB of doubles) reduced by each call to the kernel */
+#define MINMAX_BLOCK 2048
+
+/*
+ * Elements in each chunk of a reduction split among threads, and
+ * number of chunks whose results are kept at a time.
+ */
+#define REDUCE_CHUNK (32 * MINMAX_BLOCK)
+#define REDUCE_GROUP 256
 
 #define BASE_LONG_DOUBLE
 #include "templates_on.h"
@@ -0,0 +1,213 @@
+/* tensor/minmax_kernels_source.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Kernel for the reductions of minmax_source.c, included once for
+ * each instruction set like oper_kernels_source.c.
+ *
+ * It keeps the smallest and largest values seen in each lane of a
+ * vector and combines the lanes at the end. Floating point data also
+ * gets the sum of x - x, which only stops being 0 at a NaN or an
+ * infinity: then the elements are checked one by one for NaNs.
+ * 64-bit integers have no vector comparison before AVX2, and long
+ * double none at all: those use the plain loop.
+ */
+
+#if defined(BASE_DOUBLE) || defined(BASE_FLOAT) || defined(BASE_LONG_DOUBLE)
+#define MINMAX_HAS_NAN
+#endif
+
+/* Vector type and operations for the elements of this type */
+#if SIMD_BYTES > 0 && defined(BASE_DOUBLE)
+#define VEC SIMD_PD
+#define VEC_LOAD(p) SIMD_LOAD_PD(p)
+#define VEC_STORE(p, v) SIMD_STORE_PD(p, v)
+#define VEC_MIN(a, b) SIMD_MIN_PD(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_PD(a, b)
+#define VEC_ADD(a, b) SIMD_ADD_PD(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_PD(a, b)
+#define VEC_ANY_NAN(v) SIMD_ANY_NAN_PD(v)
+#elif SIMD_BYTES > 0 && defined(BASE_FLOAT)
+#define VEC SIMD_PS
+#define VEC_LOAD(p) SIMD_LOAD_PS(p)
+#define VEC_STORE(p, v) SIMD_STORE_PS(p, v)
+#define VEC_MIN(a, b) SIMD_MIN_PS(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_PS(a, b)
+#define VEC_ADD(a, b) SIMD_ADD_PS(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_PS(a, b)
+#define VEC_ANY_NAN(v) SIMD_ANY_NAN_PS(v)
+#elif SIMD_BYTES > 0 && !defined(BASE_LONG_DOUBLE)
+#define VEC SIMD_SI
+#define VEC_LOAD(p) SIMD_LOAD_SI(p)
+#define VEC_STORE(p, v) SIMD_STORE_SI(p, v)
+#if (defined(BASE_CHAR) && CHAR_MIN < 0)
+#define VEC_MIN(a, b) SIMD_MIN_EPI8(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPI8(a, b)
+#elif defined(BASE_CHAR) || defined(BASE_UCHAR)
+#define VEC_MIN(a, b) SIMD_MIN_EPU8(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPU8(a, b)
+#elif defined(BASE_SHORT)
+#define VEC_MIN(a, b) SIMD_MIN_EPI16(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPI16(a, b)
+#elif defined(BASE_USHORT)
+#define VEC_MIN(a, b) SIMD_MIN_EPU16(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPU16(a, b)
+#elif defined(BASE_INT) || (defined(BASE_LONG) && ULONG_MAX == 0xffffffffUL)
+#define VEC_MIN(a, b) SIMD_MIN_EPI32(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPI32(a, b)
+#elif defined(BASE_UINT) || ULONG_MAX == 0xffffffffUL
+#define VEC_MIN(a, b) SIMD_MIN_EPU32(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPU32(a, b)
+#elif defined(BASE_LONG) && SIMD_BYTES > 16
+#define VEC_MIN(a, b) SIMD_MIN_EPI64(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPI64(a, b)
+#elif defined(BASE_ULONG) && SIMD_BYTES > 16
+#define VEC_MIN(a, b) SIMD_MIN_EPU64(a, b)
+#define VEC_MAX(a, b) SIMD_MAX_EPU64(a, b)
+#endif
+#endif
+
+#ifdef VEC
+#define VEC_LANES (SIMD_BYTES / sizeof(ATOMIC))
+#endif
+
+
+/*
+ * Smallest and largest of the n (> 0) elements of x in *min and *max,
+ * or NaN in both if there is one. If sum is not NULL the elements are
+ * also added to *sum.
+ */
+static void
+FUNCTION(SIMD_DIR, block_minmax) (const ATOMIC * x, size_t n,
+                                  ATOMIC * min, ATOMIC * max, double * sum)
+{
+  size_t i = 0;
+  ATOMIC lo = x[0], hi = x[0];
+
+#if defined(VEC_MIN)
+  if (n >= VEC_LANES)
+    {
+      ATOMIC lanes[VEC_LANES];
+      VEC v = VEC_LOAD(x);
+      VEC vmin = v, vmax = v;
+      size_t k;
+#ifdef VEC_ANY_NAN
+      VEC bad = VEC_SUB(v, v);
+#endif
+
+      for (i = VEC_LANES; i + VEC_LANES <= n; i += VEC_LANES)
+        {
+          v = VEC_LOAD(x + i);
+          vmin = VEC_MIN(v, vmin);
+          vmax = VEC_MAX(v, vmax);
+#ifdef VEC_ANY_NAN
+          bad = VEC_ADD(bad, VEC_SUB(v, v));
+#endif
+        }
+
+#ifdef VEC_ANY_NAN
+      if (VEC_ANY_NAN(bad))
+        for (k = 0; k < i; k++)
+          if (x[k] != x[k])
+            {
+              *min = *max = x[k];
+              return;
+            }
+#endif
+
+      VEC_STORE(lanes, vmin);
+      lo = lanes[0];
+      for (k = 1; k < VEC_LANES; k++)
+        if (lanes[k] < lo)
+          lo = lanes[k];
+
+      VEC_STORE(lanes, vmax);
+      hi = lanes[0];
+      for (k = 1; k < VEC_LANES; k++)
+        if (lanes[k] > hi)
+          hi = lanes[k];
+    }
+#endif
+
+  for (; i < n; i++)
+    {
+      const ATOMIC y = x[i];
+#ifdef MINMAX_HAS_NAN
+      if (y != y)
+        {
+          *min = *max = y;
+          return;
+        }
+#endif
+      lo = (y < lo) ? y : lo;
+      hi = (y > hi) ? y : hi;
+    }
+
+  *min = lo;
+  *max = hi;
+
+  if (sum == NULL)
+    return;
+
+  /* The block is still in the cache: add it up in a second pass */
+  i = 0;
+#if SIMD_BYTES > 0 && (defined(BASE_DOUBLE) || defined(BASE_FLOAT))
+  {
+    const size_t lanes = SIMD_BYTES / sizeof(double);
+    double partial[SIMD_BYTES / sizeof(double)];
+    SIMD_PD s = SIMD_SET1_PD(0.0);
+    size_t k;
+
+#if defined(BASE_DOUBLE)
+    for (; i + lanes <= n; i += lanes)
+      s = SIMD_ADD_PD(s, SIMD_LOAD_PD(x + i));
+#else
+    for (; i + 2 * lanes <= n; i += 2 * lanes)
+      {
+        const SIMD_PS v = SIMD_LOAD_PS(x + i);
+
+        s = SIMD_ADD_PD(s, SIMD_ADD_PD(SIMD_CVT_LO_PS_PD(v),
+                                       SIMD_CVT_HI_PS_PD(v)));
+      }
+#endif
+
+    SIMD_STORE_PD(partial, s);
+    for (k = 0; k < lanes; k++)
+      *sum += partial[k];
+  }
+#endif
+
+  for (; i < n; i++)
+    *sum += x[i];
+}
+
+
+#ifdef VEC
+#undef VEC
+#undef VEC_LOAD
+#undef VEC_STORE
+#undef VEC_LANES
+#endif
+#undef VEC_MIN
+#undef VEC_MAX
+#undef VEC_ADD
+#undef VEC_SUB
+#undef VEC_ANY_NAN
+#undef MINMAX_HAS_NAN
@@ -19,46 +19,306 @@
  */
 
 /*
- * Finds the largest element of a tensor.
+ * Reduction kernels (minmax_kernels_source.c) for every instruction
+ * set, and the function that calls the one in use.
  */
-BASE
-FUNCTION (tensor, max) (const TYPE (tensor) * t)
+
+#define SIMD_KERNELS "minmax_kernels_source.c"
+#include "simd_each.h"
+#undef SIMD_KERNELS
+
+static void
+FUNCTION(simd, block_minmax) (const ATOMIC * x, size_t n,
+                              ATOMIC * min, ATOMIC * max, double * sum)
+{
+  SIMD_CALL(block_minmax, (x, n, min, max, sum));
+}
+
+
+/*
+ * Smallest and largest elements of a part of a tensor, the logical
+ * positions of their first occurrences, and the sum of the elements.
+ */
+typedef struct
+{
+  ATOMIC min, max;
+  size_t pmin, pmax;
+  double sum;
+  int nan;  /* min and max are the first NaN, at pmin and pmax */
+} TYPE(minmax_partial);
+
+
+/*
+ * Reduction of the items (rows or, for a single row, elements) of a
+ * tensor, in chunks of "chunk" items, each giving a partial. The group
+ * of chunks that starts at chunk "first" goes in "partial".
+ */
+typedef struct
 {
-  size_t i, n;
+  const TYPE(tensor) * t;
+  size_t rows, n;
+  size_t items, chunk, first;
+  int want_positions;
+  int want_sum;
+  TYPE(minmax_partial) * partial;
+} TYPE(minmax_job);
 
-  BASE max = t->data[0];
 
-  n = t->size;
+/*
+ * Reduces the items from begin to end - 1 into p.
+ *
+ * The data goes through the kernel in blocks of MINMAX_BLOCK elements
+ * (that never cross the end of a row of a padded tensor), remembering
+ * the first block where each extreme appears; only that block is
+ * searched again for the position. A NaN stops the scan.
+ */
+static void
+FUNCTION(tensor, scan_items) (const TYPE(minmax_job) * job,
+                              size_t begin, size_t end,
+                              TYPE(minmax_partial) * p)
+{
+  const TYPE(tensor) * t = job->t;
+  const int single = (job->rows == 1);
+  const ATOMIC * xmin, * xmax;
+  size_t r, b, bmin, bmax;
+  ATOMIC lo, hi;
+  double s = 0;
+
+  xmin = xmax = single ? t->data + begin : t->data + begin * t->tda;
+  bmin = bmax = single ? begin : begin * job->n;
+  p->min = p->max = xmin[0];
+  p->nan = 0;
+
+  for (r = begin; r < end; r++)
+    {
+      /* A row, or all the elements of the range */
+      const ATOMIC * const x = single ? t->data + begin : t->data + r * t->tda;
+      const size_t n = single ? end - begin : job->n;
+      const size_t pos = single ? begin : r * job->n;
+
+      for (b = 0; b < n; b += MINMAX_BLOCK)
+        {
+          const size_t len = (n - b < MINMAX_BLOCK) ? n - b : MINMAX_BLOCK;
+
+          FUNCTION(simd, block_minmax) (x + b, len, &lo, &hi,
+                                        job->want_sum ? &s : NULL);
+
+#if defined(BASE_DOUBLE) || defined(BASE_FLOAT) || defined(BASE_LONG_DOUBLE)
+          if (lo != lo)  /* a NaN */
+            {
+              size_t i = b;
+
+              while (x[i] == x[i])
+                i++;
+
+              p->min = p->max = lo;
+              p->pmin = p->pmax = pos + i;
+              p->sum = lo;
+              p->nan = 1;
+
+              return;
+            }
+#endif
+
+          if (lo < p->min)
+            {
+              p->min = lo;
+              xmin = x + b;
+              bmin = pos + b;
+            }
+          if (hi > p->max)
+            {
+              p->max = hi;
+              xmax = x + b;
+              bmax = pos + b;
+            }
+        }
 
-  for (i = 0; i < n; i++)
+      if (single)
+        break;
+    }
+
+  if (job->want_positions)
     {
-      BASE x = t->data[i];
-      if (x > max)
-	max = x;
+      for (b = 0; xmin[b] != p->min; b++)
+        ;
+      p->pmin = bmin + b;
+
+      for (b = 0; xmax[b] != p->max; b++)
+        ;
+      p->pmax = bmax + b;
     }
 
-  return max;
+  p->sum = s;
 }
 
 
 /*
- * Finds the smallest element of a tensor.
+ * a = the reduction of a and then b, the part that follows it.
  */
-BASE
-FUNCTION (tensor, min) (const TYPE (tensor) * t)
+static void
+FUNCTION(tensor, scan_combine) (TYPE(minmax_partial) * a,
+                                const TYPE(minmax_partial) * b)
 {
-  size_t i, n;
+  if (a->nan)
+    return;
 
-  BASE min = t->data[0];
+  if (b->nan)
+    {
+      *a = *b;
+      return;
+    }
+
+  if (b->min < a->min)
+    {
+      a->min = b->min;
+      a->pmin = b->pmin;
+    }
+  if (b->max > a->max)
+    {
+      a->max = b->max;
+      a->pmax = b->pmax;
+    }
+
+  a->sum += b->sum;
+}
 
-  n = t->size;
 
-  for (i = 0; i < n; i++)
+static void
+FUNCTION(tensor, scan_part) (void * arg, size_t begin, size_t end)
+{
+  const TYPE(minmax_job) * job = (const TYPE(minmax_job) *) arg;
+  size_t c;
+
+  for (c = begin; c < end; c++)
     {
-      BASE x = t->data[i];
-      if (x < min)
-	min = x;
+      const size_t first = (job->first + c) * job->chunk;
+      const size_t last = GSL_MIN(first + job->chunk, job->items);
+
+      FUNCTION(tensor, scan_items) (job, first, last, &job->partial[c]);
     }
+}
+
+
+/*
+ * Smallest and largest elements of a tensor and, if pmin and pmax are
+ * not NULL, the positions of their first occurrences. If sum is not
+ * NULL it gets the sum of all the elements. If there is a NaN the
+ * result is NaN, at the position of the first one.
+ *
+ * The chunks of REDUCE_CHUNK elements are reduced in parallel, and
+ * their results are put together in a tree with the same shape for
+ * any number of threads, so the sum is always the same to the last
+ * bit (unless tensor_set_deterministic(0) asked for one chunk per
+ * thread).
+ */
+static void
+FUNCTION(tensor, scan) (const TYPE(tensor) * t, ATOMIC * min, ATOMIC * max,
+                        size_t * pmin, size_t * pmax, double * sum)
+{
+  TYPE(minmax_partial) partial[REDUCE_GROUP + 1];
+  TYPE(minmax_job) job;
+  size_t chunks, elements, c, k, step;
+
+  job.t = t;
+  job.rows = TENSOR_ROWS(t);
+  job.n = TENSOR_ROW_LENGTH(t);
+  job.items = PARALLEL_ITEMS(job.rows, job.n);
+  job.want_positions = (pmin != NULL);
+  job.want_sum = (sum != NULL);
+
+  if (tensor_get_deterministic ())
+    job.chunk = PARALLEL_GRAIN(job.rows, job.n, REDUCE_CHUNK);
+  else
+    job.chunk = (job.items + tensor_get_num_threads () - 1)
+      / tensor_get_num_threads ();
+
+  chunks = (job.items + job.chunk - 1) / job.chunk;
+  elements = job.chunk * ((job.rows > 1) ? job.n : 1);
+
+  /*
+   * The first group of chunks is reduced into partial[0], and each of
+   * the others into partial[1], which is then added to it.
+   */
+  for (c = 0; c < chunks; c += REDUCE_GROUP)
+    {
+      const size_t group = GSL_MIN(chunks - c, REDUCE_GROUP);
+
+      job.first = c;
+      job.partial = (c == 0) ? partial : partial + 1;
+      tensor_parallel_for (group,
+                           (PARALLEL_MIN_TEST + elements - 1) / elements,
+                           FUNCTION(tensor, scan_part), &job);
+
+      for (step = 1; step < group; step *= 2)
+        for (k = 0; k + step < group; k += 2 * step)
+          FUNCTION(tensor, scan_combine) (&job.partial[k],
+                                          &job.partial[k + step]);
+
+      if (c > 0)
+        FUNCTION(tensor, scan_combine) (&partial[0], &partial[1]);
+    }
+
+  *min = partial[0].min;
+  *max = partial[0].max;
+
+  if (pmin != NULL)
+    {
+      *pmin = partial[0].pmin;
+      *pmax = partial[0].pmax;
+    }
+
+  if (sum != NULL)
+    *sum = partial[0].sum;
+}
+
+
+/*
+ * Indices of the element at position pos of t. (position2index() gives
+ * them in the opposite order, the last index first.)
+ */
+static void
+FUNCTION(tensor, position_indices) (const TYPE(tensor) * t, size_t pos,
+                                    size_t * indices)
+{
+  divisor div;
+  unsigned int k;
+
+  divisor_init(&div, t->dimension);
+
+  for (k = t->rank; k-- > 0; )
+    {
+      const size_t q = divisor_quotient(pos, &div);
+
+      indices[k] = pos - q * t->dimension;
+      pos = q;
+    }
+}
+
+
+/*
+ * Finds the largest element of a tensor.
+ */
+BASE
+FUNCTION (tensor, max) (const TYPE (tensor) * t)
+{
+  ATOMIC min, max;
+
+  FUNCTION(tensor, scan) (t, &min, &max, NULL, NULL, NULL);
+
+  return max;
+}
+
+
+/*
+ * Finds the smallest element of a tensor.
+ */
+BASE
+FUNCTION (tensor, min) (const TYPE (tensor) * t)
+{
+  ATOMIC min, max;
+
+  FUNCTION(tensor, scan) (t, &min, &max, NULL, NULL, NULL);
 
   return min;
 }
@@ -72,26 +332,7 @@ FUNCTION (tensor, minmax) (const TYPE (tensor) * t,
                                BASE * min_out,
                                BASE * max_out)
 {
-  size_t i, n;
-
-  BASE min = t->data[0];
-  BASE max = t->data[0];
-
-  n = t->size;
-
-  for (i = 0; i < n; i++)
-    {
-      BASE x = t->data[i];
-      if (x < min)
-	{
-	min = x;
-	}
-      if (x > max)
-	max = x;
-    }
-
-  *min_out = min;
-  *max_out = max;
+  FUNCTION(tensor, scan) (t, min_out, max_out, NULL, NULL, NULL);
 }
 
 
@@ -105,24 +346,12 @@ void
 FUNCTION (tensor, max_index) (const TYPE (tensor) * t,
                                   size_t * indices)
 {
-  size_t i, n;
-
-  BASE max = t->data[0];
-  size_t max_index = 0;
+  ATOMIC min, max;
+  size_t pmin, pmax;
 
-  n = t->size;
-
-  for (i = 0; i < n; i++)
-    {
-      BASE x = t->data[i];
-      if (x > max)
-        {
-          max = x;
-          max_index = i;
-        }
-    }
+  FUNCTION(tensor, scan) (t, &min, &max, &pmin, &pmax, NULL);
 
-  position2index(t->rank, t->dimension, max_index, indices);
+  FUNCTION(tensor, position_indices) (t, pmax, indices);
 }
 
 
@@ -136,24 +365,12 @@ void
 FUNCTION (tensor, min_index) (const TYPE (tensor) * t,
                                   size_t * indices)
 {
-  size_t i, n;
-
-  BASE min = t->data[0];
-  size_t min_index = 0;
+  ATOMIC min, max;
+  size_t pmin, pmax;
 
-  n = t->size;
+  FUNCTION(tensor, scan) (t, &min, &max, &pmin, &pmax, NULL);
 
-  for (i = 0; i < n; i++)
-    {
-      BASE x = t->data[i];
-      if (x < min)
-        {
-          min = x;
-          min_index = i;
-        }
-    }
-
-  position2index(t->rank, t->dimension, min_index, indices);
+  FUNCTION(tensor, position_indices) (t, pmin, indices);
 }
 
 
@@ -167,30 +384,45 @@ void
 FUNCTION (tensor, minmax_index) (const TYPE (tensor) * t,
                                      size_t * imin, size_t * imax)
 {
-  size_t i, n;
+  FUNCTION(tensor, stats) (t, NULL, NULL, imin, imax, NULL);
+}
 
-  BASE min = t->data[0];
-  BASE max = t->data[0];
-  size_t min_index = 0;
-  size_t max_index = 0;
 
-  n = t->size;
+/*
+ * Finds, in a single pass over the data, the smallest and largest
+ * elements of a tensor, their indices and the sum of all elements.
+ * Any of the outputs can be NULL if it is not wanted.
+ *
+ * The arrays "imin" and "imax" must have enough space to store all the
+ * indices *before* calling this function.
+ */
+void
+FUNCTION (tensor, stats) (const TYPE (tensor) * t,
+                              BASE * min_out, BASE * max_out,
+                              size_t * imin, size_t * imax,
+                              double * sum)
+{
+  ATOMIC min, max;
+  size_t pmin, pmax;
+  const int want_index = (imin != NULL || imax != NULL);
+
+  FUNCTION(tensor, scan) (t, &min, &max,
+                          want_index ? &pmin : NULL,
+                          want_index ? &pmax : NULL, sum);
 
-  for (i = 0; i < n; i++)
+  if (min_out != NULL)
+    *min_out = min;
+  if (max_out != NULL)
+    *max_out = max;
+
+  if (imin != NULL)
+    FUNCTION(tensor, position_indices) (t, pmin, imin);
+
+  if (imax != NULL)
     {
-      BASE x = t->data[i];
-      if (x < min)
-        {
-          min = x;
-          min_index = i;
-        }
-      if (x > max)
-        {
-          max = x;
-          max_index = i;
-        }
+      if (imin != NULL && pmax == pmin)
+        memcpy(imax, imin, t->rank * sizeof(size_t));
+      else
+        FUNCTION(tensor, position_indices) (t, pmax, imax);
     }
-
-  position2index(t->rank, t->dimension, min_index, imin);
-  position2index(t->rank, t->dimension, max_index, imax);
 }
@@ -19,8 +19,26 @@
 #include <config.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
 #include <gsl/gsl_math.h>
+#include <gsl/gsl_cblas.h>
 #include "tensor.h"
+#include "tensor_internal.h"
+#include "divisor.h"
+
+/* True if the arrays p and q, of n elements each, do not overlap */
+#define DISJOINT(p, q, n) ((p) + (n) <= (q) || (q) + (n) <= (p))
+
+/* Rows shorter than this are added inline rather than by a kernel */
+#define KERNEL_MIN_LENGTH 16
+
+/* Element-wise operations (see tensor_oper_run()) */
+#define OPER_ADD          0
+#define OPER_SUB          1
+#define OPER_MUL          2
+#define OPER_DIV          3
+#define OPER_SCALE        4
+#define OPER_ADD_CONSTANT 5
 
 #define BASE_COMPLEX_DOUBLE
 #include "templates_on.h"
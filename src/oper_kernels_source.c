@@ -0,0 +1,398 @@
+/* tensor/oper_kernels_source.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Kernels for the elementwise operations of oper_source.c, written
+ * with the vector operations of simd_on.h. This file is included once
+ * for each instruction set (see simd_each.h) and the names of the
+ * kernels carry SIMD_DIR to tell the copies apart.
+ *
+ * The arrays they get must not overlap (the callers check it), which
+ * is what keeps the compiler from vectorizing the plain loops. Each
+ * kernel runs over whole vectors and finishes the last elements with
+ * the plain loop. The results are those of the loop:
+ *   - integers wrap around in the same way,
+ *   - scale and add_constant go through double as "a[i] *= x" does,
+ *   - complex products and quotients that do not come out finite (or
+ *     whose divisor is too large or too small to square) are redone
+ *     with the C operators, which handle infinities and overflow.
+ *     Other quotients use the textbook formula, which can differ from
+ *     the C operator in the last bit, as can products when the
+ *     compiler fuses their multiplications and additions.
+ * Where there is no vector instruction for an operation (division of
+ * integers, long double, ...) the kernel is just the plain loop.
+ */
+
+/* Vector type and operations for the elements of this type */
+#if SIMD_BYTES > 0 && (defined(BASE_DOUBLE) || defined(BASE_COMPLEX_DOUBLE))
+#define VEC_ELEMENT double
+#define VEC SIMD_PD
+#define VEC_LOAD(p) SIMD_LOAD_PD(p)
+#define VEC_STORE(p, v) SIMD_STORE_PD(p, v)
+#define VEC_ADD(a, b) SIMD_ADD_PD(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_PD(a, b)
+#if defined(BASE_DOUBLE)
+#define VEC_MUL(a, b) SIMD_MUL_PD(a, b)
+#define VEC_DIV(a, b) SIMD_DIV_PD(a, b)
+#endif
+#elif SIMD_BYTES > 0 && defined(BASE_FLOAT)
+#define VEC_ELEMENT float
+#define VEC SIMD_PS
+#define VEC_LOAD(p) SIMD_LOAD_PS(p)
+#define VEC_STORE(p, v) SIMD_STORE_PS(p, v)
+#define VEC_ADD(a, b) SIMD_ADD_PS(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_PS(a, b)
+#define VEC_MUL(a, b) SIMD_MUL_PS(a, b)
+#define VEC_DIV(a, b) SIMD_DIV_PS(a, b)
+#elif SIMD_BYTES > 0 && !defined(BASE_LONG_DOUBLE)
+#define VEC_ELEMENT ATOMIC
+#define VEC SIMD_SI
+#define VEC_LOAD(p) SIMD_LOAD_SI(p)
+#define VEC_STORE(p, v) SIMD_STORE_SI(p, v)
+#if defined(BASE_CHAR) || defined(BASE_UCHAR)
+#define VEC_ADD(a, b) SIMD_ADD_EPI8(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_EPI8(a, b)
+/* Low bytes of the 16-bit products of even and of odd bytes */
+#define VEC_MUL(a, b) \
+  SIMD_OR_SI(SIMD_AND_SI(SIMD_MULLO_EPI16(a, b), SIMD_SET1_EPI16(0xff)), \
+             SIMD_SLLI_EPI16(SIMD_MULLO_EPI16(SIMD_SRLI_EPI16(a, 8), \
+                                              SIMD_SRLI_EPI16(b, 8)), 8))
+#elif defined(BASE_SHORT) || defined(BASE_USHORT)
+#define VEC_ADD(a, b) SIMD_ADD_EPI16(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_EPI16(a, b)
+#define VEC_MUL(a, b) SIMD_MULLO_EPI16(a, b)
+#elif defined(BASE_INT) || defined(BASE_UINT) || ULONG_MAX == 0xffffffffUL
+#define VEC_ADD(a, b) SIMD_ADD_EPI32(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_EPI32(a, b)
+#define VEC_MUL(a, b) SIMD_MULLO_EPI32(a, b)
+#else
+#define VEC_ADD(a, b) SIMD_ADD_EPI64(a, b)
+#define VEC_SUB(a, b) SIMD_SUB_EPI64(a, b)
+#endif
+#endif
+
+#ifdef VEC
+#define VEC_LANES (SIMD_BYTES / sizeof(VEC_ELEMENT))
+/* Number of VEC_ELEMENTs in n elements of the tensor */
+#define VEC_COUNT(n) ((n) * (sizeof(ATOMIC) / sizeof(VEC_ELEMENT)))
+#endif
+
+
+static void
+FUNCTION(SIMD_DIR, add) (ATOMIC * restrict a,
+                         const ATOMIC * restrict b, size_t n)
+{
+  size_t i = 0;
+
+#if defined(VEC_ADD)
+  {
+    VEC_ELEMENT * const x = (VEC_ELEMENT *) a;
+    const VEC_ELEMENT * const y = (const VEC_ELEMENT *) b;
+    const size_t m = VEC_COUNT(n);
+
+    for (; i + VEC_LANES <= m; i += VEC_LANES)
+      VEC_STORE(x + i, VEC_ADD(VEC_LOAD(x + i), VEC_LOAD(y + i)));
+
+    i /= VEC_COUNT(1);
+  }
+#endif
+
+  for (; i < n; i++)
+    a[i] += b[i];
+}
+
+
+static void
+FUNCTION(SIMD_DIR, sub) (ATOMIC * restrict a,
+                         const ATOMIC * restrict b, size_t n)
+{
+  size_t i = 0;
+
+#if defined(VEC_SUB)
+  {
+    VEC_ELEMENT * const x = (VEC_ELEMENT *) a;
+    const VEC_ELEMENT * const y = (const VEC_ELEMENT *) b;
+    const size_t m = VEC_COUNT(n);
+
+    for (; i + VEC_LANES <= m; i += VEC_LANES)
+      VEC_STORE(x + i, VEC_SUB(VEC_LOAD(x + i), VEC_LOAD(y + i)));
+
+    i /= VEC_COUNT(1);
+  }
+#endif
+
+  for (; i < n; i++)
+    a[i] -= b[i];
+}
+
+
+#if defined(BASE_COMPLEX_DOUBLE) && SIMD_BYTES > 0
+/* -0.0 in the real parts: xor flips their sign */
+static const double FUNCTION(SIMD_DIR, sign_re)[8] =
+  {-0.0, 0.0, -0.0, 0.0, -0.0, 0.0, -0.0, 0.0};
+static const double FUNCTION(SIMD_DIR, sign_im)[8] =
+  {0.0, -0.0, 0.0, -0.0, 0.0, -0.0, 0.0, -0.0};
+#endif
+
+
+static void
+FUNCTION(SIMD_DIR, mul) (ATOMIC * restrict a,
+                         const ATOMIC * restrict b, size_t n)
+{
+  size_t i = 0;
+
+#if defined(VEC_MUL)
+  {
+    VEC_ELEMENT * const x = (VEC_ELEMENT *) a;
+    const VEC_ELEMENT * const y = (const VEC_ELEMENT *) b;
+    const size_t m = VEC_COUNT(n);
+
+    for (; i + VEC_LANES <= m; i += VEC_LANES)
+      {
+        const VEC u = VEC_LOAD(x + i);
+        const VEC v = VEC_LOAD(y + i);
+
+        VEC_STORE(x + i, VEC_MUL(u, v));
+      }
+
+    i /= VEC_COUNT(1);
+  }
+#elif defined(BASE_COMPLEX_DOUBLE) && SIMD_BYTES > 0
+  {
+    /* (p + qi)(r + si) = (pr - qs) + (ps + qr)i on pairs of doubles */
+    double * const x = (double *) a;
+    const double * const y = (const double *) b;
+    const size_t m = 2 * n;
+    const SIMD_PD sign = SIMD_LOAD_PD(FUNCTION(SIMD_DIR, sign_re));
+    const SIMD_PD lo = SIMD_SET1_PD(-GSL_DBL_MAX);
+    const SIMD_PD hi = SIMD_SET1_PD(GSL_DBL_MAX);
+    const size_t lanes = SIMD_BYTES / sizeof(double);
+
+    for (; i + lanes <= m; i += lanes)
+      {
+        const SIMD_PD u = SIMD_LOAD_PD(x + i);
+        const SIMD_PD v = SIMD_LOAD_PD(y + i);
+        const SIMD_PD pr_ps = SIMD_MUL_PD(SIMD_DUP_EVEN_PD(u), v);
+        const SIMD_PD qs_qr = SIMD_MUL_PD(SIMD_DUP_ODD_PD(u),
+                                          SIMD_SWAP_PAIRS_PD(v));
+        const SIMD_PD w = SIMD_ADD_PD(pr_ps, SIMD_XOR_PD(qs_qr, sign));
+
+        if (SIMD_ANY_OUTSIDE_PD(w, lo, hi))
+          {
+            size_t k;
+
+            for (k = i / 2; k < (i + lanes) / 2; k++)
+              a[k] *= b[k];
+          }
+        else
+          SIMD_STORE_PD(x + i, w);
+      }
+
+    i /= 2;
+  }
+#endif
+
+  for (; i < n; i++)
+    a[i] *= b[i];
+}
+
+
+static void
+FUNCTION(SIMD_DIR, div) (ATOMIC * restrict a,
+                         const ATOMIC * restrict b, size_t n)
+{
+  size_t i = 0;
+
+#if defined(VEC_DIV)
+  {
+    VEC_ELEMENT * const x = (VEC_ELEMENT *) a;
+    const VEC_ELEMENT * const y = (const VEC_ELEMENT *) b;
+    const size_t m = VEC_COUNT(n);
+
+    for (; i + VEC_LANES <= m; i += VEC_LANES)
+      VEC_STORE(x + i, VEC_DIV(VEC_LOAD(x + i), VEC_LOAD(y + i)));
+
+    i /= VEC_COUNT(1);
+  }
+#elif defined(BASE_COMPLEX_DOUBLE) && SIMD_BYTES > 0
+  {
+    /* (p + qi)/(r + si) = ((pr + qs) + (qr - ps)i) / (r^2 + s^2) */
+    double * const x = (double *) a;
+    const double * const y = (const double *) b;
+    const size_t m = 2 * n;
+    const SIMD_PD sign = SIMD_LOAD_PD(FUNCTION(SIMD_DIR, sign_im));
+    const SIMD_PD lo = SIMD_SET1_PD(-GSL_DBL_MAX);
+    const SIMD_PD hi = SIMD_SET1_PD(GSL_DBL_MAX);
+    const SIMD_PD tiny = SIMD_SET1_PD(GSL_DBL_MIN);
+    const size_t lanes = SIMD_BYTES / sizeof(double);
+
+    for (; i + lanes <= m; i += lanes)
+      {
+        const SIMD_PD u = SIMD_LOAD_PD(x + i);
+        const SIMD_PD v = SIMD_LOAD_PD(y + i);
+        const SIMD_PD pr_ps = SIMD_MUL_PD(SIMD_DUP_EVEN_PD(u), v);
+        const SIMD_PD qs_qr = SIMD_MUL_PD(SIMD_DUP_ODD_PD(u),
+                                          SIMD_SWAP_PAIRS_PD(v));
+        const SIMD_PD v2 = SIMD_MUL_PD(v, v);
+        const SIMD_PD norm = SIMD_ADD_PD(v2, SIMD_SWAP_PAIRS_PD(v2));
+        const SIMD_PD w = SIMD_DIV_PD(SIMD_ADD_PD(qs_qr,
+                                                  SIMD_XOR_PD(pr_ps, sign)),
+                                      norm);
+
+        if (SIMD_ANY_OUTSIDE_PD(norm, tiny, hi) ||
+            SIMD_ANY_OUTSIDE_PD(w, lo, hi))
+          {
+            size_t k;
+
+            for (k = i / 2; k < (i + lanes) / 2; k++)
+              a[k] /= b[k];
+          }
+        else
+          SIMD_STORE_PD(x + i, w);
+      }
+
+    i /= 2;
+  }
+#endif
+
+  for (; i < n; i++)
+    a[i] /= b[i];
+}
+
+
+static void
+FUNCTION(SIMD_DIR, scale) (ATOMIC * restrict a, const double c,
+                           size_t n)
+{
+  size_t i = 0;
+
+#if SIMD_BYTES > 0 && (defined(BASE_DOUBLE) || defined(BASE_COMPLEX_DOUBLE))
+  {
+    double * const x = (double *) a;
+    const size_t m = VEC_COUNT(n);
+    const SIMD_PD factor = SIMD_SET1_PD(c);
+
+    for (; i + VEC_LANES <= m; i += VEC_LANES)
+      SIMD_STORE_PD(x + i, SIMD_MUL_PD(SIMD_LOAD_PD(x + i), factor));
+
+    i /= VEC_COUNT(1);
+  }
+#elif SIMD_BYTES > 0 && defined(BASE_FLOAT)
+  {
+    const SIMD_PD factor = SIMD_SET1_PD(c);
+
+    for (; i + VEC_LANES <= n; i += VEC_LANES)
+      {
+        const SIMD_PS u = SIMD_LOAD_PS(a + i);
+
+        SIMD_STORE_PS(a + i,
+                      SIMD_CVT_PD_PS(SIMD_MUL_PD(SIMD_CVT_LO_PS_PD(u), factor),
+                                     SIMD_MUL_PD(SIMD_CVT_HI_PS_PD(u), factor)));
+      }
+  }
+#elif SIMD_BYTES > 0 && defined(BASE_INT)
+  {
+    const SIMD_PD factor = SIMD_SET1_PD(c);
+
+    for (; i + VEC_LANES <= n; i += VEC_LANES)
+      {
+        const SIMD_SI u = SIMD_LOAD_SI(a + i);
+
+        SIMD_STORE_SI(a + i,
+                      SIMD_CVTT_PD_EPI32(
+                        SIMD_MUL_PD(SIMD_CVT_LO_EPI32_PD(u), factor),
+                        SIMD_MUL_PD(SIMD_CVT_HI_EPI32_PD(u), factor)));
+      }
+  }
+#endif
+
+  for (; i < n; i++)
+    a[i] *= c;
+}
+
+
+static void
+FUNCTION(SIMD_DIR, add_constant) (ATOMIC * restrict a, const double c,
+                                  size_t n)
+{
+  size_t i = 0;
+
+#if SIMD_BYTES > 0 && (defined(BASE_DOUBLE) || defined(BASE_COMPLEX_DOUBLE))
+  {
+    double * const x = (double *) a;
+    const size_t m = VEC_COUNT(n);
+#if defined(BASE_COMPLEX_DOUBLE)
+    const double pairs[8] = {c, 0, c, 0, c, 0, c, 0};  /* real parts only */
+    const SIMD_PD term = SIMD_LOAD_PD(pairs);
+#else
+    const SIMD_PD term = SIMD_SET1_PD(c);
+#endif
+
+    for (; i + VEC_LANES <= m; i += VEC_LANES)
+      SIMD_STORE_PD(x + i, SIMD_ADD_PD(SIMD_LOAD_PD(x + i), term));
+
+    i /= VEC_COUNT(1);
+  }
+#elif SIMD_BYTES > 0 && defined(BASE_FLOAT)
+  {
+    const SIMD_PD term = SIMD_SET1_PD(c);
+
+    for (; i + VEC_LANES <= n; i += VEC_LANES)
+      {
+        const SIMD_PS u = SIMD_LOAD_PS(a + i);
+
+        SIMD_STORE_PS(a + i,
+                      SIMD_CVT_PD_PS(SIMD_ADD_PD(SIMD_CVT_LO_PS_PD(u), term),
+                                     SIMD_ADD_PD(SIMD_CVT_HI_PS_PD(u), term)));
+      }
+  }
+#elif SIMD_BYTES > 0 && defined(BASE_INT)
+  {
+    const SIMD_PD term = SIMD_SET1_PD(c);
+
+    for (; i + VEC_LANES <= n; i += VEC_LANES)
+      {
+        const SIMD_SI u = SIMD_LOAD_SI(a + i);
+
+        SIMD_STORE_SI(a + i,
+                      SIMD_CVTT_PD_EPI32(
+                        SIMD_ADD_PD(SIMD_CVT_LO_EPI32_PD(u), term),
+                        SIMD_ADD_PD(SIMD_CVT_HI_EPI32_PD(u), term)));
+      }
+  }
+#endif
+
+  for (; i < n; i++)
+    a[i] += c;
+}
+
+
+#ifdef VEC
+#undef VEC_ELEMENT
+#undef VEC
+#undef VEC_LOAD
+#undef VEC_STORE
+#undef VEC_LANES
+#undef VEC_COUNT
+#endif
+#undef VEC_ADD
+#undef VEC_SUB
+#undef VEC_MUL
+#undef VEC_DIV
@@ -0,0 +1,73 @@
+/* tensor/oper_simd_source.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Elementwise kernels (oper_kernels_source.c) for every instruction
+ * set, and the functions that call the one in use.
+ */
+
+#define SIMD_KERNELS "oper_kernels_source.c"
+#include "simd_each.h"
+#undef SIMD_KERNELS
+
+static void
+FUNCTION(simd, add) (ATOMIC * restrict a, const ATOMIC * restrict b,
+                     size_t n)
+{
+  SIMD_CALL(add, (a, b, n));
+}
+
+
+static void
+FUNCTION(simd, sub) (ATOMIC * restrict a, const ATOMIC * restrict b,
+                     size_t n)
+{
+  SIMD_CALL(sub, (a, b, n));
+}
+
+
+static void
+FUNCTION(simd, mul) (ATOMIC * restrict a, const ATOMIC * restrict b,
+                     size_t n)
+{
+  SIMD_CALL(mul, (a, b, n));
+}
+
+
+static void
+FUNCTION(simd, div) (ATOMIC * restrict a, const ATOMIC * restrict b,
+                     size_t n)
+{
+  SIMD_CALL(div, (a, b, n));
+}
+
+
+static void
+FUNCTION(simd, scale) (ATOMIC * restrict a, const double x, size_t n)
+{
+  SIMD_CALL(scale, (a, x, n));
+}
+
+
+static void
+FUNCTION(simd, add_constant) (ATOMIC * restrict a, const double x, size_t n)
+{
+  SIMD_CALL(add_constant, (a, x, n));
+}
@@ -18,12 +18,145 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
  */
 
+#include "gemm_source.c"
+#include "oper_simd_source.c"
+
+/*
+ * An element-wise operation a = a op b (or a = a op c if b is NULL),
+ * on the rows of a and b or, when rows is 1, on all the elements.
+ */
+typedef struct
+{
+  int op;  /* OPER_ADD, ... */
+  ATOMIC * x;
+  const ATOMIC * y;
+  size_t x_tda, y_tda;
+  size_t rows, n;
+  double c;
+} TYPE(oper_job);
+
+
+static void
+FUNCTION(tensor, oper_row) (const TYPE(oper_job) * job, ATOMIC * x,
+                            const ATOMIC * y, size_t n)
+{
+  size_t i;
+
+  switch (job->op)
+    {
+    case OPER_ADD:
+      if (DISJOINT(x, y, n))
+        FUNCTION(simd, add) (x, y, n);
+      else
+        for (i = 0; i < n; i++)
+          x[i] += y[i];
+      break;
+
+    case OPER_SUB:
+      if (DISJOINT(x, y, n))
+        FUNCTION(simd, sub) (x, y, n);
+      else
+        for (i = 0; i < n; i++)
+          x[i] -= y[i];
+      break;
+
+    case OPER_MUL:
+      if (DISJOINT(x, y, n))
+        FUNCTION(simd, mul) (x, y, n);
+      else
+        for (i = 0; i < n; i++)
+          x[i] *= y[i];
+      break;
+
+    case OPER_DIV:
+      if (DISJOINT(x, y, n))
+        FUNCTION(simd, div) (x, y, n);
+      else
+        for (i = 0; i < n; i++)
+          x[i] /= y[i];
+      break;
+
+    case OPER_SCALE:
+      FUNCTION(simd, scale) (x, job->c, n);
+      break;
+
+    case OPER_ADD_CONSTANT:
+      FUNCTION(simd, add_constant) (x, job->c, n);
+      break;
+    }
+}
+
+
+/*
+ * Does the items (rows, or elements if there is one row) from begin
+ * to end - 1 of the job at arg, in one of the threads.
+ */
+static void
+FUNCTION(tensor, oper_part) (void * arg, size_t begin, size_t end)
+{
+  const TYPE(oper_job) * job = (const TYPE(oper_job) *) arg;
+  size_t r;
+
+  if (job->rows == 1)
+    {
+      FUNCTION(tensor, oper_row) (job, job->x + begin,
+                                  (job->y != NULL) ? job->y + begin : NULL,
+                                  end - begin);
+      return;
+    }
+
+  for (r = begin; r < end; r++)
+    FUNCTION(tensor, oper_row) (job, job->x + r * job->x_tda,
+                                (job->y != NULL) ? job->y + r * job->y_tda
+                                                 : NULL,
+                                job->n);
+}
+
+
+/*
+ * a = a op b, or a = a op c if b is NULL, split among the threads in
+ * parts of at least min elements. a must not be shared. If the data of
+ * b overlaps that of a (other than being the same) it is all done in
+ * one thread, in order.
+ */
+static int
+FUNCTION(tensor, oper_run) (TYPE(tensor) * a, const TYPE(tensor) * b,
+                            int op, double c, size_t min)
+{
+  TYPE(oper_job) job;
+  size_t items, grain;
+
+  job.op = op;
+  job.x = a->data;
+  job.y = (b != NULL) ? b->data : NULL;
+  job.x_tda = a->tda;
+  job.y_tda = (b != NULL) ? b->tda : 0;
+  job.rows = (b != NULL) ? TENSOR_ROWS2(a, b) : TENSOR_ROWS(a);
+  job.n = a->size / job.rows;
+  job.c = c;
+
+  items = PARALLEL_ITEMS(job.rows, job.n);
+  grain = PARALLEL_GRAIN(job.rows, job.n, min);
+
+  if (b != NULL && !(a->data == b->data && a->tda == b->tda))
+    {
+      const size_t span = (job.rows - 1) * GSL_MAX(a->tda, b->tda) + job.n;
+
+      if (!DISJOINT(a->data, b->data, span))
+        grain = items;
+    }
+
+  tensor_parallel_for (items, grain, FUNCTION(tensor, oper_part), &job);
+
+  return GSL_SUCCESS;
+}
+
+
 int
 FUNCTION(tensor, add) (TYPE(tensor) * a, const TYPE(tensor) * b)
 {
   const unsigned int rank = a->rank;
   const size_t dimension  = a->dimension;
-  size_t i, n;
 
   if (b->rank != rank || b->dimension != dimension)
     {
@@ -31,13 +164,12 @@ FUNCTION(tensor, add) (TYPE(tensor) * a, const TYPE(tensor) * b)
       return 1;
     }
 
+  if (FUNCTION(tensor, unshare) (a))
+    return GSL_ENOMEM;
 
-  n = a->size;
-
-  for (i = 0; i < n; i++)
-    a->data[i] += b->data[i];
 
-  return GSL_SUCCESS;
+  return FUNCTION(tensor, oper_run) (a, b, OPER_ADD, 0.0,
+                                     PARALLEL_MIN_ARITH);
 }
 
 
@@ -46,7 +178,6 @@ FUNCTION(tensor, sub) (TYPE(tensor) * a, const TYPE(tensor) * b)
 {
   const unsigned int rank = a->rank;
   const size_t dimension  = a->dimension;
-  size_t i, n;
 
   if (b->rank != rank || b->dimension != dimension)
     {
@@ -54,13 +185,12 @@ FUNCTION(tensor, sub) (TYPE(tensor) * a, const TYPE(tensor) * b)
       return 1;
     }
 
+  if (FUNCTION(tensor, unshare) (a))
+    return GSL_ENOMEM;
 
-  n = a->size;
-
-  for (i = 0; i < n; i++)
-    a->data[i] -= b->data[i];
 
-  return GSL_SUCCESS;
+  return FUNCTION(tensor, oper_run) (a, b, OPER_SUB, 0.0,
+                                     PARALLEL_MIN_ARITH);
 }
 
 
@@ -70,7 +200,6 @@ FUNCTION(tensor, mul_elements) (TYPE(tensor) * a,
 {
   const unsigned int rank = a->rank;
   const size_t dimension  = a->dimension;
-  size_t i, n;
 
   if (b->rank != rank || b->dimension != dimension)
     {
@@ -78,13 +207,12 @@ FUNCTION(tensor, mul_elements) (TYPE(tensor) * a,
       return 1;
     }
 
+  if (FUNCTION(tensor, unshare) (a))
+    return GSL_ENOMEM;
 
-  n = a->size;
-
-  for (i = 0; i < n; i++)
-    a->data[i] *= b->data[i];
 
-  return GSL_SUCCESS;
+  return FUNCTION(tensor, oper_run) (a, b, OPER_MUL, 0.0,
+                                     PARALLEL_MIN_ARITH);
 }
 
 
@@ -94,7 +222,6 @@ FUNCTION(tensor, div_elements) (TYPE(tensor) * a,
 {
   const unsigned int rank = a->rank;
   const size_t dimension  = a->dimension;
-  size_t i, n;
 
   if (b->rank != rank || b->dimension != dimension)
     {
@@ -102,65 +229,53 @@ FUNCTION(tensor, div_elements) (TYPE(tensor) * a,
       return 1;
     }
 
+  if (FUNCTION(tensor, unshare) (a))
+    return GSL_ENOMEM;
 
-  n = a->size;
-
-  for (i = 0; i < n; i++)
-    a->data[i] /= b->data[i];
 
-  return GSL_SUCCESS;
+  return FUNCTION(tensor, oper_run) (a, b, OPER_DIV, 0.0,
+                                     PARALLEL_MIN_DIV);
 }
 
 
 int
 FUNCTION(tensor, scale) (TYPE(tensor) * a, const double x)
 {
-  size_t i, n;
-
-  n = a->size;
-
-  for (i = 0; i < n; i++)
-    a->data[i] *= x;
+  if (FUNCTION(tensor, unshare) (a))
+    return GSL_ENOMEM;
 
-  return GSL_SUCCESS;
+  return FUNCTION(tensor, oper_run) (a, NULL, OPER_SCALE, x,
+                                     PARALLEL_MIN_ARITH);
 }
 
 
 int
 FUNCTION(tensor, add_constant) (TYPE(tensor) * a, const double x)
 {
-  size_t i, n;
-
-  n = a->size;
-
-  for (i = 0; i < n; i++)
-    a->data[i] += x;
+  if (FUNCTION(tensor, unshare) (a))
+    return GSL_ENOMEM;
 
-  return GSL_SUCCESS;
+  return FUNCTION(tensor, oper_run) (a, NULL, OPER_ADD_CONSTANT, x,
+                                     PARALLEL_MIN_ARITH);
 }
 
 
 int
 FUNCTION(tensor, add_diagonal) (TYPE(tensor) * a, const double x)
 {
-  unsigned int i, j;
-  size_t * index;
-  size_t position;
+  unsigned int i;
+  size_t step;
 
-  index = (size_t *) malloc(a->rank * sizeof(size_t));
+  /* Element (i, i, ..., i) is at i * (stride[0] + ... + stride[rank-1]) */
+  if (FUNCTION(tensor, unshare) (a))
+    return GSL_ENOMEM;
 
+  step = 0;
   for (i = 0; i < a->rank; i++)
-    {
-      for (j = 0; j < a->rank; j++)
-        index[j] = i;
-
-      position = index2position(a->rank, a->dimension, index);
-
-      a->data[position] += x;
-    }
-
+    step += a->stride[i];
 
-  free(index);
+  for (i = 0; i < a->rank; i++)
+    a->data[i * step] += x;
 
   return GSL_SUCCESS;
 }
@@ -176,107 +291,724 @@ TYPE(tensor) *
 FUNCTION(tensor, product) (const TYPE(tensor) * a,
                            const TYPE(tensor) * b)
 {
-  size_t i, j;
-  size_t position;
+  return FUNCTION(tensor, product_ws) (a, b, NULL);
+}
 
-  if (a->dimension != b->dimension)
+
+/*
+ * Same as tensor_product, with the result in the workspace w.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, product_ws) (const TYPE(tensor) * a,
+                              const TYPE(tensor) * b,
+                              tensor_workspace * w)
+{
+  TYPE(tensor) * c;
+
+  c = FUNCTION(tensor, alloc_ws) (a->rank + b->rank, a->dimension, w);
+
+  if (c == NULL)
+    return NULL;
+
+  if (FUNCTION(tensor, product_into) (c, a, b) != GSL_SUCCESS)
     {
-      GSL_ERROR_VAL("tensors must have same underlying dimension",
-                    GSL_EBADLEN, 0);
+      if (w == NULL)
+        FUNCTION(tensor, free) (c);
       return NULL;
     }
 
-  TYPE(tensor) * c =
-    FUNCTION(tensor, alloc) (a->rank + b->rank, a->dimension);
+  return c;
+}
+
 
-  position = 0;
-  for (i = 0; i < a->size; i++)
-    for (j = 0; j < b->size; j++)
-      c->data[position++] = a->data[i] * b->data[j];
+/*
+ * Tensorial product of a and b, written in c, which must already have
+ * rank a->rank + b->rank and their dimension.
+ */
+int
+FUNCTION(tensor, product_into) (TYPE(tensor) * c,
+                                const TYPE(tensor) * a,
+                                const TYPE(tensor) * b)
+{
+  size_t i, j, k, r;
+  size_t a_rows, b_rows, b_step, c_step;
+  ATOMIC * row;
 
-  return c;
+  if (a->dimension != b->dimension)
+    {
+      GSL_ERROR("tensors must have same underlying dimension", GSL_EBADLEN);
+    }
+
+  if (c->rank != a->rank + b->rank || c->dimension != a->dimension)
+    {
+      GSL_ERROR("destination tensor has the wrong size", GSL_EBADLEN);
+    }
+
+  if (FUNCTION(tensor, unshare) (c))
+    return GSL_ENOMEM;
+
+  if (c->data == a->data || c->data == b->data)
+    {
+      GSL_ERROR("product can not be done in place", GSL_EINVAL);
+    }
+
+  if (b->rank == 0)
+    {
+      /* c is a times a number */
+      const size_t rows = TENSOR_ROWS2(c, a);
+      const size_t n = a->size / rows;
+
+      for (r = 0; r < rows; r++)
+        for (i = 0; i < n; i++)
+          c->data[r * c->tda + i] = a->data[r * a->tda + i] * b->data[0];
+
+      return GSL_SUCCESS;
+    }
+
+  /*
+   * Otherwise the last index of c is that of b, so each row of b, times
+   * an element of a, gives a row of c (or all of b does, if b and c
+   * have no padding).
+   */
+  if (TENSOR_CONTIGUOUS(b) && TENSOR_CONTIGUOUS(c))
+    {
+      b_rows = 1;
+      b_step = c_step = b->size;
+    }
+  else
+    {
+      b_rows = b->size / b->dimension;
+      b_step = b->tda;
+      c_step = c->tda;
+    }
+
+  a_rows = TENSOR_ROWS(a);
+  row = c->data;
+  for (r = 0; r < a_rows; r++)
+    for (i = 0; i < a->size / a_rows; i++)
+      {
+        const ATOMIC x = a->data[r * a->tda + i];
+
+        for (k = 0; k < b_rows; k++)
+          {
+            const ATOMIC * const y = b->data + k * b_step;
+
+            for (j = 0; j < b->size / b_rows; j++)
+              row[j] = x * y[j];
+
+            row += c_step;
+          }
+      }
+
+  return GSL_SUCCESS;
 }
 
 
 /*
- * Contracts the indices i and j of a tensor.
+ * A contraction, as set up by tensor_contract_pairs(), whose output
+ * items (rows of the output, or elements when the last index is
+ * contracted) can be computed in any order.
+ */
+typedef struct
+{
+  const TYPE(tensor) * t_ij;
+  ATOMIC * out;
+  size_t out_tda;
+  size_t npairs, n_diag, row_length;
+  unsigned int n_free;
+  size_t free_stride[TENSOR_MAX_RANK];  /* of the output indices */
+  size_t step[TENSOR_MAX_RANK];         /* one per pair */
+} TYPE(contract_job);
+
+
+/*
+ * Computes the output items from begin to end - 1.
+ *
+ * The output is written in order while a counter over its indices
+ * keeps track of where the corresponding part of the input starts,
+ * so only the first item has its indices decoded from its position
+ * (which takes O(rank) divisions). A second counter runs over the
+ * values of the contracted indices, each of them a fixed step apart.
  *
- * This function, unlike the others above, is not trivial. The
- * algorithm is based on the correspondence of the indices in the
- * tensor and the serialized corresponding position.
+ * When the last index is not contracted, a whole row of the output
+ * (all values of the last index) is accumulated at once from
+ * contiguous rows of the input, with the vectorized add kernel.
+ */
+static void
+FUNCTION(tensor, contract_part) (void * arg, size_t begin, size_t end)
+{
+  const TYPE(contract_job) * job = (const TYPE(contract_job) *) arg;
+  const TYPE(tensor) * t_ij = job->t_ij;
+  const size_t dimension = t_ij->dimension;
+  const size_t row_length = job->row_length;
+  const size_t npairs = job->npairs;
+  const unsigned int n_free = job->n_free;
+  size_t counter[TENSOR_MAX_RANK];
+  size_t diag[TENSOR_MAX_RANK];
+  unsigned int m;
+  size_t k, x, item, column, base, offset;
+  ATOMIC * row;
+  divisor dim;
+
+  /* Indices of the first item, and where it is in the input */
+  divisor_init(&dim, dimension);
+  divisor_digits(n_free, &dim, begin, counter);
+
+  base = 0;
+  for (m = 0; m < n_free; m++)
+    base += counter[m] * job->free_stride[n_free - 1 - m];
+
+  /* counter[] was filled last index first */
+  for (m = 0; m < n_free / 2; m++)
+    {
+      const size_t c = counter[m];
+
+      counter[m] = counter[n_free - 1 - m];
+      counter[n_free - 1 - m] = c;
+    }
+
+  if (row_length > 1)
+    {
+      row = job->out + begin * job->out_tda;
+      column = 0;
+    }
+  else
+    {
+      const size_t q = divisor_quotient(begin, &dim);
+
+      column = begin - q * dimension;
+      row = job->out + q * job->out_tda + column;
+    }
+
+  for (k = 0; k < npairs; k++)
+    diag[k] = 0;
+
+  for (item = begin; item < end; item++)
+    {
+      for (x = 0; x < row_length; x++)
+        row[x] = 0;
+
+      offset = 0;
+      for (k = 0; k < job->n_diag; k++)
+        {
+          const ATOMIC * const line = t_ij->data + base + offset;
+
+          if (row_length >= KERNEL_MIN_LENGTH)
+            FUNCTION(simd, add) (row, line, row_length);
+          else
+            for (x = 0; x < row_length; x++)
+              row[x] += line[x];
+
+          /* Next element of the diagonal */
+          for (m = npairs; m > 0; m--)
+            {
+              offset += job->step[m-1];
+              if (++diag[m-1] < dimension)
+                break;
+              offset -= dimension * job->step[m-1];
+              diag[m-1] = 0;
+            }
+        }
+
+      /* Next row (or element) of the output */
+      if (row_length > 1)
+        row += job->out_tda;
+      else if (++column < dimension)
+        row++;
+      else
+        {
+          row += job->out_tda - (dimension - 1);
+          column = 0;
+        }
+
+      for (m = n_free; m > 0; m--)
+        {
+          base += job->free_stride[m-1];
+          if (++counter[m-1] < dimension)
+            break;
+          base -= dimension * job->free_stride[m-1];
+          counter[m-1] = 0;
+        }
+    }
+}
+
+
+/*
+ * Contracts the npairs pairs of indices (pairs[2k], pairs[2k+1]) of
+ * t_ij and writes the result, of rank t_ij->rank - 2*npairs, in out.
+ * The indices must have been checked by the caller.
+ *
+ * The output is split among the threads in contiguous ranges of rows,
+ * so that each thread reads and writes its own part of the memory.
+ * Each element of the output is summed in the order of the diagonal,
+ * and by itself, so it is the same to the last bit however the output
+ * is split (see tensor_parallel_for()).
+ *
+ * The rows of the output start out_tda elements apart.
+ */
+static void
+FUNCTION(tensor, contract_pairs) (const TYPE(tensor) * t_ij,
+                                  const size_t * pairs, size_t npairs,
+                                  ATOMIC * out, size_t out_tda)
+{
+  const size_t dimension = t_ij->dimension;
+  const unsigned int rank = t_ij->rank;
+  const size_t * const stride = t_ij->stride;
+  TYPE(contract_job) job;
+  int contracted[TENSOR_MAX_RANK];
+  unsigned int m;
+  size_t k, items, work;
+
+  job.t_ij = t_ij;
+  job.out = out;
+  job.out_tda = out_tda;
+  job.npairs = npairs;
+
+  for (m = 0; m < rank; m++)
+    contracted[m] = 0;
+
+  job.n_diag = 1;
+  for (k = 0; k < npairs; k++)
+    {
+      contracted[pairs[2*k]] = contracted[pairs[2*k+1]] = 1;
+      job.step[k] = stride[pairs[2*k]] + stride[pairs[2*k+1]];
+      job.n_diag *= dimension;
+    }
+
+  job.n_free = 0;
+  for (m = 0; m < rank; m++)
+    if (!contracted[m])
+      job.free_stride[job.n_free++] = stride[m];
+
+  /* Work on whole rows when the last index is not contracted */
+  job.row_length = (rank > 0 && !contracted[rank - 1]) ? dimension : 1;
+  if (job.row_length > 1)
+    job.n_free--;
+
+  items = t_ij->size / (job.n_diag * job.n_diag) / job.row_length;
+  work = job.n_diag * job.row_length;  /* elements read per item */
+
+  tensor_parallel_for (items, (PARALLEL_MIN_CONTRACT + work - 1) / work,
+                       FUNCTION(tensor, contract_part), &job);
+}
+
+
+/*
+ * Checks that pairs[0..2*npairs-1] are different indices of a tensor
+ * of the given rank.
+ */
+static int
+FUNCTION(tensor, check_pairs) (unsigned int rank,
+                               const size_t * pairs, size_t npairs)
+{
+  int used[TENSOR_MAX_RANK];
+  unsigned int m;
+
+  if (rank > TENSOR_MAX_RANK || 2 * npairs > rank)
+    return GSL_EINVAL;
+
+  for (m = 0; m < rank; m++)
+    used[m] = 0;
+
+  for (m = 0; m < 2 * npairs; m++)
+    {
+      if (pairs[m] >= rank || used[pairs[m]])
+        return GSL_EINVAL;
+      used[pairs[m]] = 1;
+    }
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Contracts the indices i and j of a tensor.
  */
 TYPE(tensor) *
 FUNCTION(tensor, contract) (const TYPE(tensor) * t_ij,
                             size_t i, size_t j)
 {
-  size_t dimension;
-  unsigned int rank;
-  size_t n;
+  return FUNCTION(tensor, contract_ws) (t_ij, i, j, NULL);
+}
 
-  size_t k;
-  size_t step;
-  size_t * indices;
-  size_t pos;
-  size_t pos_00;
-  ATOMIC sum;
 
-  dimension = t_ij->dimension;  /* to write less later */
-  rank = t_ij->rank;
+/*
+ * Same as tensor_contract, with the result in the workspace w.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, contract_ws) (const TYPE(tensor) * t_ij,
+                               size_t i, size_t j, tensor_workspace * w)
+{
+  size_t pair[2];
+
+  pair[0] = i;
+  pair[1] = j;
+
+  return FUNCTION(tensor, contract_many_ws) (t_ij, pair, 1, w);
+}
+
+
+/*
+ * Contracts the indices i and j of t_ij into dest, which must already
+ * have rank t_ij->rank - 2 and the same dimension.
+ */
+int
+FUNCTION(tensor, contract_into) (TYPE(tensor) * dest,
+                                 const TYPE(tensor) * t_ij,
+                                 size_t i, size_t j)
+{
+  size_t pair[2];
+
+  pair[0] = i;
+  pair[1] = j;
+
+  return FUNCTION(tensor, contract_many_into) (dest, t_ij, pair, 1);
+}
 
-  if (i >= rank || j >= rank || i == j)
+
+/*
+ * Contracts several pairs of indices of a tensor at once: indices
+ * pairs[0] and pairs[1], pairs[2] and pairs[3], etc.
+ *
+ * This reads the tensor only once and needs no intermediate tensors,
+ * unlike calling tensor_contract() npairs times.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, contract_many) (const TYPE(tensor) * t,
+                                 const size_t * pairs, size_t npairs)
+{
+  return FUNCTION(tensor, contract_many_ws) (t, pairs, npairs, NULL);
+}
+
+
+/*
+ * Same as tensor_contract_many, with the result in the workspace w.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, contract_many_ws) (const TYPE(tensor) * t,
+                                    const size_t * pairs, size_t npairs,
+                                    tensor_workspace * w)
+{
+  TYPE(tensor) * t_c;
+
+  if (FUNCTION(tensor, check_pairs) (t->rank, pairs, npairs))
     {
       GSL_ERROR_VAL("bad indices to contract tensor", GSL_EINVAL, 0);
-      return NULL;
     }
 
   /* Create a new tensor with the appropriate rank */
-  TYPE(tensor) * t_ii = FUNCTION(tensor, alloc) (rank - 2, dimension);
+  t_c = FUNCTION(tensor, alloc_ws) (t->rank - 2 * npairs, t->dimension, w);
 
-  if (t_ii == NULL)
+  if (t_c == NULL)
     {
-      GSL_ERROR_VAL("no memory to allocate tensor", GSL_EINVAL, 0);
-      return NULL;
+      GSL_ERROR_VAL("no memory to allocate tensor", GSL_ENOMEM, 0);
     }
 
-  /* Number of elements of the new tensor */
-  n = t_ii->size;
+  FUNCTION(tensor, contract_many_into) (t_c, t, pairs, npairs);
 
+  return t_c;
+}
 
-  /* Start counting the indices in the opposite direction,
-   * for clarity in the algorithm (but potentially confusing!)
-   * Now the last two indices, for instance, will be 1,0.
-   */
-  i = (rank - 1) - i;
-  j = (rank - 1) - j;
 
-  if (i > j) {         /* swap indices if necessary, so j > i */
-    k = i;
-    i = j;
-    j = k;
-  }
+/*
+ * Contracts several pairs of indices of t into dest, which must
+ * already have rank t->rank - 2*npairs and the same dimension.
+ */
+int
+FUNCTION(tensor, contract_many_into) (TYPE(tensor) * dest,
+                                      const TYPE(tensor) * t,
+                                      const size_t * pairs, size_t npairs)
+{
+  if (FUNCTION(tensor, check_pairs) (t->rank, pairs, npairs))
+    {
+      GSL_ERROR("bad indices to contract tensor", GSL_EINVAL);
+    }
 
-  step = quick_pow(dimension, i) + quick_pow(dimension, j);
+  if (dest->rank != t->rank - 2 * npairs || dest->dimension != t->dimension)
+    {
+      GSL_ERROR("destination tensor has the wrong size", GSL_EBADLEN);
+    }
 
-  indices = (size_t *) malloc(rank * sizeof(size_t));
+  if (FUNCTION(tensor, unshare) (dest))
+    return GSL_ENOMEM;
 
-  for (pos = 0; pos < n; pos++)
+  if (dest->data == t->data)
     {
-      sum = 0;
+      GSL_ERROR("contraction can not be done in place", GSL_EINVAL);
+    }
 
-      position2index(rank - 2, dimension, pos, indices);
+  FUNCTION(tensor, contract_pairs) (t, pairs, npairs, dest->data, dest->tda);
 
-      vec_insert(indices, rank - 2, i, 0);
-      vec_insert(indices, rank - 1, j, 0);
+  return GSL_SUCCESS;
+}
 
-      pos_00 = index2position(rank, dimension, indices);
 
-      for (k = 0; k < dimension; k++)
-        sum += t_ij->data[pos_00 + step * k];
+/*
+ * Contracts all indices of a tensor of even rank in consecutive
+ * pairs (0 with 1, 2 with 3, ...) and returns the resulting scalar.
+ * For a rank 2 tensor, this is the trace of the matrix.
+ */
+BASE
+FUNCTION(tensor, trace_all) (const TYPE(tensor) * t)
+{
+  size_t pairs[TENSOR_MAX_RANK];
+  ATOMIC trace;
+  unsigned int m;
 
-      t_ii->data[pos] = sum;
+  if (t->rank % 2 != 0 || t->rank > TENSOR_MAX_RANK)
+    {
+      GSL_ERROR_VAL("tensor must have even rank for a full trace",
+                    GSL_EINVAL, 0);
     }
 
-  free(indices);
+  for (m = 0; m < t->rank; m++)
+    pairs[m] = m;
+
+  FUNCTION(tensor, contract_pairs) (t, pairs, t->rank / 2, &trace, 1);
+
+  return trace;
+}
+
+
+/*
+ * Moves the indices of t listed in "first" (n of them) to the front
+ * (if front != 0) or to the back (if front == 0), keeping the order of
+ * the others. If nothing has to move (and t has no padding) it returns
+ * t itself, otherwise a new tensor in the workspace w (or one that the
+ * caller must free, if w is NULL).
+ */
+static const TYPE(tensor) *
+FUNCTION(tensor, tensordot_operand) (const TYPE(tensor) * t,
+                                     const size_t * first, size_t n,
+                                     int front, tensor_workspace * w)
+{
+  size_t perm[TENSOR_MAX_RANK];
+  int contracted[TENSOR_MAX_RANK];
+  unsigned int k, m, free_start;
+  int identity;
+  TYPE(tensor) * tt;
+
+  for (k = 0; k < t->rank; k++)
+    contracted[k] = 0;
+  for (k = 0; k < n; k++)
+    contracted[first[k]] = 1;
+
+  free_start = front ? n : 0;
+  m = free_start;
+  for (k = 0; k < t->rank; k++)
+    if (!contracted[k])
+      perm[m++] = k;
+  m = front ? 0 : t->rank - n;
+  for (k = 0; k < n; k++)
+    perm[m + k] = first[k];
+
+  identity = 1;
+  for (k = 0; k < t->rank; k++)
+    if (perm[k] != k)
+      identity = 0;
+
+  if (identity && TENSOR_CONTIGUOUS(t))
+    return t;
+
+  tt = FUNCTION(tensor, alloc_ws) (t->rank, t->dimension, w);
+  if (tt == NULL)
+    return NULL;
+
+  FUNCTION(tensor, permute) (tt, t, perm);
+
+  return tt;
+}
+
+
+/*
+ * Contracts indices ia[0..n-1] of a with indices ib[0..n-1] of b:
+ *
+ *   C_{free a}{free b} = sum A_{..ia[0]=x0..} * B_{..ib[0]=x0..}
+ *
+ * The result has the free indices of a (in order) followed by the
+ * free indices of b (in order), like numpy's tensordot.
+ *
+ * Unlike tensor_product() followed by tensor_contract(), it never
+ * builds the full outer product: the operands are permuted into
+ * matrices (free x contracted, and contracted x free) and multiplied
+ * with a matrix-matrix product.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, tensordot) (const TYPE(tensor) * a, const size_t * ia,
+                             const TYPE(tensor) * b, const size_t * ib,
+                             size_t n)
+{
+  return FUNCTION(tensor, tensordot_ws) (a, ia, b, ib, n, NULL);
+}
+
 
-  return t_ii;
+/*
+ * Checks that ia[0..n-1] and ib[0..n-1] are different indices of a
+ * and b that can be contracted together.
+ */
+static int
+FUNCTION(tensor, tensordot_check) (const TYPE(tensor) * a, const size_t * ia,
+                                   const TYPE(tensor) * b, const size_t * ib,
+                                   size_t n)
+{
+  int used_a[TENSOR_MAX_RANK], used_b[TENSOR_MAX_RANK];
+  unsigned int k;
+
+  if (a->dimension != b->dimension)
+    {
+      GSL_ERROR("tensors must have same underlying dimension", GSL_EBADLEN);
+    }
+
+  if (a->rank > TENSOR_MAX_RANK || b->rank > TENSOR_MAX_RANK)
+    {
+      GSL_ERROR("tensor rank too large for tensordot", GSL_EINVAL);
+    }
+
+  if (n > a->rank || n > b->rank)
+    {
+      GSL_ERROR("too many indices to contract", GSL_EINVAL);
+    }
+
+  for (k = 0; k < TENSOR_MAX_RANK; k++)
+    used_a[k] = used_b[k] = 0;
+
+  for (k = 0; k < n; k++)
+    {
+      if (ia[k] >= a->rank || ib[k] >= b->rank || used_a[ia[k]] ||
+          used_b[ib[k]])
+        {
+          GSL_ERROR("bad indices to contract tensors", GSL_EINVAL);
+        }
+      used_a[ia[k]] = used_b[ib[k]] = 1;
+    }
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Same as tensor_tensordot_into, with the permuted operands in the
+ * workspace w (or on the heap, freed before returning, if w is NULL).
+ */
+static int
+FUNCTION(tensor, tensordot_work) (TYPE(tensor) * c,
+                                  const TYPE(tensor) * a, const size_t * ia,
+                                  const TYPE(tensor) * b, const size_t * ib,
+                                  size_t n, tensor_workspace * w)
+{
+  const TYPE(tensor) * a_mat;
+  const TYPE(tensor) * b_mat;
+  TYPE(tensor) * c_mat;
+  size_t m_rows, n_cols, k_inner;
+  int status;
+
+  status = FUNCTION(tensor, tensordot_check) (a, ia, b, ib, n);
+  if (status)
+    return status;
+
+  if (c->rank != a->rank + b->rank - 2 * n || c->dimension != a->dimension)
+    {
+      GSL_ERROR("destination tensor has the wrong size", GSL_EBADLEN);
+    }
+
+  if (FUNCTION(tensor, unshare) (c))
+    return GSL_ENOMEM;
+
+  if (c->data == a->data || c->data == b->data)
+    {
+      GSL_ERROR("tensordot can not be done in place", GSL_EINVAL);
+    }
+
+  a_mat = FUNCTION(tensor, tensordot_operand) (a, ia, n, 0, w);
+  b_mat = FUNCTION(tensor, tensordot_operand) (b, ib, n, 1, w);
+
+  if (a_mat == NULL || b_mat == NULL)
+    {
+      if (w == NULL && a_mat != NULL && a_mat != a)
+        FUNCTION(tensor, free) ((TYPE(tensor) *) a_mat);
+      if (w == NULL && b_mat != NULL && b_mat != b)
+        FUNCTION(tensor, free) ((TYPE(tensor) *) b_mat);
+      GSL_ERROR("no memory to permute operands", GSL_ENOMEM);
+    }
+
+  /* The product is only written in place if c has no padding */
+  c_mat = c;
+  if (!TENSOR_CONTIGUOUS(c))
+    c_mat = FUNCTION(tensor, alloc_ws) (c->rank, c->dimension, w);
+
+  if (c_mat == NULL)
+    {
+      status = GSL_ENOMEM;
+      goto done;
+    }
+
+  k_inner = quick_pow(a->dimension, n);
+  m_rows = a->size / k_inner;
+  n_cols = b->size / k_inner;
+
+  FUNCTION(tensor, gemm) (m_rows, n_cols, k_inner,
+                          a_mat->data, b_mat->data, c_mat->data);
+
+  if (c_mat != c)
+    {
+      FUNCTION(tensor, memcpy) (c, c_mat);
+      if (w == NULL)
+        FUNCTION(tensor, free) (c_mat);
+    }
+
+ done:
+  if (w == NULL && a_mat != a)
+    FUNCTION(tensor, free) ((TYPE(tensor) *) a_mat);
+  if (w == NULL && b_mat != b)
+    FUNCTION(tensor, free) ((TYPE(tensor) *) b_mat);
+
+  if (status)
+    {
+      GSL_ERROR("no memory for the product", status);
+    }
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Same as tensor_tensordot, with the result in the workspace w, as
+ * well as the permuted operands.
+ */
+TYPE(tensor) *
+FUNCTION(tensor, tensordot_ws) (const TYPE(tensor) * a, const size_t * ia,
+                                const TYPE(tensor) * b, const size_t * ib,
+                                size_t n, tensor_workspace * w)
+{
+  TYPE(tensor) * c;
+
+  if (FUNCTION(tensor, tensordot_check) (a, ia, b, ib, n))
+    return NULL;
+
+  c = FUNCTION(tensor, alloc_ws) (a->rank + b->rank - 2 * n, a->dimension, w);
+  if (c == NULL)
+    return NULL;
+
+  if (FUNCTION(tensor, tensordot_work) (c, a, ia, b, ib, n, w))
+    {
+      if (w == NULL)
+        FUNCTION(tensor, free) (c);
+      return NULL;
+    }
+
+  return c;
+}
+
+
+/*
+ * Same as tensor_tensordot, with the result written in c, which must
+ * already have rank a->rank + b->rank - 2*n and their dimension.
+ */
+int
+FUNCTION(tensor, tensordot_into) (TYPE(tensor) * c,
+                                  const TYPE(tensor) * a, const size_t * ia,
+                                  const TYPE(tensor) * b, const size_t * ib,
+                                  size_t n)
+{
+  return FUNCTION(tensor, tensordot_work) (c, a, ia, b, ib, n, NULL);
 }
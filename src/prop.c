@@ -19,6 +19,22 @@
 #include <config.h>
 #include "tensor.h"
 #include <gsl/gsl_errno.h>
+#include "tensor_internal.h"
+
+/*
+ * A flag that the parts of an operation, in several threads, set and
+ * look at to stop early. Looking at it is cheap enough for every row.
+ */
+#if defined(__ATOMIC_RELAXED)
+#define FLAG_SET(f) __atomic_store_n (&(f), 1, __ATOMIC_RELAXED)
+#define FLAG_GET(f) __atomic_load_n (&(f), __ATOMIC_RELAXED)
+#else
+#define FLAG_SET(f) ((f) = 1)
+#define FLAG_GET(f) (f)
+#endif
+
+/* Elements checked between two looks at the flag */
+#define FLAG_BLOCK 4096
 
 #define BASE_COMPLEX_DOUBLE
 #include "templates_on.h"
@@ -18,18 +18,70 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
  */
 
-int
-FUNCTION (tensor, isnull) (const TYPE (tensor) * t)
+/* A tensor to check, by rows or, if rows is 1, all at once */
+typedef struct
 {
-  size_t i, n;
+  const ATOMIC * data;
+  size_t tda, rows, n;
+  volatile int nonzero;  /* found in some part, so the others can stop */
+} TYPE(isnull_job);
+
 
-  n = t->size;
+static int
+FUNCTION (tensor, isnull_run) (const ATOMIC * data, size_t n)
+{
+  size_t i;
 
   for (i = 0; i < n; i++)
     {
-      if (t->data[i] != 0.0)
+      if (data[i] != 0.0)
         return 0;
     }
 
   return 1;
 }
+
+
+static void
+FUNCTION (tensor, isnull_part) (void * arg, size_t begin, size_t end)
+{
+  TYPE(isnull_job) * job = (TYPE(isnull_job) *) arg;
+  size_t b, r;
+
+  if (job->rows == 1)
+    {
+      for (b = begin; b < end && !FLAG_GET(job->nonzero); b += FLAG_BLOCK)
+        {
+          const size_t len = (end - b < FLAG_BLOCK) ? end - b : FLAG_BLOCK;
+
+          if (!FUNCTION (tensor, isnull_run) (job->data + b, len))
+            FLAG_SET(job->nonzero);
+        }
+      return;
+    }
+
+  for (r = begin; r < end && !FLAG_GET(job->nonzero); r++)
+    {
+      if (!FUNCTION (tensor, isnull_run) (job->data + r * job->tda, job->n))
+        FLAG_SET(job->nonzero);
+    }
+}
+
+
+int
+FUNCTION (tensor, isnull) (const TYPE (tensor) * t)
+{
+  TYPE(isnull_job) job;
+
+  job.data = t->data;
+  job.tda = t->tda;
+  job.rows = TENSOR_ROWS(t);
+  job.n = TENSOR_ROW_LENGTH(t);
+  job.nonzero = 0;
+
+  tensor_parallel_for (PARALLEL_ITEMS(job.rows, job.n),
+                       PARALLEL_GRAIN(job.rows, job.n, PARALLEL_MIN_TEST),
+                       FUNCTION(tensor, isnull_part), &job);
+
+  return !job.nonzero;
+}
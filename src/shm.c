@@ -0,0 +1,302 @@
+/* tensor/shm.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Blocks in POSIX shared memory, for tensors that several processes
+ * use at once (see tensor_shm.h), and their sequence lock.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_SHM_OPEN) && defined(HAVE_MMAP)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define USE_SHM 1
+#endif
+#include <gsl/gsl_errno.h>
+#include "tensor_shm.h"
+#include "tensor_utilities.h"
+
+/*
+ * Orders the accesses to the data and to the version number, for
+ * processes that run in other processors.
+ */
+#if defined(__GNUC__)
+#define BARRIER() __sync_synchronize ()
+#else
+#define BARRIER() ((void) 0)
+#endif
+
+
+#ifdef USE_SHM
+/* Bytes before the data, keeping it aligned */
+static size_t
+shm_offset (void)
+{
+  return (sizeof (tensor_shm_header) + TENSOR_ALIGN - 1)
+    / TENSOR_ALIGN * TENSOR_ALIGN;
+}
+
+
+/*
+ * Block for the data of the mapping p of length bytes, which starts
+ * with a tensor_shm_header.
+ */
+static tensor_block *
+shm_block (void * p, size_t length, int read_only)
+{
+  tensor_shm_header * h = (tensor_shm_header *) p;
+  tensor_block * b = (tensor_block *) malloc (sizeof (tensor_block));
+
+  if (b == 0)
+    {
+      munmap (p, length);
+      GSL_ERROR_VAL ("failed to allocate space for block", GSL_ENOMEM, 0);
+    }
+
+  b->refcount = 1;
+  b->offset = h->offset;
+  b->size = length - h->offset;
+  b->align = TENSOR_ALIGN;
+  b->data = (char *) p + h->offset;
+  b->flags = TENSOR_BLOCK_MAPPED | TENSOR_BLOCK_SHM;
+  b->numa_policy = TENSOR_NUMA_DEFAULT;
+  b->numa_node = 0;
+  b->numa_applied = TENSOR_NUMA_FIRST_TOUCH;
+  if (read_only)
+    b->flags |= TENSOR_BLOCK_READ_ONLY;
+
+  return b;
+}
+#endif
+
+
+/*
+ * Creates the shared memory object "name" (which starts with '/' and
+ * must not exist yet), for a tensor with size bytes of data of the
+ * given type, rank and dimension, and maps it for reading and writing.
+ */
+tensor_block *
+tensor_block_shm_create (const char * name, const char * type,
+                         unsigned int rank, size_t dimension, size_t size)
+{
+#ifdef USE_SHM
+  const size_t offset = shm_offset ();
+  tensor_shm_header * h;
+  void * p;
+  int fd;
+
+  fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0666);
+
+  if (fd < 0)
+    {
+      GSL_ERROR_VAL ("can not create shared memory object", GSL_EFAILED, 0);
+    }
+
+  if (ftruncate (fd, (off_t) (offset + size)) != 0)
+    {
+      close (fd);
+      shm_unlink (name);
+      GSL_ERROR_VAL ("can not size shared memory object", GSL_EFAILED, 0);
+    }
+
+  p = mmap (NULL, offset + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (p == MAP_FAILED)
+    {
+      shm_unlink (name);
+      GSL_ERROR_VAL ("failed to map shared memory object", GSL_EFAILED, 0);
+    }
+
+  h = (tensor_shm_header *) p;
+  strncpy (h->type, type, sizeof (h->type) - 1);
+  h->rank = rank;
+  h->dimension = dimension;
+  h->offset = offset;
+  h->version = 0;
+
+  /* Other processes only take the header as valid once it is filled */
+  BARRIER ();
+  memcpy (h->magic, TENSOR_SHM_MAGIC, sizeof (h->magic));
+
+  return shm_block (p, offset + size, 0);
+#else
+  GSL_ERROR_VAL ("shared memory is not supported", GSL_EUNIMPL, 0);
+#endif
+}
+
+
+/*
+ * Maps the shared memory object "name", made by tensor_shm_create()
+ * for tensors of the given type, whose elements have atomic_size
+ * bytes. mode is TENSOR_MMAP_READ or TENSOR_MMAP_WRITE.
+ */
+tensor_block *
+tensor_block_shm_open (const char * name, const char * type,
+                       size_t atomic_size, int mode)
+{
+#ifdef USE_SHM
+  const int writable = (mode & TENSOR_MMAP_WRITE) != 0;
+  const tensor_shm_header * h;
+  struct stat st;
+  size_t length;
+  void * p;
+  int fd;
+
+  fd = shm_open (name, writable ? O_RDWR : O_RDONLY, 0);
+
+  if (fd < 0)
+    {
+      GSL_ERROR_VAL ("can not open shared memory object", GSL_EFAILED, 0);
+    }
+
+  if (fstat (fd, &st) != 0 || (size_t) st.st_size < shm_offset ())
+    {
+      close (fd);
+      GSL_ERROR_VAL ("shared memory object is not a tensor", GSL_EINVAL, 0);
+    }
+
+  length = (size_t) st.st_size;
+  p = mmap (NULL, length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+            MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (p == MAP_FAILED)
+    {
+      GSL_ERROR_VAL ("failed to map shared memory object", GSL_EFAILED, 0);
+    }
+
+  h = (const tensor_shm_header *) p;
+
+  if (memcmp (h->magic, TENSOR_SHM_MAGIC, sizeof (h->magic)) != 0 ||
+      h->offset != shm_offset () ||
+      h->dimension == 0 ||
+      length - h->offset < quick_pow (h->dimension, h->rank) * atomic_size)
+    {
+      munmap (p, length);
+      GSL_ERROR_VAL ("shared memory object is not a tensor", GSL_EINVAL, 0);
+    }
+
+  if (strncmp (h->type, type, sizeof (h->type)) != 0)
+    {
+      munmap (p, length);
+      GSL_ERROR_VAL ("shared memory object has tensors of another type",
+                     GSL_EINVAL, 0);
+    }
+
+  return shm_block (p, length, !writable);
+#else
+  GSL_ERROR_VAL ("shared memory is not supported", GSL_EUNIMPL, 0);
+#endif
+}
+
+
+/*
+ * Header of the shared memory of block b, or NULL if b is not in
+ * shared memory.
+ */
+tensor_shm_header *
+tensor_block_shm_header (const tensor_block * b)
+{
+  if (b == NULL || !(b->flags & TENSOR_BLOCK_SHM))
+    return NULL;
+
+  return (tensor_shm_header *) ((char *) b->data - b->offset);
+}
+
+
+/*
+ * Removes the shared memory object "name". The processes that have it
+ * mapped can still use it, until they free their tensors.
+ */
+int
+tensor_shm_unlink (const char * name)
+{
+#ifdef USE_SHM
+  if (shm_unlink (name) != 0)
+    {
+      GSL_ERROR ("can not remove shared memory object", GSL_EFAILED);
+    }
+
+  return GSL_SUCCESS;
+#else
+  GSL_ERROR ("shared memory is not supported", GSL_EUNIMPL);
+#endif
+}
+
+
+/*
+ * Marks the data as being written. Only one process can write at a
+ * time; the lock does not keep the others out.
+ */
+void
+tensor_shm_header_write_begin (tensor_shm_header * h)
+{
+  h->version++;
+  BARRIER ();
+}
+
+
+/*
+ * Marks the end of the write started by tensor_shm_header_write_begin().
+ */
+void
+tensor_shm_header_write_end (tensor_shm_header * h)
+{
+  BARRIER ();
+  h->version++;
+}
+
+
+/*
+ * Version to give tensor_shm_header_read_retry() after reading,
+ * waiting for the write in progress to end, if any.
+ */
+unsigned long
+tensor_shm_header_read_begin (const tensor_shm_header * h)
+{
+  unsigned long version;
+
+  while ((version = h->version) & 1)
+    ;
+
+  BARRIER ();
+
+  return version;
+}
+
+
+/*
+ * True if the data was written since tensor_shm_header_read_begin() gave
+ * version, so that what was read must be read again.
+ */
+int
+tensor_shm_header_read_retry (const tensor_shm_header * h,
+                              unsigned long version)
+{
+  BARRIER ();
+
+  return h->version != version;
+}
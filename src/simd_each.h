@@ -0,0 +1,101 @@
+/* tensor/simd_each.h
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Includes the kernels in the file named by SIMD_KERNELS once for
+ * each instruction set that can be chosen when the library runs
+ * (see cpu.c), each copy compiled for its instruction set whatever
+ * the flags of the rest of the library. SIMD_CALL(name, (args)) then
+ * calls the copy of kernel "name" for the current instruction set.
+ * That includes SSE2: x86-64 compilers always target it, but those for
+ * 32-bit x86 do not.
+ *
+ * Where that is not possible (TENSOR_DISPATCH undefined) there is a
+ * single copy, for the instruction set the compiler targets.
+ */
+
+#ifdef TENSOR_DISPATCH
+
+/*
+ * The intrinsics are declared before any target is changed: some
+ * compilers reject parts of <immintrin.h> inside a target region.
+ */
+#include <immintrin.h>
+
+#define SIMD_GENERIC
+#include "simd_on.h"
+#include SIMD_KERNELS
+#include "simd_off.h"
+
+#pragma GCC push_options
+#pragma GCC target ("sse2")
+#define SIMD_SSE2
+#include "simd_on.h"
+#include SIMD_KERNELS
+#include "simd_off.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+#define SIMD_AVX2
+#include "simd_on.h"
+#include SIMD_KERNELS
+#include "simd_off.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target ("avx512f,avx512bw")
+#define SIMD_AVX512
+#include "simd_on.h"
+#include SIMD_KERNELS
+#include "simd_off.h"
+#pragma GCC pop_options
+
+#ifndef SIMD_CALL
+#define SIMD_CALL(name, args)                            \
+  do {                                                   \
+    switch (tensor_isa_level())                          \
+      {                                                  \
+      case TENSOR_ISA_AVX512:                            \
+        FUNCTION(simd_avx512, name) args;                \
+        break;                                           \
+      case TENSOR_ISA_AVX2:                              \
+        FUNCTION(simd_avx2, name) args;                  \
+        break;                                           \
+      case TENSOR_ISA_SSE2:                              \
+        FUNCTION(simd_sse2, name) args;                  \
+        break;                                           \
+      default:                                           \
+        FUNCTION(simd_generic, name) args;               \
+      }                                                  \
+  } while (0)
+#endif
+
+#else
+
+#include "simd_on.h"
+#include SIMD_KERNELS
+#include "simd_off.h"
+
+#ifndef SIMD_CALL
+#define SIMD_CALL(name, args) FUNCTION(simd_native, name) args
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+/* Undoes simd_on.h, so it can be included again for another
+   instruction set. */
+
+#undef SIMD_GENERIC
+#undef SIMD_SSE2
+#undef SIMD_AVX2
+#undef SIMD_AVX512
+#undef SIMD_DIR
+#undef SIMD_ADD_EPI16
+#undef SIMD_ADD_EPI32
+#undef SIMD_ADD_EPI64
+#undef SIMD_ADD_EPI8
+#undef SIMD_ADD_PD
+#undef SIMD_ADD_PS
+#undef SIMD_AND_SI
+#undef SIMD_ANY_NAN_PD
+#undef SIMD_ANY_NAN_PS
+#undef SIMD_ANY_OUTSIDE_PD
+#undef SIMD_BYTES
+#undef SIMD_CVTT_PD_EPI32
+#undef SIMD_CVT_HI_EPI32_PD
+#undef SIMD_CVT_HI_PS_PD
+#undef SIMD_CVT_LO_EPI32_PD
+#undef SIMD_CVT_LO_PS_PD
+#undef SIMD_CVT_PD_PS
+#undef SIMD_DIV_PD
+#undef SIMD_DIV_PS
+#undef SIMD_DUP_EVEN_PD
+#undef SIMD_DUP_ODD_PD
+#undef SIMD_LOAD_PD
+#undef SIMD_LOAD_PS
+#undef SIMD_LOAD_SI
+#undef SIMD_MAX_EPI16
+#undef SIMD_MAX_EPI32
+#undef SIMD_MAX_EPI64
+#undef SIMD_MAX_EPI8
+#undef SIMD_MAX_EPU16
+#undef SIMD_MAX_EPU32
+#undef SIMD_MAX_EPU64
+#undef SIMD_MAX_EPU8
+#undef SIMD_MAX_PD
+#undef SIMD_MAX_PS
+#undef SIMD_MIN_EPI16
+#undef SIMD_MIN_EPI32
+#undef SIMD_MIN_EPI64
+#undef SIMD_MIN_EPI8
+#undef SIMD_MIN_EPU16
+#undef SIMD_MIN_EPU32
+#undef SIMD_MIN_EPU64
+#undef SIMD_MIN_EPU8
+#undef SIMD_MIN_PD
+#undef SIMD_MIN_PS
+#undef SIMD_MULLO_EPI16
+#undef SIMD_MULLO_EPI32
+#undef SIMD_MUL_PD
+#undef SIMD_MUL_PS
+#undef SIMD_OR_SI
+#undef SIMD_PD
+#undef SIMD_PS
+#undef SIMD_SELECT_SI
+#undef SIMD_SET1_EPI16
+#undef SIMD_SET1_PD
+#undef SIMD_SI
+#undef SIMD_SIGN16
+#undef SIMD_SIGN32
+#undef SIMD_SIGN64
+#undef SIMD_SLLI_EPI16
+#undef SIMD_SRLI_EPI16
+#undef SIMD_STORE_PD
+#undef SIMD_STORE_PS
+#undef SIMD_STORE_SI
+#undef SIMD_SUB_EPI16
+#undef SIMD_SUB_EPI32
+#undef SIMD_SUB_EPI64
+#undef SIMD_SUB_EPI8
+#undef SIMD_SUB_PD
+#undef SIMD_SUB_PS
+#undef SIMD_SWAP_PAIRS_PD
+#undef SIMD_XOR_PD
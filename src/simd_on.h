@@ -0,0 +1,346 @@
+/* tensor/simd_on.h
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Vector operations for the SIMD kernels, the same way templates_on.h
+ * gives the names for each type: a kernel written with SIMD_XXX()
+ * works for 128-bit (SSE2), 256-bit (AVX2) and 512-bit (AVX-512F/BW)
+ * registers.
+ *
+ * Define SIMD_GENERIC, SIMD_SSE2, SIMD_AVX2 or SIMD_AVX512 before
+ * including this to pick one (the code must then be compiled for that
+ * instruction set, see simd_each.h); otherwise it is the best one the
+ * compiler targets. With SIMD_GENERIC, or if there is none, SIMD_BYTES
+ * is 0 and the kernels must not use the rest. SIMD_DIR is the prefix
+ * for the names of the kernels built for it. simd_off.h undoes all
+ * this.
+ *
+ * Vectors are loaded and stored unaligned: tensor data is only as
+ * aligned as malloc() makes it.
+ */
+
+#if defined(SIMD_GENERIC)
+#define SIMD_DIR simd_generic
+#elif defined(SIMD_SSE2)
+#define SIMD_DIR simd_sse2
+#elif defined(SIMD_AVX2)
+#define SIMD_DIR simd_avx2
+#elif defined(SIMD_AVX512)
+#define SIMD_DIR simd_avx512
+#else
+#define SIMD_DIR simd_native
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+#define SIMD_AVX512
+#elif defined(__AVX2__)
+#define SIMD_AVX2
+#elif defined(__SSE2__)
+#define SIMD_SSE2
+#endif
+#endif
+
+#if defined(SIMD_SSE2) || defined(SIMD_AVX2) || defined(SIMD_AVX512)
+#include <immintrin.h>
+#endif
+
+
+#if defined(SIMD_AVX512)
+
+#define SIMD_BYTES 64
+#define SIMD_PD __m512d
+#define SIMD_PS __m512
+#define SIMD_SI __m512i
+
+#define SIMD_LOAD_PD(p) _mm512_loadu_pd(p)
+#define SIMD_STORE_PD(p, v) _mm512_storeu_pd(p, v)
+#define SIMD_SET1_PD(x) _mm512_set1_pd(x)
+#define SIMD_ADD_PD(a, b) _mm512_add_pd(a, b)
+#define SIMD_SUB_PD(a, b) _mm512_sub_pd(a, b)
+#define SIMD_MUL_PD(a, b) _mm512_mul_pd(a, b)
+#define SIMD_DIV_PD(a, b) _mm512_div_pd(a, b)
+#define SIMD_XOR_PD(a, b) \
+  _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), \
+                                       _mm512_castpd_si512(b)))
+#define SIMD_DUP_EVEN_PD(a) _mm512_unpacklo_pd(a, a)
+#define SIMD_DUP_ODD_PD(a) _mm512_unpackhi_pd(a, a)
+#define SIMD_SWAP_PAIRS_PD(a) _mm512_permute_pd(a, 0x55)
+#define SIMD_ANY_OUTSIDE_PD(v, lo, hi) \
+  ((_mm512_cmp_pd_mask(v, lo, _CMP_NGE_UQ) | \
+    _mm512_cmp_pd_mask(v, hi, _CMP_NLE_UQ)) != 0)
+
+#define SIMD_LOAD_PS(p) _mm512_loadu_ps(p)
+#define SIMD_STORE_PS(p, v) _mm512_storeu_ps(p, v)
+#define SIMD_ADD_PS(a, b) _mm512_add_ps(a, b)
+#define SIMD_SUB_PS(a, b) _mm512_sub_ps(a, b)
+#define SIMD_MUL_PS(a, b) _mm512_mul_ps(a, b)
+#define SIMD_DIV_PS(a, b) _mm512_div_ps(a, b)
+
+#define SIMD_MIN_PD(a, b) _mm512_min_pd(a, b)
+#define SIMD_MAX_PD(a, b) _mm512_max_pd(a, b)
+#define SIMD_MIN_PS(a, b) _mm512_min_ps(a, b)
+#define SIMD_MAX_PS(a, b) _mm512_max_ps(a, b)
+#define SIMD_ANY_NAN_PD(v) (_mm512_cmp_pd_mask(v, v, _CMP_UNORD_Q) != 0)
+#define SIMD_ANY_NAN_PS(v) (_mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q) != 0)
+
+#define SIMD_LOAD_SI(p) _mm512_loadu_si512((const void *) (p))
+#define SIMD_STORE_SI(p, v) _mm512_storeu_si512((void *) (p), v)
+#define SIMD_SET1_EPI16(x) _mm512_set1_epi16(x)
+#define SIMD_AND_SI(a, b) _mm512_and_si512(a, b)
+#define SIMD_OR_SI(a, b) _mm512_or_si512(a, b)
+#define SIMD_ADD_EPI8(a, b) _mm512_add_epi8(a, b)
+#define SIMD_ADD_EPI16(a, b) _mm512_add_epi16(a, b)
+#define SIMD_ADD_EPI32(a, b) _mm512_add_epi32(a, b)
+#define SIMD_ADD_EPI64(a, b) _mm512_add_epi64(a, b)
+#define SIMD_SUB_EPI8(a, b) _mm512_sub_epi8(a, b)
+#define SIMD_SUB_EPI16(a, b) _mm512_sub_epi16(a, b)
+#define SIMD_SUB_EPI32(a, b) _mm512_sub_epi32(a, b)
+#define SIMD_SUB_EPI64(a, b) _mm512_sub_epi64(a, b)
+#define SIMD_MULLO_EPI16(a, b) _mm512_mullo_epi16(a, b)
+#define SIMD_MULLO_EPI32(a, b) _mm512_mullo_epi32(a, b)
+#define SIMD_SRLI_EPI16(a, n) _mm512_srli_epi16(a, n)
+#define SIMD_MIN_EPI8(a, b) _mm512_min_epi8(a, b)
+#define SIMD_MAX_EPI8(a, b) _mm512_max_epi8(a, b)
+#define SIMD_MIN_EPU8(a, b) _mm512_min_epu8(a, b)
+#define SIMD_MAX_EPU8(a, b) _mm512_max_epu8(a, b)
+#define SIMD_MIN_EPI16(a, b) _mm512_min_epi16(a, b)
+#define SIMD_MAX_EPI16(a, b) _mm512_max_epi16(a, b)
+#define SIMD_MIN_EPU16(a, b) _mm512_min_epu16(a, b)
+#define SIMD_MAX_EPU16(a, b) _mm512_max_epu16(a, b)
+#define SIMD_MIN_EPI32(a, b) _mm512_min_epi32(a, b)
+#define SIMD_MAX_EPI32(a, b) _mm512_max_epi32(a, b)
+#define SIMD_MIN_EPU32(a, b) _mm512_min_epu32(a, b)
+#define SIMD_MAX_EPU32(a, b) _mm512_max_epu32(a, b)
+#define SIMD_MIN_EPI64(a, b) _mm512_min_epi64(a, b)
+#define SIMD_MAX_EPI64(a, b) _mm512_max_epi64(a, b)
+#define SIMD_MIN_EPU64(a, b) _mm512_min_epu64(a, b)
+#define SIMD_MAX_EPU64(a, b) _mm512_max_epu64(a, b)
+#define SIMD_SLLI_EPI16(a, n) _mm512_slli_epi16(a, n)
+
+/* Conversions between a vector and the two halves of another one */
+#define SIMD_CVT_LO_PS_PD(v) _mm512_cvtps_pd(_mm512_castps512_ps256(v))
+#define SIMD_CVT_HI_PS_PD(v) \
+  _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd( \
+    _mm512_castps_pd(v), 1)))
+#define SIMD_CVT_PD_PS(lo, hi) \
+  _mm512_castpd_ps(_mm512_insertf64x4( \
+    _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(lo))), \
+    _mm256_castps_pd(_mm512_cvtpd_ps(hi)), 1))
+#define SIMD_CVT_LO_EPI32_PD(v) \
+  _mm512_cvtepi32_pd(_mm512_castsi512_si256(v))
+#define SIMD_CVT_HI_EPI32_PD(v) \
+  _mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(v, 1))
+#define SIMD_CVTT_PD_EPI32(lo, hi) \
+  _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvttpd_epi32(lo)), \
+                     _mm512_cvttpd_epi32(hi), 1)
+
+#elif defined(SIMD_AVX2)
+
+#define SIMD_BYTES 32
+#define SIMD_PD __m256d
+#define SIMD_PS __m256
+#define SIMD_SI __m256i
+
+#define SIMD_LOAD_PD(p) _mm256_loadu_pd(p)
+#define SIMD_STORE_PD(p, v) _mm256_storeu_pd(p, v)
+#define SIMD_SET1_PD(x) _mm256_set1_pd(x)
+#define SIMD_ADD_PD(a, b) _mm256_add_pd(a, b)
+#define SIMD_SUB_PD(a, b) _mm256_sub_pd(a, b)
+#define SIMD_MUL_PD(a, b) _mm256_mul_pd(a, b)
+#define SIMD_DIV_PD(a, b) _mm256_div_pd(a, b)
+#define SIMD_XOR_PD(a, b) _mm256_xor_pd(a, b)
+#define SIMD_DUP_EVEN_PD(a) _mm256_unpacklo_pd(a, a)
+#define SIMD_DUP_ODD_PD(a) _mm256_unpackhi_pd(a, a)
+#define SIMD_SWAP_PAIRS_PD(a) _mm256_permute_pd(a, 0x5)
+#define SIMD_ANY_OUTSIDE_PD(v, lo, hi) \
+  (_mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(v, lo, _CMP_NGE_UQ), \
+                                   _mm256_cmp_pd(v, hi, _CMP_NLE_UQ))) != 0)
+
+#define SIMD_LOAD_PS(p) _mm256_loadu_ps(p)
+#define SIMD_STORE_PS(p, v) _mm256_storeu_ps(p, v)
+#define SIMD_ADD_PS(a, b) _mm256_add_ps(a, b)
+#define SIMD_SUB_PS(a, b) _mm256_sub_ps(a, b)
+#define SIMD_MUL_PS(a, b) _mm256_mul_ps(a, b)
+#define SIMD_DIV_PS(a, b) _mm256_div_ps(a, b)
+
+#define SIMD_MIN_PD(a, b) _mm256_min_pd(a, b)
+#define SIMD_MAX_PD(a, b) _mm256_max_pd(a, b)
+#define SIMD_MIN_PS(a, b) _mm256_min_ps(a, b)
+#define SIMD_MAX_PS(a, b) _mm256_max_ps(a, b)
+#define SIMD_ANY_NAN_PD(v) \
+  (_mm256_movemask_pd(_mm256_cmp_pd(v, v, _CMP_UNORD_Q)) != 0)
+#define SIMD_ANY_NAN_PS(v) \
+  (_mm256_movemask_ps(_mm256_cmp_ps(v, v, _CMP_UNORD_Q)) != 0)
+
+#define SIMD_LOAD_SI(p) _mm256_loadu_si256((const __m256i *) (p))
+#define SIMD_STORE_SI(p, v) _mm256_storeu_si256((__m256i *) (p), v)
+#define SIMD_SET1_EPI16(x) _mm256_set1_epi16(x)
+#define SIMD_AND_SI(a, b) _mm256_and_si256(a, b)
+#define SIMD_OR_SI(a, b) _mm256_or_si256(a, b)
+#define SIMD_ADD_EPI8(a, b) _mm256_add_epi8(a, b)
+#define SIMD_ADD_EPI16(a, b) _mm256_add_epi16(a, b)
+#define SIMD_ADD_EPI32(a, b) _mm256_add_epi32(a, b)
+#define SIMD_ADD_EPI64(a, b) _mm256_add_epi64(a, b)
+#define SIMD_SUB_EPI8(a, b) _mm256_sub_epi8(a, b)
+#define SIMD_SUB_EPI16(a, b) _mm256_sub_epi16(a, b)
+#define SIMD_SUB_EPI32(a, b) _mm256_sub_epi32(a, b)
+#define SIMD_SUB_EPI64(a, b) _mm256_sub_epi64(a, b)
+#define SIMD_MULLO_EPI16(a, b) _mm256_mullo_epi16(a, b)
+#define SIMD_MULLO_EPI32(a, b) _mm256_mullo_epi32(a, b)
+#define SIMD_SRLI_EPI16(a, n) _mm256_srli_epi16(a, n)
+#define SIMD_MIN_EPI8(a, b) _mm256_min_epi8(a, b)
+#define SIMD_MAX_EPI8(a, b) _mm256_max_epi8(a, b)
+#define SIMD_MIN_EPU8(a, b) _mm256_min_epu8(a, b)
+#define SIMD_MAX_EPU8(a, b) _mm256_max_epu8(a, b)
+#define SIMD_MIN_EPI16(a, b) _mm256_min_epi16(a, b)
+#define SIMD_MAX_EPI16(a, b) _mm256_max_epi16(a, b)
+#define SIMD_MIN_EPU16(a, b) _mm256_min_epu16(a, b)
+#define SIMD_MAX_EPU16(a, b) _mm256_max_epu16(a, b)
+#define SIMD_MIN_EPI32(a, b) _mm256_min_epi32(a, b)
+#define SIMD_MAX_EPI32(a, b) _mm256_max_epi32(a, b)
+#define SIMD_MIN_EPU32(a, b) _mm256_min_epu32(a, b)
+#define SIMD_MAX_EPU32(a, b) _mm256_max_epu32(a, b)
+/* 64-bit ones through a comparison (unsigned: with the sign flipped) */
+#define SIMD_SIGN64 _mm256_set1_epi64x((long long) 1 << 63)
+#define SIMD_MIN_EPI64(a, b) _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b))
+#define SIMD_MAX_EPI64(a, b) _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b))
+#define SIMD_MIN_EPU64(a, b) \
+  _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(_mm256_xor_si256(a, SIMD_SIGN64), \
+                                              _mm256_xor_si256(b, SIMD_SIGN64)))
+#define SIMD_MAX_EPU64(a, b) \
+  _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(_mm256_xor_si256(a, SIMD_SIGN64), \
+                                              _mm256_xor_si256(b, SIMD_SIGN64)))
+#define SIMD_SLLI_EPI16(a, n) _mm256_slli_epi16(a, n)
+
+#define SIMD_CVT_LO_PS_PD(v) _mm256_cvtps_pd(_mm256_castps256_ps128(v))
+#define SIMD_CVT_HI_PS_PD(v) _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))
+#define SIMD_CVT_PD_PS(lo, hi) \
+  _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), \
+                       _mm256_cvtpd_ps(hi), 1)
+#define SIMD_CVT_LO_EPI32_PD(v) \
+  _mm256_cvtepi32_pd(_mm256_castsi256_si128(v))
+#define SIMD_CVT_HI_EPI32_PD(v) \
+  _mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1))
+#define SIMD_CVTT_PD_EPI32(lo, hi) \
+  _mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lo)), \
+                          _mm256_cvttpd_epi32(hi), 1)
+
+#elif defined(SIMD_SSE2)
+
+#define SIMD_BYTES 16
+#define SIMD_PD __m128d
+#define SIMD_PS __m128
+#define SIMD_SI __m128i
+
+#define SIMD_LOAD_PD(p) _mm_loadu_pd(p)
+#define SIMD_STORE_PD(p, v) _mm_storeu_pd(p, v)
+#define SIMD_SET1_PD(x) _mm_set1_pd(x)
+#define SIMD_ADD_PD(a, b) _mm_add_pd(a, b)
+#define SIMD_SUB_PD(a, b) _mm_sub_pd(a, b)
+#define SIMD_MUL_PD(a, b) _mm_mul_pd(a, b)
+#define SIMD_DIV_PD(a, b) _mm_div_pd(a, b)
+#define SIMD_XOR_PD(a, b) _mm_xor_pd(a, b)
+#define SIMD_DUP_EVEN_PD(a) _mm_unpacklo_pd(a, a)
+#define SIMD_DUP_ODD_PD(a) _mm_unpackhi_pd(a, a)
+#define SIMD_SWAP_PAIRS_PD(a) _mm_shuffle_pd(a, a, 1)
+#define SIMD_ANY_OUTSIDE_PD(v, lo, hi) \
+  (_mm_movemask_pd(_mm_or_pd(_mm_cmpnge_pd(v, lo), \
+                             _mm_cmpnle_pd(v, hi))) != 0)
+
+#define SIMD_LOAD_PS(p) _mm_loadu_ps(p)
+#define SIMD_STORE_PS(p, v) _mm_storeu_ps(p, v)
+#define SIMD_ADD_PS(a, b) _mm_add_ps(a, b)
+#define SIMD_SUB_PS(a, b) _mm_sub_ps(a, b)
+#define SIMD_MUL_PS(a, b) _mm_mul_ps(a, b)
+#define SIMD_DIV_PS(a, b) _mm_div_ps(a, b)
+
+#define SIMD_MIN_PD(a, b) _mm_min_pd(a, b)
+#define SIMD_MAX_PD(a, b) _mm_max_pd(a, b)
+#define SIMD_MIN_PS(a, b) _mm_min_ps(a, b)
+#define SIMD_MAX_PS(a, b) _mm_max_ps(a, b)
+#define SIMD_ANY_NAN_PD(v) (_mm_movemask_pd(_mm_cmpunord_pd(v, v)) != 0)
+#define SIMD_ANY_NAN_PS(v) (_mm_movemask_ps(_mm_cmpunord_ps(v, v)) != 0)
+
+#define SIMD_LOAD_SI(p) _mm_loadu_si128((const __m128i *) (p))
+#define SIMD_STORE_SI(p, v) _mm_storeu_si128((__m128i *) (p), v)
+#define SIMD_SET1_EPI16(x) _mm_set1_epi16(x)
+#define SIMD_AND_SI(a, b) _mm_and_si128(a, b)
+#define SIMD_OR_SI(a, b) _mm_or_si128(a, b)
+#define SIMD_ADD_EPI8(a, b) _mm_add_epi8(a, b)
+#define SIMD_ADD_EPI16(a, b) _mm_add_epi16(a, b)
+#define SIMD_ADD_EPI32(a, b) _mm_add_epi32(a, b)
+#define SIMD_ADD_EPI64(a, b) _mm_add_epi64(a, b)
+#define SIMD_SUB_EPI8(a, b) _mm_sub_epi8(a, b)
+#define SIMD_SUB_EPI16(a, b) _mm_sub_epi16(a, b)
+#define SIMD_SUB_EPI32(a, b) _mm_sub_epi32(a, b)
+#define SIMD_SUB_EPI64(a, b) _mm_sub_epi64(a, b)
+#define SIMD_MULLO_EPI16(a, b) _mm_mullo_epi16(a, b)
+/* SSE2 has no 32-bit multiply: use two 32x32->64 ones, keep the lows */
+#define SIMD_MULLO_EPI32(a, b) \
+  _mm_unpacklo_epi32( \
+    _mm_shuffle_epi32(_mm_mul_epu32(a, b), _MM_SHUFFLE(0, 0, 2, 0)), \
+    _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(a, 32), \
+                                    _mm_srli_epi64(b, 32)), \
+                      _MM_SHUFFLE(0, 0, 2, 0)))
+#define SIMD_SRLI_EPI16(a, n) _mm_srli_epi16(a, n)
+/*
+ * SSE2 only has min and max for unsigned bytes and signed shorts. The
+ * others go through a comparison (unsigned: with the sign flipped),
+ * and there is none for 64 bits.
+ */
+#define SIMD_SELECT_SI(m, a, b) \
+  _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+#define SIMD_SIGN16 _mm_set1_epi16(-0x7fff - 1)
+#define SIMD_SIGN32 _mm_set1_epi32(-0x7fffffff - 1)
+#define SIMD_MIN_EPI8(a, b) SIMD_SELECT_SI(_mm_cmpgt_epi8(a, b), b, a)
+#define SIMD_MAX_EPI8(a, b) SIMD_SELECT_SI(_mm_cmpgt_epi8(a, b), a, b)
+#define SIMD_MIN_EPU8(a, b) _mm_min_epu8(a, b)
+#define SIMD_MAX_EPU8(a, b) _mm_max_epu8(a, b)
+#define SIMD_MIN_EPI16(a, b) _mm_min_epi16(a, b)
+#define SIMD_MAX_EPI16(a, b) _mm_max_epi16(a, b)
+#define SIMD_MIN_EPU16(a, b) \
+  _mm_xor_si128(_mm_min_epi16(_mm_xor_si128(a, SIMD_SIGN16), \
+                              _mm_xor_si128(b, SIMD_SIGN16)), SIMD_SIGN16)
+#define SIMD_MAX_EPU16(a, b) \
+  _mm_xor_si128(_mm_max_epi16(_mm_xor_si128(a, SIMD_SIGN16), \
+                              _mm_xor_si128(b, SIMD_SIGN16)), SIMD_SIGN16)
+#define SIMD_MIN_EPI32(a, b) SIMD_SELECT_SI(_mm_cmpgt_epi32(a, b), b, a)
+#define SIMD_MAX_EPI32(a, b) SIMD_SELECT_SI(_mm_cmpgt_epi32(a, b), a, b)
+#define SIMD_MIN_EPU32(a, b) \
+  SIMD_SELECT_SI(_mm_cmpgt_epi32(_mm_xor_si128(a, SIMD_SIGN32), \
+                                 _mm_xor_si128(b, SIMD_SIGN32)), b, a)
+#define SIMD_MAX_EPU32(a, b) \
+  SIMD_SELECT_SI(_mm_cmpgt_epi32(_mm_xor_si128(a, SIMD_SIGN32), \
+                                 _mm_xor_si128(b, SIMD_SIGN32)), a, b)
+#define SIMD_SLLI_EPI16(a, n) _mm_slli_epi16(a, n)
+
+#define SIMD_CVT_LO_PS_PD(v) _mm_cvtps_pd(v)
+#define SIMD_CVT_HI_PS_PD(v) _mm_cvtps_pd(_mm_movehl_ps(v, v))
+#define SIMD_CVT_PD_PS(lo, hi) \
+  _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi))
+#define SIMD_CVT_LO_EPI32_PD(v) _mm_cvtepi32_pd(v)
+#define SIMD_CVT_HI_EPI32_PD(v) \
+  _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2)))
+#define SIMD_CVTT_PD_EPI32(lo, hi) \
+  _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi))
+
+#else
+
+#define SIMD_BYTES 0
+
+#endif
@@ -20,6 +20,7 @@
 #include "tensor.h"
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_errno.h>
+#include "divisor.h"
 
 #define BASE_COMPLEX_DOUBLE
 #include "templates_on.h"
@@ -24,22 +24,85 @@
 TYPE(tensor) *
 FUNCTION (tensor, swap_indices) (const TYPE (tensor) * t_ij,
                                      size_t i, size_t j)
+{
+  return FUNCTION (tensor, swap_indices_ws) (t_ij, i, j, NULL);
+}
+
+
+/*
+ * Same as tensor_swap_indices, with the result in the workspace w.
+ */
+TYPE(tensor) *
+FUNCTION (tensor, swap_indices_ws) (const TYPE (tensor) * t_ij,
+                                    size_t i, size_t j,
+                                    tensor_workspace * w)
+{
+  TYPE(tensor) * t_ji;
+
+  /* Create a new tensor with the appropiate rank */
+  t_ji = FUNCTION(tensor, alloc_ws) (t_ij->rank, t_ij->dimension, w);
+
+  if (t_ji == NULL)
+    return NULL;
+
+  if (FUNCTION (tensor, swap_indices_into) (t_ji, t_ij, i, j) != GSL_SUCCESS)
+    {
+      if (w == NULL)
+        FUNCTION(tensor, free) (t_ji);
+      return NULL;
+    }
+
+  return t_ji;
+}
+
+
+/*
+ * t_.i.j. -> t_.j.i., written in t_ji, which must already have the
+ * rank and dimension of t_ij.
+ */
+int
+FUNCTION (tensor, swap_indices_into) (TYPE (tensor) * t_ji,
+                                      const TYPE (tensor) * t_ij,
+                                      size_t i, size_t j)
 {
   size_t pos;
   size_t n = t_ij->size;
   unsigned int rank = t_ij->rank;
   size_t dimension = t_ij->dimension;
   size_t * pos_in_base;
+  divisor base;
 
   if (i >= rank || j >= rank || i == j)
     {
-      GSL_ERROR_VAL("bad indices in swap_indices request", GSL_EINVAL, 0);
-      return NULL;
+      GSL_ERROR("bad indices in swap_indices request", GSL_EINVAL);
     }
 
-  /* Create a new tensor with the appropiate rank */
-  TYPE(tensor) * t_ji = FUNCTION(tensor, alloc) (rank, dimension);
-    
+  if (t_ji->rank != rank || t_ji->dimension != dimension)
+    {
+      GSL_ERROR("destination tensor has the wrong size", GSL_EBADLEN);
+    }
+
+  if (FUNCTION(tensor, unshare) (t_ji))
+    return GSL_ENOMEM;
+
+  if (t_ji->data == t_ij->data)
+    {
+      GSL_ERROR("swap_indices can not be done in place", GSL_EINVAL);
+    }
+
+  /*
+   * Swapping the indices of a view is free, and copying it into the
+   * new tensor is done in cache-friendly tiles.
+   */
+  if (rank <= TENSOR_MAX_RANK)
+    {
+      VIEW(tensor, view) v =
+        FUNCTION(tensor, const_view_tensor) (t_ij);
+      VIEW(tensor, view) v_ji =
+        FUNCTION(tensor, view_swap_indices) (&v, i, j);
+
+      return FUNCTION(tensor, view_memcpy) (t_ji, &v_ji);
+    }
   
   /* Start counting the indices in the opposite direction,
    * for clarity in the algorithm (but potentially confusing!)
@@ -50,20 +113,89 @@ FUNCTION (tensor, swap_indices) (const TYPE (tensor) * t_ij,
     
   pos_in_base = (size_t *) malloc(rank * sizeof(size_t));
 
+  if (pos_in_base == NULL)
+    {
+      GSL_ERROR("no memory for swap_indices", GSL_ENOMEM);
+    }
+
+  divisor_init(&base, dimension);
+
+  /* The digits are the indices, last first: go through the strides */
   for (pos = 0; pos < n; pos++)
     {
-      size_t newpos;
+      size_t from = 0, to = 0;
+      unsigned int k;
+
+      divisor_digits(rank, &base, pos, pos_in_base);
+
+      for (k = 0; k < rank; k++)
+        from += pos_in_base[k] * t_ij->stride[rank - 1 - k];
 
-      position2index(rank, dimension, pos, pos_in_base);
-      
       vec_swap(pos_in_base, i, j);
-      
-      newpos = index2position(rank, dimension, pos_in_base);
-      
-      t_ji->data[newpos] = t_ij->data[pos];
+
+      for (k = 0; k < rank; k++)
+        to += pos_in_base[k] * t_ji->stride[rank - 1 - k];
+
+      t_ji->data[to] = t_ij->data[from];
     }
 
   free(pos_in_base);
 
-  return t_ji;
-}  
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Permutes the indices of src and writes the result in dest, so that
+ * index k of dest is index perm[k] of src:
+ *   dest[i_0, ..., i_{r-1}] = src[j_0, ..., j_{r-1}]  with j_perm[k] = i_k
+ *
+ * Any permutation is done in a single pass over the data, through a
+ * view with permuted strides that is copied in cache-sized tiles.
+ */
+int
+FUNCTION (tensor, permute) (TYPE (tensor) * dest,
+                            const TYPE (tensor) * src, const size_t * perm)
+{
+  const unsigned int rank = src->rank;
+  VIEW(tensor, view) v, v_perm;
+  int used[TENSOR_MAX_RANK];
+  unsigned int k;
+
+  if (dest->rank != rank || dest->dimension != src->dimension)
+    {
+      GSL_ERROR ("tensor sizes are different", GSL_EBADLEN);
+    }
+
+  if (FUNCTION(tensor, unshare) (dest))
+    return GSL_ENOMEM;
+
+  if (dest->data == src->data)
+    {
+      GSL_ERROR ("permute can not be done in place", GSL_EINVAL);
+    }
+
+  if (rank > TENSOR_MAX_RANK)
+    {
+      GSL_ERROR ("tensor rank too large to permute", GSL_EINVAL);
+    }
+
+  for (k = 0; k < rank; k++)
+    used[k] = 0;
+
+  for (k = 0; k < rank; k++)
+    {
+      if (perm[k] >= rank || used[perm[k]])
+        {
+          GSL_ERROR ("perm is not a permutation of the indices", GSL_EINVAL);
+        }
+      used[perm[k]] = 1;
+    }
+
+  v = FUNCTION(tensor, const_view_tensor) (src);
+  v_perm = v;
+  for (k = 0; k < rank; k++)
+    v_perm.stride[k] = v.stride[perm[k]];
+
+  return FUNCTION(tensor, view_memcpy) (dest, &v_perm);
+}
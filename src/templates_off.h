@@ -10,6 +10,10 @@
 #undef CONCAT3x
 #endif
 
+#ifdef COMPLEX_CONCATx
+#undef COMPLEX_CONCATx
+#endif
+
 #ifdef CONCAT2
 #undef CONCAT2
 #endif
@@ -22,6 +26,10 @@
 #undef TYPE
 #endif
 
+#ifdef VIEW
+#undef VIEW
+#endif
+
 #ifdef USES_LONGDOUBLE
 #undef USES_LONGDOUBLE
 #endif
@@ -117,12 +117,17 @@
 #if defined(BASE_DOUBLE)
 #  define FUNCTION(dir,name) CONCAT2(dir,name)
 #  define TYPE(dir) dir
+#  define VIEW(dir,name) CONCAT2(dir,name)
 #elif defined(BASE_COMPLEX_DOUBLE)
-#  define FUNCTION(dir,name) dir ## _complex_ ## name
+/* Not CONCAT3, as "complex" is a macro itself */
+#  define COMPLEX_CONCATx(dir,name) dir ## _complex_ ## name
+#  define FUNCTION(dir,name) COMPLEX_CONCATx(dir,name)
 #  define TYPE(dir) dir ## _complex
+#  define VIEW(dir,name) dir ## _complex_ ## name
 #else
 #  define FUNCTION(a,c) CONCAT3(a,SHORT,c)
 #  define TYPE(dir) CONCAT2(dir,SHORT)
+#  define VIEW(dir,name) CONCAT3(dir,SHORT,name)
 #endif
 
 #define STRING(x) #x
@@ -37,5 +37,19 @@
 #include "tensor_uchar.h"
 #include "tensor_char.h"
 
+/* Instruction set used by the vectorized kernels */
+const char * tensor_get_isa (void);
+int tensor_set_isa (const char * name);
+
+/* Threads that large operations are split among */
+int tensor_get_num_threads (void);
+int tensor_set_num_threads (int n);
+int tensor_get_deterministic (void);
+int tensor_set_deterministic (int on);
+
+/* Where the data of tensors goes on a NUMA machine (TENSOR_NUMA_...) */
+int tensor_get_default_numa_policy (void);
+int tensor_set_default_numa_policy (int policy, int node);
+
 
 #endif /* __TENSOR_H__ */
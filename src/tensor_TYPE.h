@@ -34,6 +34,9 @@
 #include <gsl/gsl_vector.h>
 
 #include "tensor_utilities.h"
+#include "tensor_workspace.h"
+#include "tensor_block.h"
+#include "tensor_shm.h"
 
 #undef __BEGIN_DECLS
 #undef __END_DECLS
@@ -54,23 +57,51 @@ __BEGIN_DECLS
  * different possible values for each index) and an array to store the
  * dimension^rank values.
  *
- * For the moment, there is no tda, as opossed to matrices, because it
- * would complicate quite a bit the algorithms and probably it is not
- * worth it.
+ * The element with indices (i0, i1, ...) is data[stride[0]*i0 +
+ * stride[1]*i1 + ...], stride[k] being dimension^(rank-1-k). The
+ * strides are computed once, when the tensor is allocated, so that
+ * accessing an element needs no divisions.
+ *
+ * Tensors from tensor_NAME_alloc_aligned() have their data aligned to
+ * TENSOR_ALIGN bytes, and each row (the dimension elements along the
+ * last index) padded so that every row starts on such a boundary too.
+ * Like for matrices, tda is then the distance between the beginnings
+ * of two consecutive rows, and stride[rank-2] == tda. Other tensors
+ * have tda == dimension, with no padding at all. In both cases size
+ * is the number of elements, dimension^rank.
+ *
+ * The data belongs to block, which copies of the tensor may share
+ * until one of them is written (see tensor_block.h). Tensors in a
+ * workspace have no block.
  */
 typedef struct
 {
   unsigned int rank;
   size_t dimension;
   size_t size;
+  size_t tda;
   TYPE * data;
+  size_t * stride;
+  tensor_block * block;
+  tensor_shm_header * shm_write;  /* see tensor_shm_write_begin() */
 } tensor_NAME;
 
 
 /*
- * There is not such a thing as "tensor views", in contrast with the
- * case for gsl_matrix.
+ * A view is a window into the data of an existing tensor, similar to
+ * gsl_matrix_view. It does not own its data, so there is nothing to
+ * free. The element with indices (i0, i1, ...) is at
+ *   data[stride[0]*i0 + stride[1]*i1 + ...]
+ * which lets slices and subtensors share the memory of their parent.
  */
+typedef struct
+{
+  unsigned int rank;
+  size_t dimension;
+  size_t size;
+  TYPE * data;
+  size_t stride[TENSOR_MAX_RANK];
+} tensor_NAME_view;
 
 /* Allocation */
 
@@ -80,17 +111,96 @@ tensor_NAME_alloc(const unsigned int rank, const size_t dimension);
 tensor_NAME *
 tensor_NAME_calloc(const unsigned int rank, const size_t dimension);
 
+tensor_NAME *
+tensor_NAME_alloc_aligned(const unsigned int rank, const size_t dimension);
+
+tensor_NAME *
+tensor_NAME_mmap(const char * path, const unsigned int rank,
+                 const size_t dimension, const int mode);
+
 tensor_NAME *
 tensor_NAME_copy(tensor_NAME * t);
 
 void tensor_NAME_free(tensor_NAME * t);
 
+int tensor_NAME_unshare(tensor_NAME * t);
+
+int tensor_NAME_set_numa_policy(tensor_NAME * t, int policy,
+                                int node);
+
+
+/* Tensors in shared memory, for several processes (see tensor_shm.h) */
+
+tensor_NAME *
+tensor_NAME_shm_create(const char * name, const unsigned int rank,
+                       const size_t dimension);
+
+tensor_NAME *
+tensor_NAME_shm_open(const char * name, const int mode);
+
+void tensor_NAME_shm_write_begin(tensor_NAME * t);
+
+void tensor_NAME_shm_write_end(tensor_NAME * t);
+
+unsigned long tensor_NAME_shm_read_begin(const tensor_NAME * t);
+
+int tensor_NAME_shm_read_retry(const tensor_NAME * t,
+                               unsigned long version);
+
+
+/* Allocation in a workspace (see tensor_workspace.h) */
+
+tensor_NAME *
+tensor_NAME_alloc_ws(const unsigned int rank, const size_t dimension,
+                     tensor_workspace * w);
+
+tensor_NAME *
+tensor_NAME_calloc_ws(const unsigned int rank, const size_t dimension,
+                      tensor_workspace * w);
+
+tensor_NAME *
+tensor_NAME_copy_ws(const tensor_NAME * t, tensor_workspace * w);
+
+tensor_NAME *
+tensor_NAME_swap_indices_ws(const tensor_NAME * t, size_t i, size_t j,
+                            tensor_workspace * w);
+tensor_NAME * tensor_NAME_product_ws(const tensor_NAME * a, const tensor_NAME * b,
+                                     tensor_workspace * w);
+tensor_NAME * tensor_NAME_contract_ws(const tensor_NAME * t_ij, size_t i, size_t j,
+                                      tensor_workspace * w);
+tensor_NAME * tensor_NAME_contract_many_ws(const tensor_NAME * t,
+                                           const size_t * pairs, size_t npairs,
+                                           tensor_workspace * w);
+tensor_NAME * tensor_NAME_tensordot_ws(const tensor_NAME * a, const size_t * ia,
+                                       const tensor_NAME * b, const size_t * ib,
+                                       size_t n, tensor_workspace * w);
+
 
 /* Views */
 
-/*
- * There are no views.
- */
+tensor_NAME_view tensor_NAME_view_tensor(tensor_NAME * t);
+tensor_NAME_view tensor_NAME_const_view_tensor(const tensor_NAME * t);
+tensor_NAME_view tensor_NAME_slice(tensor_NAME * t, size_t i, size_t k);
+tensor_NAME_view tensor_NAME_subtensor(tensor_NAME * t,
+                                       const size_t * offset, size_t n);
+tensor_NAME_view tensor_NAME_view_slice(const tensor_NAME_view * v,
+                                        size_t i, size_t k);
+tensor_NAME_view tensor_NAME_view_subtensor(const tensor_NAME_view * v,
+                                            const size_t * offset,
+                                            size_t n);
+tensor_NAME_view tensor_NAME_view_swap_indices(const tensor_NAME_view * v,
+                                               size_t i, size_t j);
+
+TYPE tensor_NAME_view_get(const tensor_NAME_view * v,
+                          const size_t * indices);
+void tensor_NAME_view_set(tensor_NAME_view * v, const size_t * indices,
+                          const TYPE x);
+TYPE * tensor_NAME_view_ptr(tensor_NAME_view * v, const size_t * indices);
+const TYPE * tensor_NAME_view_const_ptr(const tensor_NAME_view * v,
+                                        const size_t * indices);
+
+int tensor_NAME_view_memcpy(tensor_NAME * dest, const tensor_NAME_view * src);
+tensor_NAME * tensor_NAME_view_copy(const tensor_NAME_view * v);
 
 
 /* Conversions */
@@ -99,6 +209,23 @@ gsl_matrix_NAME * tensor_NAME_2matrix(tensor_NAME * t);
 gsl_vector_NAME * tensor_NAME_2vector(tensor_NAME * t);
 
 
+/* Tensors of existing data, which they do not own */
+
+tensor_NAME *
+tensor_NAME_view_array(TYPE * data, const unsigned int rank,
+                       const size_t dimension);
+
+tensor_NAME *
+tensor_NAME_view_array_with_tda(TYPE * data, const unsigned int rank,
+                                const size_t dimension, const size_t tda);
+
+tensor_NAME *
+tensor_NAME_view_matrix(gsl_matrix_NAME * m);
+
+tensor_NAME *
+tensor_NAME_view_vector(gsl_vector_NAME * v);
+
+
 /* Operations */
 
 TYPE tensor_NAME_get(const tensor_NAME * t, const size_t * indices);
@@ -119,9 +246,14 @@ int tensor_NAME_fprintf(FILE * stream, const tensor_NAME * t,
 
 int tensor_NAME_memcpy(tensor_NAME * dest, const tensor_NAME * src);
 int tensor_NAME_swap(tensor_NAME * t1, tensor_NAME * t2);
+int tensor_NAME_swap_data(tensor_NAME * t1, tensor_NAME * t2);
 
 tensor_NAME *
 tensor_NAME_swap_indices(const tensor_NAME * t, size_t i, size_t j);
+int tensor_NAME_swap_indices_into(tensor_NAME * dest, const tensor_NAME * t,
+                                  size_t i, size_t j);
+int tensor_NAME_permute(tensor_NAME * dest, const tensor_NAME * src,
+                        const size_t * perm);
 
 TYPE tensor_NAME_max(const tensor_NAME * t);
 TYPE tensor_NAME_min(const tensor_NAME * t);
@@ -132,6 +264,9 @@ void tensor_NAME_max_index(const tensor_NAME * t, size_t * indices);
 void tensor_NAME_min_index(const tensor_NAME * t, size_t * indices);
 void tensor_NAME_minmax_index(const tensor_NAME * t,
                               size_t * imin, size_t * imax);
+void tensor_NAME_stats(const tensor_NAME * t,
+                       TYPE * min_out, TYPE * max_out,
+                       size_t * imin, size_t * imax, double * sum);
 
 int tensor_NAME_isnull(const tensor_NAME * t);
 
@@ -144,8 +279,26 @@ int tensor_NAME_add_constant(tensor_NAME * a, const double x);
 int tensor_NAME_add_diagonal(tensor_NAME * a, const double x);
 tensor_NAME * tensor_NAME_product(const tensor_NAME * a,
                                   const tensor_NAME * b);
+int tensor_NAME_product_into(tensor_NAME * c, const tensor_NAME * a,
+                             const tensor_NAME * b);
 tensor_NAME * tensor_NAME_contract(const tensor_NAME * t_ij,
                                    size_t i, size_t j);
+int tensor_NAME_contract_into(tensor_NAME * dest, const tensor_NAME * t_ij,
+                              size_t i, size_t j);
+tensor_NAME * tensor_NAME_contract_many(const tensor_NAME * t,
+                                        const size_t * pairs, size_t npairs);
+int tensor_NAME_contract_many_into(tensor_NAME * dest, const tensor_NAME * t,
+                                   const size_t * pairs, size_t npairs);
+TYPE tensor_NAME_trace_all(const tensor_NAME * t);
+tensor_NAME * tensor_NAME_tensordot(const tensor_NAME * a, const size_t * ia,
+                                    const tensor_NAME * b, const size_t * ib,
+                                    size_t n);
+int tensor_NAME_tensordot_into(tensor_NAME * c,
+                               const tensor_NAME * a, const size_t * ia,
+                               const tensor_NAME * b, const size_t * ib,
+                               size_t n);
+tensor_NAME * tensor_NAME_einsum(const char * spec, size_t n,
+                                 tensor_NAME * const tensors[]);
 
 
 /* inline functions if you are using GCC */
@@ -155,21 +308,18 @@ extern inline
 size_t
 tensor_NAME_position(const size_t * indices, const tensor_NAME * t)
 {
-  size_t shift, position;
+  size_t position;
   unsigned int i;
 
-  shift = t->size/t->dimension;  /* == quick_pow(t->dimension, t->rank-1) */
-
   position = 0;
   for (i = 0; i < t->rank; i++)
     {
 #if GSL_RANGE_CHECK
       if (indices[i] >= t->dimension)
-        return t->size;
+        return TENSOR_BAD_POSITION;
 #endif
 
-      position += shift * indices[i];
-      shift /= t->dimension;
+      position += t->stride[i] * indices[i];
     }
 
   return position;
@@ -184,7 +334,7 @@ tensor_NAME_get(const tensor_NAME * t, const size_t * indices)
 
   position = tensor_NAME_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_VAL("index out of range", GSL_EINVAL, 0);
 #endif
 
@@ -200,10 +350,13 @@ tensor_NAME_set(tensor_NAME * t, const size_t * indices, const TYPE x)
   
   position = tensor_NAME_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_VOID("index out of range", GSL_EINVAL);
 #endif
 
+  if (TENSOR_BLOCK_SHARED(t->block) && tensor_NAME_unshare(t))
+    return;
+
   t->data[position] = x;
 }
 
@@ -216,10 +369,16 @@ tensor_NAME_ptr(tensor_NAME * t, const size_t * indices)
 
   position = tensor_NAME_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 #endif
 
+  /* The pointer can be kept to write into t later */
+  if (TENSOR_BLOCK_SHARED(t->block) && tensor_NAME_unshare(t))
+    return NULL;
+
+  tensor_block_expose(t->block);
+
   return (TYPE *) (t->data + position);
 }
 
@@ -232,7 +391,7 @@ tensor_NAME_const_ptr(const tensor_NAME * t, const size_t * indices)
 
   position = tensor_NAME_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 #endif
 
@@ -0,0 +1,152 @@
+/* tensor/tensor_block.h
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef __TENSOR_BLOCK_H__
+#define __TENSOR_BLOCK_H__
+
+#include <stdlib.h>
+
+#undef __BEGIN_DECLS
+#undef __END_DECLS
+#ifdef __cplusplus
+# define __BEGIN_DECLS extern "C" {
+# define __END_DECLS }
+#else
+# define __BEGIN_DECLS /* empty */
+# define __END_DECLS /* empty */
+#endif
+
+__BEGIN_DECLS
+
+
+/*
+ * A block is the memory where the elements of a tensor live, like
+ * gsl_block for matrices. tensor_copy() gives a tensor that shares the
+ * block of the original, and counts one more user of it. The first
+ * function that writes into a tensor whose block has other users gets
+ * it a block of its own first (see tensor_unshare()), so sharing is
+ * never visible. The block is freed with its last tensor.
+ *
+ * The struct and the data are allocated together, the data aligned to
+ * "align" bytes, except for blocks mapped from a file, whose data is
+ * unmapped when they are freed. The tensors of a read-only mapping
+ * also get a block of their own before they are written.
+ *
+ * Views, matrices, vectors and pointers that can write into a tensor
+ * (tensor_view_tensor, tensor_2matrix, ...) write into its block
+ * directly, so once one of them has been given out, the block is
+ * marked as exposed, and the copies of the tensor get data of their
+ * own right away instead of sharing it. The same is done for the
+ * mappings opened for writing, whose tensors must keep writing into
+ * the file or the shared memory.
+ *
+ * On a NUMA machine, the pages of the data are placed on the nodes
+ * with the policy of the block (TENSOR_NUMA_...), when tensor_set_zero,
+ * tensor_set_all or tensor_calloc initialize it.
+ */
+typedef struct
+{
+  size_t refcount;  /* number of tensors that use the block */
+  size_t size;      /* bytes of data */
+  size_t align;
+  void * data;
+  int flags;        /* TENSOR_BLOCK_MAPPED, TENSOR_BLOCK_READ_ONLY, ... */
+  size_t offset;    /* bytes of the mapping before the data */
+  int numa_policy;  /* TENSOR_NUMA_..., and the node for ..._BIND */
+  int numa_node;
+  int numa_applied; /* the policy the data was last placed with */
+} tensor_block;
+
+#define TENSOR_BLOCK_MAPPED    1
+#define TENSOR_BLOCK_READ_ONLY 2
+#define TENSOR_BLOCK_SHM       4  /* mapped, after a tensor_shm_header */
+#define TENSOR_BLOCK_EXPOSED   8  /* can be written without unsharing */
+
+/*
+ * How tensor_mmap() maps a file: to read it (writes into the tensor
+ * stay in memory), or to read and write it, and optionally how the
+ * data will be accessed, as a hint for the system.
+ */
+#define TENSOR_MMAP_READ       0
+#define TENSOR_MMAP_WRITE      1
+#define TENSOR_MMAP_SEQUENTIAL 2
+#define TENSOR_MMAP_RANDOM     4
+
+/*
+ * Where the pages of the data of a tensor go on a NUMA machine:
+ *   - DEFAULT: with the policy of tensor_set_default_numa_policy(),
+ *   - FIRST_TOUCH: on the node of the thread that first writes each
+ *     page, which, for data initialized in parallel, is near the
+ *     thread that later works with it (the default),
+ *   - INTERLEAVE: in turns on all the nodes, for data that all the
+ *     threads read,
+ *   - BIND: all on one node.
+ */
+#define TENSOR_NUMA_DEFAULT     (-1)
+#define TENSOR_NUMA_FIRST_TOUCH 0
+#define TENSOR_NUMA_INTERLEAVE  1
+#define TENSOR_NUMA_BIND        2
+
+
+tensor_block * tensor_block_alloc(size_t size, size_t align);
+
+tensor_block * tensor_block_copy(const tensor_block * b);
+
+tensor_block * tensor_block_mmap(const char * path, size_t size, int mode);
+
+void tensor_block_share(tensor_block * b);
+
+void tensor_block_expose(tensor_block * b);
+
+void tensor_block_release(tensor_block * b);
+
+int tensor_block_set_numa_policy(tensor_block * b, int policy, int node);
+
+void tensor_block_numa_apply(tensor_block * b);
+
+/*
+ * True if b is a mapping written into (a file or shared memory): the
+ * tensors of such a block must always write into it, never into a
+ * copy of their own.
+ */
+#define TENSOR_BLOCK_WRITABLE_MAPPING(b) \
+  (((b)->flags & (TENSOR_BLOCK_MAPPED | TENSOR_BLOCK_READ_ONLY)) \
+   == TENSOR_BLOCK_MAPPED)
+
+/*
+ * True if the copies of a tensor with block b can share it: nothing
+ * writes into b without unsharing it first.
+ */
+#define TENSOR_BLOCK_SHAREABLE(b) \
+  ((b) != NULL && !((b)->flags & TENSOR_BLOCK_EXPOSED) && \
+   !TENSOR_BLOCK_WRITABLE_MAPPING(b))
+
+/*
+ * True if a tensor with block b must get a block of its own before it
+ * writes: b is also used by other tensors, or it can not be written.
+ */
+#define TENSOR_BLOCK_SHARED(b) \
+  ((b) != NULL && !TENSOR_BLOCK_WRITABLE_MAPPING(b) && \
+   ((b)->refcount > 1 || ((b)->flags & TENSOR_BLOCK_READ_ONLY)))
+
+
+__END_DECLS
+
+#endif /* __TENSOR_BLOCK_H__ */
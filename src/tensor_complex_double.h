@@ -35,6 +35,9 @@
 #include <gsl/gsl_vector.h>
 
 #include "tensor_utilities.h"
+#include "tensor_workspace.h"
+#include "tensor_block.h"
+#include "tensor_shm.h"
 
 #undef __BEGIN_DECLS
 #undef __END_DECLS
@@ -56,23 +59,51 @@ __BEGIN_DECLS
  * different possible values for each index) and an array to store the
  * dimension^rank values.
  *
- * For the moment, there is no tda, as opossed to matrices, because it
- * would complicate quite a bit the algorithms and probably it is not
- * worth it.
+ * The element with indices (i0, i1, ...) is data[stride[0]*i0 +
+ * stride[1]*i1 + ...], stride[k] being dimension^(rank-1-k). The
+ * strides are computed once, when the tensor is allocated, so that
+ * accessing an element needs no divisions.
+ *
+ * Tensors from tensor_complex_alloc_aligned() have their data aligned to
+ * TENSOR_ALIGN bytes, and each row (the dimension elements along the
+ * last index) padded so that every row starts on such a boundary too.
+ * Like for matrices, tda is then the distance between the beginnings
+ * of two consecutive rows, and stride[rank-2] == tda. Other tensors
+ * have tda == dimension, with no padding at all. In both cases size
+ * is the number of elements, dimension^rank.
+ *
+ * The data belongs to block, which copies of the tensor may share
+ * until one of them is written (see tensor_block.h). Tensors in a
+ * workspace have no block.
  */
 typedef struct
 {
   unsigned int rank;
   size_t dimension;
   size_t size;
+  size_t tda;
   complex double * data;
+  size_t * stride;
+  tensor_block * block;
+  tensor_shm_header * shm_write;  /* see tensor_shm_write_begin() */
 } tensor_complex;
 
 
 /*
- * There is not such a thing as "tensor views", in contrast with the
- * case for gsl_matrix.
+ * A view is a window into the data of an existing tensor, similar to
+ * gsl_matrix_view. It does not own its data, so there is nothing to
+ * free. The element with indices (i0, i1, ...) is at
+ *   data[stride[0]*i0 + stride[1]*i1 + ...]
+ * which lets slices and subtensors share the memory of their parent.
  */
+typedef struct
+{
+  unsigned int rank;
+  size_t dimension;
+  size_t size;
+  complex double * data;
+  size_t stride[TENSOR_MAX_RANK];
+} tensor_complex_view;
 
 /* Allocation */
 
@@ -82,17 +113,96 @@ tensor_complex_alloc(const unsigned int rank, const size_t dimension);
 tensor_complex *
 tensor_complex_calloc(const unsigned int rank, const size_t dimension);
 
+tensor_complex *
+tensor_complex_alloc_aligned(const unsigned int rank, const size_t dimension);
+
+tensor_complex *
+tensor_complex_mmap(const char * path, const unsigned int rank,
+                    const size_t dimension, const int mode);
+
 tensor_complex *
 tensor_complex_copy(tensor_complex * t);
 
 void tensor_complex_free(tensor_complex * t);
 
+int tensor_complex_unshare(tensor_complex * t);
+
+int tensor_complex_set_numa_policy(tensor_complex * t, int policy,
+                                   int node);
+
+
+/* Tensors in shared memory, for several processes (see tensor_shm.h) */
+
+tensor_complex *
+tensor_complex_shm_create(const char * name, const unsigned int rank,
+                          const size_t dimension);
+
+tensor_complex *
+tensor_complex_shm_open(const char * name, const int mode);
+
+void tensor_complex_shm_write_begin(tensor_complex * t);
+
+void tensor_complex_shm_write_end(tensor_complex * t);
+
+unsigned long tensor_complex_shm_read_begin(const tensor_complex * t);
+
+int tensor_complex_shm_read_retry(const tensor_complex * t,
+                                  unsigned long version);
+
+
+/* Allocation in a workspace (see tensor_workspace.h) */
+
+tensor_complex *
+tensor_complex_alloc_ws(const unsigned int rank, const size_t dimension,
+                        tensor_workspace * w);
+
+tensor_complex *
+tensor_complex_calloc_ws(const unsigned int rank, const size_t dimension,
+                         tensor_workspace * w);
+
+tensor_complex *
+tensor_complex_copy_ws(const tensor_complex * t, tensor_workspace * w);
+
+tensor_complex *
+tensor_complex_swap_indices_ws(const tensor_complex * t, size_t i, size_t j,
+                               tensor_workspace * w);
+tensor_complex * tensor_complex_product_ws(const tensor_complex * a, const tensor_complex * b,
+                                           tensor_workspace * w);
+tensor_complex * tensor_complex_contract_ws(const tensor_complex * t_ij, size_t i, size_t j,
+                                            tensor_workspace * w);
+tensor_complex * tensor_complex_contract_many_ws(const tensor_complex * t,
+                                                 const size_t * pairs, size_t npairs,
+                                                 tensor_workspace * w);
+tensor_complex * tensor_complex_tensordot_ws(const tensor_complex * a, const size_t * ia,
+                                             const tensor_complex * b, const size_t * ib,
+                                             size_t n, tensor_workspace * w);
+
 
 /* Views */
 
-/*
- * There are no views.
- */
+tensor_complex_view tensor_complex_view_tensor(tensor_complex * t);
+tensor_complex_view tensor_complex_const_view_tensor(const tensor_complex * t);
+tensor_complex_view tensor_complex_slice(tensor_complex * t, size_t i, size_t k);
+tensor_complex_view tensor_complex_subtensor(tensor_complex * t,
+                                       const size_t * offset, size_t n);
+tensor_complex_view tensor_complex_view_slice(const tensor_complex_view * v,
+                                        size_t i, size_t k);
+tensor_complex_view tensor_complex_view_subtensor(const tensor_complex_view * v,
+                                            const size_t * offset,
+                                            size_t n);
+tensor_complex_view tensor_complex_view_swap_indices(const tensor_complex_view * v,
+                                                     size_t i, size_t j);
+
+complex double tensor_complex_view_get(const tensor_complex_view * v,
+                          const size_t * indices);
+void tensor_complex_view_set(tensor_complex_view * v, const size_t * indices,
+                          const complex double x);
+complex double * tensor_complex_view_ptr(tensor_complex_view * v, const size_t * indices);
+const complex double * tensor_complex_view_const_ptr(const tensor_complex_view * v,
+                                        const size_t * indices);
+
+int tensor_complex_view_memcpy(tensor_complex * dest, const tensor_complex_view * src);
+tensor_complex * tensor_complex_view_copy(const tensor_complex_view * v);
 
 
 /* Conversions */
@@ -101,6 +211,23 @@ gsl_matrix_complex * tensor_complex_2matrix(tensor_complex * t);
 gsl_vector_complex * tensor_complex_2vector(tensor_complex * t);
 
 
+/* Tensors of existing data, which they do not own */
+
+tensor_complex *
+tensor_complex_view_array(complex double * data, const unsigned int rank,
+                          const size_t dimension);
+
+tensor_complex *
+tensor_complex_view_array_with_tda(complex double * data, const unsigned int rank,
+                                   const size_t dimension, const size_t tda);
+
+tensor_complex *
+tensor_complex_view_matrix(gsl_matrix_complex * m);
+
+tensor_complex *
+tensor_complex_view_vector(gsl_vector_complex * v);
+
+
 /* Operations */
 
 complex double tensor_complex_get(const tensor_complex * t, const size_t * indices);
@@ -120,9 +247,14 @@ int tensor_complex_fprintf(FILE * stream, const tensor_complex * t, const char *
 
 int tensor_complex_memcpy(tensor_complex * dest, const tensor_complex * src);
 int tensor_complex_swap(tensor_complex * t1, tensor_complex * t2);
+int tensor_complex_swap_data(tensor_complex * t1, tensor_complex * t2);
 
 tensor_complex *
 tensor_complex_swap_indices(const tensor_complex * t_ij, size_t i, size_t j);
+int tensor_complex_swap_indices_into(tensor_complex * dest, const tensor_complex * t,
+                                     size_t i, size_t j);
+int tensor_complex_permute(tensor_complex * dest, const tensor_complex * src,
+                           const size_t * perm);
 
 int tensor_complex_isnull(const tensor_complex * t);
 
@@ -134,7 +266,25 @@ int tensor_complex_scale(tensor_complex * a, const double x);
 int tensor_complex_add_constant(tensor_complex * a, const double x);
 int tensor_complex_add_diagonal(tensor_complex * a, const double x);
 tensor_complex * tensor_complex_product(const tensor_complex * a, const tensor_complex * b);
+int tensor_complex_product_into(tensor_complex * c, const tensor_complex * a,
+                                const tensor_complex * b);
 tensor_complex * tensor_complex_contract(const tensor_complex * t_ij, size_t i, size_t j);
+int tensor_complex_contract_into(tensor_complex * dest, const tensor_complex * t_ij,
+                                 size_t i, size_t j);
+tensor_complex * tensor_complex_contract_many(const tensor_complex * t,
+                                              const size_t * pairs, size_t npairs);
+int tensor_complex_contract_many_into(tensor_complex * dest, const tensor_complex * t,
+                                      const size_t * pairs, size_t npairs);
+complex double tensor_complex_trace_all(const tensor_complex * t);
+tensor_complex * tensor_complex_tensordot(const tensor_complex * a, const size_t * ia,
+                                          const tensor_complex * b, const size_t * ib,
+                                          size_t n);
+int tensor_complex_tensordot_into(tensor_complex * c,
+                                  const tensor_complex * a, const size_t * ia,
+                                  const tensor_complex * b, const size_t * ib,
+                                  size_t n);
+tensor_complex * tensor_complex_einsum(const char * spec, size_t n,
+                                       tensor_complex * const tensors[]);
 
 
 /* inline functions if you are using GCC */
@@ -144,21 +294,18 @@ extern inline
 size_t
 tensor_complex_position(const size_t * indices, const tensor_complex * t)
 {
-  size_t shift, position;
+  size_t position;
   unsigned int i;
 
-  shift = t->size/t->dimension;  /* == quick_pow(t->dimension, t->rank-1) */
-
   position = 0;
   for (i = 0; i < t->rank; i++)
     {
 #if GSL_RANGE_CHECK
       if (indices[i] >= t->dimension)
-        return t->size;
+        return TENSOR_BAD_POSITION;
 #endif
 
-      position += shift * indices[i];
-      shift /= t->dimension;
+      position += t->stride[i] * indices[i];
     }
 
   return position;
@@ -173,7 +320,7 @@ tensor_complex_get(const tensor_complex * t, const size_t * indices)
 
   position = tensor_complex_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_VAL("index out of range", GSL_EINVAL, 0);
 #endif
 
@@ -188,10 +335,13 @@ tensor_complex_set(tensor_complex * t, const size_t * indices, const complex dou
 
   position = tensor_complex_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_VOID("index out of range", GSL_EINVAL);
 #endif
 
+  if (TENSOR_BLOCK_SHARED(t->block) && tensor_complex_unshare(t))
+    return;
+
   t->data[position] = x;
 }
 
@@ -204,10 +354,16 @@ tensor_complex_ptr(tensor_complex * t, const size_t * indices)
 
   position = tensor_complex_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 #endif
 
+  /* The pointer can be kept to write into t later */
+  if (TENSOR_BLOCK_SHARED(t->block) && tensor_complex_unshare(t))
+    return NULL;
+
+  tensor_block_expose(t->block);
+
   return (complex double *) (t->data + position);
 } 
 
@@ -219,7 +375,7 @@ tensor_complex_const_ptr(const tensor_complex * t, const size_t * indices)
 
   position = tensor_complex_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 #endif
 
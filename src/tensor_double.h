@@ -35,6 +35,9 @@
 #include <gsl/gsl_vector.h>
 
 #include "tensor_utilities.h"
+#include "tensor_workspace.h"
+#include "tensor_block.h"
+#include "tensor_shm.h"
 
 #undef __BEGIN_DECLS
 #undef __END_DECLS
@@ -56,23 +59,51 @@ __BEGIN_DECLS
  * different possible values for each index) and an array to store the
  * dimension^rank values.
  *
- * For the moment, there is no tda, as opossed to matrices, because it
- * would complicate quite a bit the algorithms and probably it is not
- * worth it.
+ * The element with indices (i0, i1, ...) is data[stride[0]*i0 +
+ * stride[1]*i1 + ...], stride[k] being dimension^(rank-1-k). The
+ * strides are computed once, when the tensor is allocated, so that
+ * accessing an element needs no divisions.
+ *
+ * Tensors from tensor_alloc_aligned() have their data aligned to
+ * TENSOR_ALIGN bytes, and each row (the dimension elements along the
+ * last index) padded so that every row starts on such a boundary too.
+ * Like for matrices, tda is then the distance between the beginnings
+ * of two consecutive rows, and stride[rank-2] == tda. Other tensors
+ * have tda == dimension, with no padding at all. In both cases size
+ * is the number of elements, dimension^rank.
+ *
+ * The data belongs to block, which copies of the tensor may share
+ * until one of them is written (see tensor_block.h). Tensors in a
+ * workspace have no block.
  */
 typedef struct
 {
   unsigned int rank;
   size_t dimension;
   size_t size;
+  size_t tda;
   double * data;
+  size_t * stride;
+  tensor_block * block;
+  tensor_shm_header * shm_write;  /* see tensor_shm_write_begin() */
 } tensor;
 
 
 /*
- * There is not such a thing as "tensor views", in contrast with the
- * case for gsl_matrix.
+ * A view is a window into the data of an existing tensor, similar to
+ * gsl_matrix_view. It does not own its data, so there is nothing to
+ * free. The element with indices (i0, i1, ...) is at
+ *   data[stride[0]*i0 + stride[1]*i1 + ...]
+ * which lets slices and subtensors share the memory of their parent.
  */
+typedef struct
+{
+  unsigned int rank;
+  size_t dimension;
+  size_t size;
+  double * data;
+  size_t stride[TENSOR_MAX_RANK];
+} tensor_view;
 
 /* Allocation */
 
@@ -82,17 +113,96 @@ tensor_alloc(const unsigned int rank, const size_t dimension);
 tensor *
 tensor_calloc(const unsigned int rank, const size_t dimension);
 
+tensor *
+tensor_alloc_aligned(const unsigned int rank, const size_t dimension);
+
+tensor *
+tensor_mmap(const char * path, const unsigned int rank,
+            const size_t dimension, const int mode);
+
 tensor *
 tensor_copy(tensor * t);
 
 void tensor_free(tensor * t);
 
+int tensor_unshare(tensor * t);
+
+int tensor_set_numa_policy(tensor * t, int policy,
+                           int node);
+
+
+/* Tensors in shared memory, for several processes (see tensor_shm.h) */
+
+tensor *
+tensor_shm_create(const char * name, const unsigned int rank,
+                  const size_t dimension);
+
+tensor *
+tensor_shm_open(const char * name, const int mode);
+
+void tensor_shm_write_begin(tensor * t);
+
+void tensor_shm_write_end(tensor * t);
+
+unsigned long tensor_shm_read_begin(const tensor * t);
+
+int tensor_shm_read_retry(const tensor * t,
+                          unsigned long version);
+
+
+/* Allocation in a workspace (see tensor_workspace.h) */
+
+tensor *
+tensor_alloc_ws(const unsigned int rank, const size_t dimension,
+                tensor_workspace * w);
+
+tensor *
+tensor_calloc_ws(const unsigned int rank, const size_t dimension,
+                 tensor_workspace * w);
+
+tensor *
+tensor_copy_ws(const tensor * t, tensor_workspace * w);
+
+tensor *
+tensor_swap_indices_ws(const tensor * t, size_t i, size_t j,
+                       tensor_workspace * w);
+tensor * tensor_product_ws(const tensor * a, const tensor * b,
+                           tensor_workspace * w);
+tensor * tensor_contract_ws(const tensor * t_ij, size_t i, size_t j,
+                            tensor_workspace * w);
+tensor * tensor_contract_many_ws(const tensor * t,
+                                 const size_t * pairs, size_t npairs,
+                                 tensor_workspace * w);
+tensor * tensor_tensordot_ws(const tensor * a, const size_t * ia,
+                             const tensor * b, const size_t * ib,
+                             size_t n, tensor_workspace * w);
+
 
 /* Views */
 
-/*
- * There are no views.
- */
+tensor_view tensor_view_tensor(tensor * t);
+tensor_view tensor_const_view_tensor(const tensor * t);
+tensor_view tensor_slice(tensor * t, size_t i, size_t k);
+tensor_view tensor_subtensor(tensor * t,
+                                       const size_t * offset, size_t n);
+tensor_view tensor_view_slice(const tensor_view * v,
+                                        size_t i, size_t k);
+tensor_view tensor_view_subtensor(const tensor_view * v,
+                                            const size_t * offset,
+                                            size_t n);
+tensor_view tensor_view_swap_indices(const tensor_view * v,
+                                     size_t i, size_t j);
+
+double tensor_view_get(const tensor_view * v,
+                          const size_t * indices);
+void tensor_view_set(tensor_view * v, const size_t * indices,
+                          const double x);
+double * tensor_view_ptr(tensor_view * v, const size_t * indices);
+const double * tensor_view_const_ptr(const tensor_view * v,
+                                        const size_t * indices);
+
+int tensor_view_memcpy(tensor * dest, const tensor_view * src);
+tensor * tensor_view_copy(const tensor_view * v);
 
 
 /* Conversions */
@@ -101,6 +211,23 @@ gsl_matrix * tensor_2matrix(tensor * t);
 gsl_vector * tensor_2vector(tensor * t);
 
 
+/* Tensors of existing data, which they do not own */
+
+tensor *
+tensor_view_array(double * data, const unsigned int rank,
+                  const size_t dimension);
+
+tensor *
+tensor_view_array_with_tda(double * data, const unsigned int rank,
+                           const size_t dimension, const size_t tda);
+
+tensor *
+tensor_view_matrix(gsl_matrix * m);
+
+tensor *
+tensor_view_vector(gsl_vector * v);
+
+
 /* Operations */
 
 double tensor_get(const tensor * t, const size_t * indices);
@@ -120,9 +247,14 @@ int tensor_fprintf(FILE * stream, const tensor * t, const char * format);
 
 int tensor_memcpy(tensor * dest, const tensor * src);
 int tensor_swap(tensor * t1, tensor * t2);
+int tensor_swap_data(tensor * t1, tensor * t2);
 
 tensor *
 tensor_swap_indices(const tensor * t_ij, size_t i, size_t j);
+int tensor_swap_indices_into(tensor * dest, const tensor * t,
+                             size_t i, size_t j);
+int tensor_permute(tensor * dest, const tensor * src,
+                   const size_t * perm);
 
 double tensor_max(const tensor * t);
 double tensor_min(const tensor * t);
@@ -131,6 +263,8 @@ void tensor_minmax(const tensor * t, double * min_out, double * max_out);
 void tensor_max_index(const tensor * t, size_t * indices);
 void tensor_min_index(const tensor * t, size_t * indices);
 void tensor_minmax_index(const tensor * t, size_t * imin, size_t * imax);
+void tensor_stats(const tensor * t, double * min_out, double * max_out,
+                  size_t * imin, size_t * imax, double * sum);
 
 int tensor_isnull(const tensor * t);
 
@@ -142,7 +276,25 @@ int tensor_scale(tensor * a, const double x);
 int tensor_add_constant(tensor * a, const double x);
 int tensor_add_diagonal(tensor * a, const double x);
 tensor * tensor_product(const tensor * a, const tensor * b);
+int tensor_product_into(tensor * c, const tensor * a,
+                        const tensor * b);
 tensor * tensor_contract(const tensor * t_ij, size_t i, size_t j);
+int tensor_contract_into(tensor * dest, const tensor * t_ij,
+                         size_t i, size_t j);
+tensor * tensor_contract_many(const tensor * t,
+                              const size_t * pairs, size_t npairs);
+int tensor_contract_many_into(tensor * dest, const tensor * t,
+                              const size_t * pairs, size_t npairs);
+double tensor_trace_all(const tensor * t);
+tensor * tensor_tensordot(const tensor * a, const size_t * ia,
+                          const tensor * b, const size_t * ib,
+                          size_t n);
+int tensor_tensordot_into(tensor * c,
+                          const tensor * a, const size_t * ia,
+                          const tensor * b, const size_t * ib,
+                          size_t n);
+tensor * tensor_einsum(const char * spec, size_t n,
+                       tensor * const tensors[]);
 
 
 /* inline functions if you are using GCC */
@@ -152,21 +304,18 @@ extern inline
 size_t
 tensor_position(const size_t * indices, const tensor * t)
 {
-  size_t shift, position;
+  size_t position;
   unsigned int i;
 
-  shift = t->size/t->dimension;  /* == quick_pow(t->dimension, t->rank-1) */
-
   position = 0;
   for (i = 0; i < t->rank; i++)
     {
 #if GSL_RANGE_CHECK
       if (indices[i] >= t->dimension)
-        return t->size;
+        return TENSOR_BAD_POSITION;
 #endif
 
-      position += shift * indices[i];
-      shift /= t->dimension;
+      position += t->stride[i] * indices[i];
     }
 
   return position;
@@ -181,7 +330,7 @@ tensor_get(const tensor * t, const size_t * indices)
 
   position = tensor_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_VAL("index out of range", GSL_EINVAL, 0);
 #endif
 
@@ -196,10 +345,13 @@ tensor_set(tensor * t, const size_t * indices, const double x)
 
   position = tensor_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_VOID("index out of range", GSL_EINVAL);
 #endif
 
+  if (TENSOR_BLOCK_SHARED(t->block) && tensor_unshare(t))
+    return;
+
   t->data[position] = x;
 }
 
@@ -212,10 +364,16 @@ tensor_ptr(tensor * t, const size_t * indices)
 
   position = tensor_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 #endif
 
+  /* The pointer can be kept to write into t later */
+  if (TENSOR_BLOCK_SHARED(t->block) && tensor_unshare(t))
+    return NULL;
+
+  tensor_block_expose(t->block);
+
   return (double *) (t->data + position);
 } 
 
@@ -227,7 +385,7 @@ tensor_const_ptr(const tensor * t, const size_t * indices)
 
   position = tensor_position(indices, t);
 #if GSL_RANGE_CHECK
-  if (position >= t->size)
+  if (position == TENSOR_BAD_POSITION)
     GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 #endif
 
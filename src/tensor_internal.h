@@ -0,0 +1,87 @@
+/* tensor/tensor_internal.h
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Declarations shared by the files of the library but not part of its
+ * interface: only the .c files include this header, never the
+ * installed ones.
+ */
+
+#ifndef __TENSOR_INTERNAL_H__
+#define __TENSOR_INTERNAL_H__
+
+#include <stddef.h>
+#include "tensor_utilities.h"
+
+/*
+ * Operations over many elements are split among threads (thread.c),
+ * in parts of at least this many elements: fewer are done faster by a
+ * single thread. Memory-bound operations need larger parts than those
+ * that do more work per element.
+ */
+#define PARALLEL_MIN_SET      65536  /* set_zero, set_all */
+#define PARALLEL_MIN_TEST     65536  /* isnull, and reductions */
+#define PARALLEL_MIN_ARITH    32768  /* add, sub, mul, scale, add_constant */
+#define PARALLEL_MIN_DIV       8192  /* div */
+#define PARALLEL_MIN_CONTRACT  8192  /* contract, which reads strided data */
+#define PARALLEL_MIN_COPY     16384  /* view_memcpy, swap_indices, permute */
+
+/*
+ * Items for tensor_parallel_for() for the elements of a tensor with
+ * the given number of rows of n elements: the rows, or the elements if
+ * there is only one; and the items in a part of at least min elements.
+ */
+#define PARALLEL_ITEMS(rows, n) (((rows) > 1) ? (rows) : (n))
+#define PARALLEL_GRAIN(rows, n, min) \
+  (((rows) > 1) ? ((min) + (n) - 1) / (n) : (min))
+
+typedef void (* tensor_parallel_fn) (void * arg, size_t begin, size_t end);
+
+void tensor_parallel_for(size_t n, size_t grain, tensor_parallel_fn fn,
+                         void * arg);
+
+/* Parsing of the einsum specifications and choice of the order */
+int einsum_label_bit(char c);
+
+unsigned long long einsum_mask(const char * labels);
+
+unsigned int einsum_count(unsigned long long mask);
+
+int einsum_parse(const char * spec, size_t n, const unsigned int * ranks,
+                 char ** labels, char * output);
+
+int einsum_path(size_t n, char * const * labels, const char * output,
+                size_t dimension, size_t * path);
+
+/* The instruction set in use, one of TENSOR_ISA_* (see cpu.c) */
+int tensor_isa_level(void);
+
+/*
+ * The kernels can be built for several instruction sets and chosen
+ * when the library runs if the compiler lets each function target its
+ * own instruction set (gcc 4.9 or later, on x86).
+ */
+#if defined(__GNUC__) && !defined(__clang__) && \
+  (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+  (defined(__x86_64__) || defined(__i386__))
+#define TENSOR_DISPATCH 1
+#endif
+
+#endif /* __TENSOR_INTERNAL_H__ */
@@ -0,0 +1,86 @@
+/* tensor/tensor_shm.h
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef __TENSOR_SHM_H__
+#define __TENSOR_SHM_H__
+
+#include <stdlib.h>
+#include "tensor_block.h"
+
+#undef __BEGIN_DECLS
+#undef __END_DECLS
+#ifdef __cplusplus
+# define __BEGIN_DECLS extern "C" {
+# define __END_DECLS }
+#else
+# define __BEGIN_DECLS /* empty */
+# define __END_DECLS /* empty */
+#endif
+
+__BEGIN_DECLS
+
+
+/*
+ * A tensor in shared memory (tensor_shm_create() and tensor_shm_open())
+ * is a POSIX shared memory object that starts with this header, so
+ * that the processes that open it know what it holds, followed by the
+ * data at "offset" bytes from the start.
+ *
+ * "version" is a sequence lock: it is odd while a process writes the
+ * data. A reader takes it before reading (tensor_shm_read_begin()) and
+ * reads again if it changed in the meantime (tensor_shm_read_retry()).
+ */
+typedef struct
+{
+  char magic[8];               /* TENSOR_SHM_MAGIC */
+  char type[24];               /* "tensor_float", ... */
+  unsigned int rank;
+  size_t dimension;
+  size_t offset;
+  volatile unsigned long version;
+} tensor_shm_header;
+
+#define TENSOR_SHM_MAGIC "tensor1"
+
+
+tensor_block * tensor_block_shm_create(const char * name, const char * type,
+                                       unsigned int rank, size_t dimension,
+                                       size_t size);
+
+tensor_block * tensor_block_shm_open(const char * name, const char * type,
+                                     size_t atomic_size, int mode);
+
+tensor_shm_header * tensor_block_shm_header(const tensor_block * b);
+
+int tensor_shm_unlink(const char * name);
+
+void tensor_shm_header_write_begin(tensor_shm_header * h);
+
+void tensor_shm_header_write_end(tensor_shm_header * h);
+
+unsigned long tensor_shm_header_read_begin(const tensor_shm_header * h);
+
+int tensor_shm_header_read_retry(const tensor_shm_header * h,
+                                 unsigned long version);
+
+
+__END_DECLS
+
+#endif /* __TENSOR_SHM_H__ */
@@ -25,20 +25,17 @@ size_t
 FUNCTION(tensor, position) (const size_t * indices,
                             const TYPE (tensor) * t)
 {
-  size_t shift, position;
+  size_t position;
   unsigned int i;
 
-  shift = t->size/t->dimension;  /* == quick_pow(t->dimension, t->rank - 1) */
-
   position = 0;
   for (i = 0; i < t->rank; i++)
     {
       if (gsl_check_range)
         if (indices[i] >= t->dimension)
-          return t->size;
+          return TENSOR_BAD_POSITION;
 
-      position += shift * indices[i];
-      shift /= t->dimension;
+      position += t->stride[i] * indices[i];
     }
 
   return position;
@@ -52,7 +49,7 @@ FUNCTION(tensor, get) (const TYPE (tensor) * t, const size_t * indices)
 
   position = FUNCTION(tensor, position) (indices, t);
   if (gsl_check_range)
-    if (position >= t->size)
+    if (position == TENSOR_BAD_POSITION)
       GSL_ERROR_VAL("index out of range", GSL_EINVAL, 0);
 
   return *(BASE *) (t->data + position);
@@ -67,9 +64,12 @@ FUNCTION(tensor, set) (TYPE (tensor) * t,
 
   position = FUNCTION(tensor, position) (indices, t);
   if (gsl_check_range)
-    if (position >= t->size)
+    if (position == TENSOR_BAD_POSITION)
       GSL_ERROR_VOID("index out of range", GSL_EINVAL);
 
+  if (FUNCTION(tensor, unshare) (t))
+    return;
+
   *(BASE *) (t->data + position) = x;
 }
 
@@ -81,9 +81,15 @@ FUNCTION(tensor, ptr) (TYPE (tensor) * t, const size_t * indices)
 
   position = FUNCTION(tensor, position) (indices, t);
   if (gsl_check_range)
-    if (position >= t->size)
+    if (position == TENSOR_BAD_POSITION)
       GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 
+  /* The pointer can be kept to write into t later */
+  if (FUNCTION(tensor, unshare) (t))
+    return NULL;
+
+  tensor_block_expose (t->block);
+
   return (BASE *) (t->data + position);
 }
 
@@ -96,7 +102,7 @@ FUNCTION(tensor, const_ptr) (const TYPE (tensor) * t,
 
   position = FUNCTION(tensor, position) (indices, t);
   if (gsl_check_range)
-    if (position >= t->size)
+    if (position == TENSOR_BAD_POSITION)
       GSL_ERROR_NULL("index out of range", GSL_EINVAL);
 
   return (const BASE *) (t->data + position);
@@ -19,9 +19,12 @@
  */
 
 #include <config.h>
+#include <stdlib.h>
+#include <math.h>
 #include <gsl/gsl_errno.h>
 
-#include "tensor_utilities.h"
+#include "tensor_internal.h"
+#include "divisor.h"
 
 /*
  * Auxiliary functions.
@@ -68,13 +71,10 @@ size_t quick_pow(size_t x, unsigned int n)
 void position2index(unsigned int n_digits, size_t base, size_t n,
                     size_t * digits)
 {
-  unsigned int i;
+  divisor div;
 
-  for (i = 0; i < n_digits; i++)
-    {
-      digits[i] = n - base * (n / base);
-      n /= base;
-    }
+  divisor_init(&div, base);
+  divisor_digits(n_digits, &div, n, digits);
 }
 
 
@@ -131,3 +131,379 @@ void vec_swap(size_t * v, unsigned int i, unsigned int j)
   v[i] = v[j];
   v[j] = temp;
 }
+
+
+
+/*
+ * Einstein summation helpers, used by tensor_einsum().
+ *
+ * Indices are labeled with letters (a-z, A-Z), so a set of labels
+ * fits in the bits of an unsigned long long.
+ */
+
+#define EINSUM_MAX_OPTIMAL 8  /* search all orders up to this many terms */
+
+int einsum_label_bit(char c)
+{
+  if (c >= 'a' && c <= 'z')
+    return c - 'a';
+  if (c >= 'A' && c <= 'Z')
+    return 26 + (c - 'A');
+  return -1;
+}
+
+
+unsigned long long einsum_mask(const char * labels)
+{
+  unsigned long long mask = 0;
+
+  for (; *labels; labels++)
+    mask |= 1ULL << einsum_label_bit(*labels);
+
+  return mask;
+}
+
+
+unsigned int einsum_count(unsigned long long mask)
+{
+  unsigned int n = 0;
+
+  for (; mask; mask &= mask - 1)
+    n++;
+
+  return n;
+}
+
+
+/*
+ * Splits a specification like "abcd,cdef,efgh->abgh" into the labels
+ * of each of the n operands (labels[k], which must have space for
+ * TENSOR_MAX_RANK+1 chars) and of the output. Spaces are ignored.
+ *
+ * Without "->" the output has the labels that appear only once, in
+ * alphabetical order.
+ *
+ * It returns GSL_SUCCESS or GSL_EINVAL if spec does not match the
+ * number and rank (ranks[k]) of the operands.
+ */
+int einsum_parse(const char * spec, size_t n, const unsigned int * ranks,
+                 char ** labels, char * output)
+{
+  size_t k = 0;
+  unsigned int len = 0;
+  unsigned int count[52];
+  unsigned long long seen = 0;
+  int b;
+
+  for (b = 0; b < 52; b++)
+    count[b] = 0;
+
+  if (n == 0)
+    return GSL_EINVAL;
+
+  for (k = 0; k < n; k++)
+    labels[k][0] = '\0';
+  k = 0;
+
+  /* Inputs */
+  for (; *spec && !(spec[0] == '-' && spec[1] == '>'); spec++)
+    {
+      if (*spec == ' ')
+        continue;
+
+      if (*spec == ',')
+        {
+          if (len != ranks[k] || ++k == n)
+            return GSL_EINVAL;
+          len = 0;
+          continue;
+        }
+
+      b = einsum_label_bit(*spec);
+      if (b < 0 || len >= ranks[k] || len >= TENSOR_MAX_RANK)
+        return GSL_EINVAL;
+
+      labels[k][len++] = *spec;
+      labels[k][len] = '\0';
+      count[b]++;
+      seen |= 1ULL << b;
+    }
+
+  if (k != n - 1 || len != ranks[n-1])
+    return GSL_EINVAL;
+
+  /* Output */
+  len = 0;
+  if (*spec)
+    {
+      unsigned long long out = 0;
+
+      for (spec += 2; *spec; spec++)
+        {
+          if (*spec == ' ')
+            continue;
+
+          b = einsum_label_bit(*spec);
+          if (b < 0 || !(seen & (1ULL << b)) || (out & (1ULL << b)) ||
+              len >= TENSOR_MAX_RANK)
+            return GSL_EINVAL;
+
+          out |= 1ULL << b;
+          output[len++] = *spec;
+        }
+    }
+  else
+    {
+      for (b = 0; b < 52; b++)
+        if (count[b] == 1)
+          {
+            if (len >= TENSOR_MAX_RANK)
+              return GSL_EINVAL;
+            output[len++] = (b < 26) ? 'a' + b : 'A' + (b - 26);
+          }
+    }
+  output[len] = '\0';
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Cost of contracting two terms with label sets a and b into one
+ * with labels r: the number of multiply-adds plus the number of
+ * elements written.
+ */
+static double einsum_cost(unsigned long long a, unsigned long long b,
+                          unsigned long long r, size_t dimension)
+{
+  return (pow(dimension, einsum_count(a | b)) +
+          pow(dimension, einsum_count(r)));
+}
+
+
+/*
+ * Greedy order: contract first the pair of terms that is cheapest to
+ * contract right now.
+ */
+static void einsum_path_greedy(size_t n, unsigned long long * masks,
+                               unsigned long long output, size_t dimension,
+                               size_t * path)
+{
+  size_t i, j, k, step;
+
+  for (step = 0; n > 1; step++, n--)
+    {
+      size_t best_i = 0, best_j = 1;
+      double best_cost = -1;
+      unsigned long long best_r = 0;
+
+      for (i = 0; i < n; i++)
+        for (j = i + 1; j < n; j++)
+          {
+            unsigned long long keep = output, r;
+            double cost;
+
+            for (k = 0; k < n; k++)
+              if (k != i && k != j)
+                keep |= masks[k];
+
+            r = (masks[i] | masks[j]) & keep;
+            cost = einsum_cost(masks[i], masks[j], r, dimension);
+
+            if (best_cost < 0 || cost < best_cost)
+              {
+                best_cost = cost;
+                best_i = i;
+                best_j = j;
+                best_r = r;
+              }
+          }
+
+      path[2*step] = best_i;
+      path[2*step + 1] = best_j;
+
+      /* Remove both terms and append the result, as tensor_einsum does */
+      for (k = best_j; k + 1 < n; k++)
+        masks[k] = masks[k+1];
+      for (k = best_i; k + 1 < n - 1; k++)
+        masks[k] = masks[k+1];
+      masks[n-2] = best_r;
+    }
+}
+
+
+/*
+ * Optimal order, by dynamic programming over all subsets of terms.
+ * It takes O(3^n) steps, so it is only used for a few terms. It
+ * returns GSL_SUCCESS, or GSL_ENOMEM if there is no memory for it.
+ */
+static int einsum_path_optimal(size_t n, const unsigned long long * masks,
+                                unsigned long long output, size_t dimension,
+                                size_t * path)
+{
+  const size_t n_sets = (size_t) 1 << n;
+  const size_t all = n_sets - 1;
+  unsigned long long * labels;  /* labels of the result of each subset */
+  double * cost;
+  size_t * split;
+  size_t * order;    /* subsets in the order of the current terms */
+  size_t * stack;
+  size_t s, s1, k, n_terms, n_stack, step;
+
+  labels = (unsigned long long *) malloc(n_sets * sizeof(unsigned long long));
+  cost = (double *) malloc(n_sets * sizeof(double));
+  split = (size_t *) malloc(n_sets * sizeof(size_t));
+  order = (size_t *) malloc(n * sizeof(size_t));
+  stack = (size_t *) malloc(2 * n * sizeof(size_t));
+
+  if (labels == NULL || cost == NULL || split == NULL || order == NULL ||
+      stack == NULL)
+    {
+      free(labels);
+      free(cost);
+      free(split);
+      free(order);
+      free(stack);
+      return GSL_ENOMEM;
+    }
+
+  for (s = 1; s < n_sets; s++)
+    {
+      unsigned long long inside = 0, outside = output;
+
+      for (k = 0; k < n; k++)
+        {
+          if (s & ((size_t) 1 << k))
+            inside |= masks[k];
+          else
+            outside |= masks[k];
+        }
+      labels[s] = inside & outside;
+
+      cost[s] = 0;
+      split[s] = 0;
+      if ((s & (s - 1)) == 0)  /* a single term */
+        continue;
+
+      cost[s] = -1;
+      /* Splits s = s1 + (s - s1), with s1 holding the lowest term */
+      for (s1 = (s - 1) & s; s1 > 0; s1 = (s1 - 1) & s)
+        {
+          size_t s2 = s - s1;
+          double c;
+
+          if (!(s1 & (s & -s)))
+            continue;
+
+          c = cost[s1] + cost[s2] +
+            einsum_cost(labels[s1], labels[s2], labels[s], dimension);
+
+          if (cost[s] < 0 || c < cost[s])
+            {
+              cost[s] = c;
+              split[s] = s1;
+            }
+        }
+    }
+
+  /*
+   * Turn the tree of splits into a list of steps, replaying the way
+   * tensor_einsum() removes the two contracted terms and appends the
+   * result at the end.
+   */
+  for (k = 0; k < n; k++)
+    order[k] = (size_t) 1 << k;
+  n_terms = n;
+
+  n_stack = 0;
+  stack[n_stack++] = all;
+  step = 0;
+  while (n_stack > 0)
+    {
+      size_t s2, i, j;
+
+      s = stack[n_stack - 1];
+      s1 = split[s];
+      s2 = s - s1;
+
+      /* Children first */
+      for (i = 0; i < n_terms && order[i] != s1; i++)
+        ;
+      for (j = 0; j < n_terms && order[j] != s2; j++)
+        ;
+      if (i == n_terms || j == n_terms)
+        {
+          if (i == n_terms)
+            stack[n_stack++] = s1;
+          if (j == n_terms)
+            stack[n_stack++] = s2;
+          continue;
+        }
+
+      n_stack--;
+      if (i > j)
+        {
+          k = i;
+          i = j;
+          j = k;
+        }
+
+      path[2*step] = i;
+      path[2*step + 1] = j;
+      step++;
+
+      for (k = j; k + 1 < n_terms; k++)
+        order[k] = order[k+1];
+      for (k = i; k + 1 < n_terms - 1; k++)
+        order[k] = order[k+1];
+      order[n_terms - 2] = s;
+      n_terms--;
+    }
+
+  free(labels);
+  free(cost);
+  free(split);
+  free(order);
+  free(stack);
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Chooses the order in which to contract the n terms with the given
+ * labels. In each of the n-1 steps, terms path[2*step] and
+ * path[2*step+1] (with path[2*step] < path[2*step+1]) of the current
+ * list are removed and their contraction appended at its end.
+ *
+ * Every label should appear in at least two terms or in the output.
+ *
+ * It returns GSL_SUCCESS, or GSL_ENOMEM if there is no memory for it.
+ */
+int einsum_path(size_t n, char * const * labels, const char * output,
+                size_t dimension, size_t * path)
+{
+  unsigned long long * masks;
+  size_t k;
+  int status = GSL_SUCCESS;
+
+  if (n < 2)
+    return GSL_SUCCESS;
+
+  masks = (unsigned long long *) malloc(n * sizeof(unsigned long long));
+  if (masks == NULL)
+    return GSL_ENOMEM;
+
+  for (k = 0; k < n; k++)
+    masks[k] = einsum_mask(labels[k]);
+
+  if (n <= EINSUM_MAX_OPTIMAL)
+    status = einsum_path_optimal(n, masks, einsum_mask(output), dimension,
+                                 path);
+  else
+    einsum_path_greedy(n, masks, einsum_mask(output), dimension, path);
+
+  free(masks);
+
+  return status;
+}
@@ -18,6 +18,9 @@
  *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
  */
 
+#ifndef __TENSOR_UTILITIES_H__
+#define __TENSOR_UTILITIES_H__
+
 size_t quick_pow(size_t x, unsigned int n);
 
 void position2index(unsigned int n_digits, size_t base, size_t n,
@@ -30,3 +33,42 @@ void vec_insert(size_t * v, unsigned int n, unsigned int position,
                 size_t value);
 
 void vec_swap(size_t * v, unsigned int i, unsigned int j);
+
+/*
+ * Largest rank a view can have. Views keep their strides in a fixed
+ * array so they can be passed around by value, like gsl_matrix_view.
+ */
+#define TENSOR_MAX_RANK 32
+
+/*
+ * Alignment, in bytes, of the data and rows of the tensors from
+ * tensor_alloc_aligned(): a cache line, and a whole AVX-512 register.
+ */
+#define TENSOR_ALIGN 64
+
+/* What tensor_position() returns for indices out of range */
+#define TENSOR_BAD_POSITION ((size_t) -1)
+
+/*
+ * The elements of a tensor t, in order, are TENSOR_ROWS(t) runs of
+ * TENSOR_ROW_LENGTH(t) consecutive elements, t->tda apart: the rows
+ * of a padded tensor, or all the data at once for any other. Loops
+ * over two tensors of the same shape can only do the latter if both
+ * are contiguous, which is what TENSOR_ROWS2() takes into account.
+ */
+#define TENSOR_CONTIGUOUS(t) ((t)->rank < 2 || (t)->tda == (t)->dimension)
+#define TENSOR_ROWS(t) (TENSOR_CONTIGUOUS(t) ? 1 : (t)->size / (t)->dimension)
+#define TENSOR_ROW_LENGTH(t) ((t)->size / TENSOR_ROWS(t))
+#define TENSOR_ROWS2(a, b) \
+  ((TENSOR_CONTIGUOUS(a) && TENSOR_CONTIGUOUS(b)) ? 1 : (a)->size / (a)->dimension)
+
+/*
+ * Instruction sets the vectorized kernels are built for, from the
+ * least to the most capable (see cpu.c).
+ */
+#define TENSOR_ISA_GENERIC 0
+#define TENSOR_ISA_SSE2    1
+#define TENSOR_ISA_AVX2    2
+#define TENSOR_ISA_AVX512  3
+
+#endif /* __TENSOR_UTILITIES_H__ */
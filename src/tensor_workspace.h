@@ -0,0 +1,72 @@
+/* tensor/tensor_workspace.h
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+#ifndef __TENSOR_WORKSPACE_H__
+#define __TENSOR_WORKSPACE_H__
+
+#include <stdlib.h>
+
+#undef __BEGIN_DECLS
+#undef __END_DECLS
+#ifdef __cplusplus
+# define __BEGIN_DECLS extern "C" {
+# define __END_DECLS }
+#else
+# define __BEGIN_DECLS /* empty */
+# define __END_DECLS /* empty */
+#endif
+
+__BEGIN_DECLS
+
+
+/*
+ * A workspace is a block of memory where the "_ws" versions of the
+ * functions that return a new tensor (tensor_product_ws(), ...) put
+ * their results and temporaries, one after the other. They are all
+ * released at once by tensor_workspace_reset(), and must not be
+ * passed to tensor_free().
+ *
+ * When the block is full, the memory comes from malloc() until the
+ * next reset, which then enlarges the block to hold it all. So a loop
+ * that resets the workspace at each iteration stops calling malloc()
+ * and free() after the first one.
+ */
+typedef struct
+{
+  size_t size;      /* bytes in block */
+  size_t used;      /* bytes of block already given */
+  char * block;
+  size_t overflow;  /* bytes given outside of block since the last reset */
+  void * chunks;    /* list of the pieces of memory given outside */
+} tensor_workspace;
+
+
+tensor_workspace * tensor_workspace_alloc(size_t size);
+
+void tensor_workspace_free(tensor_workspace * w);
+
+void tensor_workspace_reset(tensor_workspace * w);
+
+void * tensor_workspace_get(tensor_workspace * w, size_t n);
+
+
+__END_DECLS
+
+#endif /* __TENSOR_WORKSPACE_H__ */
@@ -23,6 +23,53 @@ void FUNCTION(test, trap) (void);
 void FUNCTION(test, text) (void);
 void FUNCTION(test, binary) (void);
 
+/* A negative factor has no meaning for the unsigned types */
+#if defined(BASE_ULONG) || defined(BASE_UINT) \
+    || defined(BASE_USHORT) || defined(BASE_UCHAR)
+#define TEST_SCALE 0.5
+#else
+#define TEST_SCALE -2.5
+#endif
+
+
+/*
+ * True if a and b have the same rank, dimension and elements.
+ */
+static int
+FUNCTION(test, same) (const TYPE(tensor) * a, const TYPE(tensor) * b)
+{
+  size_t i, r, rows;
+
+  if (a->rank != b->rank || a->dimension != b->dimension)
+    return 0;
+
+  rows = TENSOR_ROWS2(a, b);
+  for (r = 0; r < rows; r++)
+    for (i = 0; i < a->size / rows; i++)
+      if (a->data[r * a->tda + i] != b->data[r * b->tda + i])
+        return 0;
+
+  return 1;
+}
+
+
+/*
+ * True if r differs from z by more than the rounding errors of a sum
+ * of products: none for the integer types, whose arithmetic is exact
+ * (or wraps around the same way in the library and the test).
+ */
+static int
+FUNCTION(test, differ) (BASE r, BASE z)
+{
+#if defined(BASE_COMPLEX_DOUBLE)
+  return cabs(r - z) > 10 * GSL_FLT_EPSILON * cabs(z);
+#elif defined(BASE_DOUBLE) || defined(BASE_FLOAT) || defined(BASE_LONG_DOUBLE)
+  return fabs(r - z) > 10 * GSL_FLT_EPSILON * fabs(z);
+#else
+  return r != z;
+#endif
+}
+
 
 void
 FUNCTION(test, func) (void)
@@ -43,6 +90,9 @@ FUNCTION(test, func) (void)
             NAME (tensor) "_alloc returns valid rank");
   gsl_test (t->dimension != DIMENSION,
             NAME (tensor) "_alloc returns valid dimension");
+  gsl_test (t->stride[0] != DIMENSION * DIMENSION ||
+            t->stride[1] != DIMENSION || t->stride[2] != 1,
+            NAME (tensor) "_alloc returns valid strides");
 
 
   /*
@@ -259,6 +309,126 @@ FUNCTION(test, func) (void)
       gsl_test (status,
                 NAME(tensor) "_minmax_index returns correct indices");
     }
+
+    /* Test stats, over several blocks and with every instruction set */
+    {
+      const char * const isa_names[] = {"generic", "sse2", "avx2", "avx512"};
+      const char * isa = tensor_get_isa();
+      gsl_error_handler_t * handler = gsl_set_error_handler_off();
+      TYPE (tensor) * u = FUNCTION(tensor, alloc) (2, 100);
+      size_t pmin = 0, pmax = 0, imin[2], imax[2], m;
+      BASE min, max;
+      double sum, exp_sum = 0;
+
+      for (i = 0; i < u->size; i++)
+        {
+          u->data[i] = (BASE) ((int) ((i * 7919) % 113) - 50);
+          exp_sum += u->data[i];
+          if (u->data[i] < u->data[pmin])
+            pmin = i;
+          if (u->data[i] > u->data[pmax])
+            pmax = i;
+        }
+
+      status = 0;
+      for (m = 0; m < 4; m++)
+        {
+          if (tensor_set_isa(isa_names[m]) != GSL_SUCCESS)
+            continue;
+
+          FUNCTION(tensor, stats) (u, &min, &max, imin, imax, &sum);
+          if (min != u->data[pmin] || max != u->data[pmax] || sum != exp_sum)
+            status = 1;
+          if (imin[0] * 100 + imin[1] != pmin ||
+              imax[0] * 100 + imax[1] != pmax)
+            status = 1;
+        }
+
+      gsl_test (status, NAME(tensor) "_stats returns the first extremes "
+                "and the sum with every instruction set");
+
+#if defined(BASE_DOUBLE) || defined(BASE_FLOAT) || defined(BASE_LONG_DOUBLE)
+      u->data[7000] = GSL_NAN;
+      u->data[5000] = GSL_NAN;
+
+      status = 0;
+      for (m = 0; m < 4; m++)
+        {
+          if (tensor_set_isa(isa_names[m]) != GSL_SUCCESS)
+            continue;
+
+          max = FUNCTION(tensor, max) (u);
+          FUNCTION(tensor, min_index) (u, imin);
+          FUNCTION(tensor, stats) (u, &min, NULL, NULL, imax, &sum);
+          if (max == max || min == min || sum == sum)
+            status = 1;
+          if (imin[0] != 50 || imin[1] != 0 || imax[0] != 50 || imax[1] != 0)
+            status = 1;
+        }
+
+      gsl_test (status, NAME(tensor) "_max, _min_index and _stats give "
+                "the first NaN");
+#endif
+
+      tensor_set_isa(isa);
+      gsl_set_error_handler(handler);
+      FUNCTION(tensor, free) (u);
+    }
+
+    /* Reductions give the same result with any number of threads */
+    {
+      TYPE (tensor) * u = FUNCTION(tensor, alloc) (2, 1024);
+      TYPE (tensor) * v = FUNCTION(tensor, alloc_aligned) (3, 70);
+      size_t imin[3], imax[3], jmin[3], jmax[3];
+      BASE min1, max1, min, max;
+      double sum1, sum;
+      int threads[] = {3, 4, 1};
+
+      for (i = 0; i < u->size; i++)
+        u->data[i] = (BASE) ((double) ((i * 7919) % 1013) / 7);
+      for (i = 0; i < 70 * 70 * 70; i++)
+        v->data[(i / 70) * v->tda + i % 70] = u->data[i];
+
+      status = 0;
+      for (k = 0; k < 2; k++)
+        {
+          TYPE (tensor) * w = (k == 0) ? u : v;
+
+          tensor_set_num_threads (1);
+          tensor_set_deterministic (1);
+          FUNCTION(tensor, stats) (w, &min1, &max1, imin, imax, &sum1);
+
+          for (i = 0; i < 3; i++)
+            {
+              tensor_set_num_threads (threads[i]);
+              tensor_set_deterministic (i < 2);
+              FUNCTION(tensor, stats) (w, &min, &max, jmin, jmax, &sum);
+
+              if (min != min1 || max != max1 ||
+                  memcmp (imin, jmin, w->rank * sizeof (size_t)) != 0 ||
+                  memcmp (imax, jmax, w->rank * sizeof (size_t)) != 0 ||
+                  (i < 2 && memcmp (&sum, &sum1, sizeof (double)) != 0))
+                status = 1;
+            }
+        }
+
+#if defined(BASE_DOUBLE) || defined(BASE_FLOAT) || defined(BASE_LONG_DOUBLE)
+      u->data[900000] = GSL_NAN;
+      u->data[300000] = GSL_NAN;
+      tensor_set_num_threads (4);
+      FUNCTION(tensor, max_index) (u, imax);
+      if (imax[0] * 1024 + imax[1] != 300000)
+        status = 1;
+#endif
+
+      gsl_test (status, NAME(tensor) "_stats gives the same result with "
+                "any number of threads");
+
+      tensor_set_num_threads (0);
+      tensor_set_deterministic (1);
+      FUNCTION(tensor, free) (u);
+      FUNCTION(tensor, free) (v);
+    }
   }
 #endif
 
@@ -393,6 +563,93 @@ FUNCTION(test, func) (void)
       gsl_test(status, NAME(tensor) "_div_elements elements division");
     }
 
+    /* Scaling */
+    FUNCTION(tensor, memcpy) (t, a);
+    FUNCTION(tensor, scale) (t, TEST_SCALE);
+
+    {
+      status = 0;
+
+      for (i = 0; i < DIMENSION; i++)
+        {
+          for (j = 0; j < DIMENSION; j++)
+            {
+              for (k = 0; k < DIMENSION; k++)
+                {
+                  indices[0] = i;  indices[1] = j;  indices[2] = k;
+                  BASE r = FUNCTION(tensor, get) (t, indices);
+                  BASE z = FUNCTION(tensor, get) (a, indices);
+                  z *= TEST_SCALE;
+                  if (r != z)
+                    status = 1;
+                }
+            }
+        }
+
+      gsl_test(status, NAME(tensor) "_scale multiplication by a number");
+    }
+
+    /* Constant addition */
+    FUNCTION(tensor, memcpy) (t, a);
+    FUNCTION(tensor, add_constant) (t, 2.5);
+
+    {
+      status = 0;
+
+      for (i = 0; i < DIMENSION; i++)
+        {
+          for (j = 0; j < DIMENSION; j++)
+            {
+              for (k = 0; k < DIMENSION; k++)
+                {
+                  indices[0] = i;  indices[1] = j;  indices[2] = k;
+                  BASE r = FUNCTION(tensor, get) (t, indices);
+                  BASE z = FUNCTION(tensor, get) (a, indices);
+                  z += 2.5;
+                  if (r != z)
+                    status = 1;
+                }
+            }
+        }
+
+      gsl_test(status, NAME(tensor) "_add_constant addition of a number");
+    }
+
+    /* Same results with every instruction set */
+    {
+      const char * const isa_names[] = {"generic", "sse2", "avx2", "avx512"};
+      const char * isa = tensor_get_isa();
+      gsl_error_handler_t * handler = gsl_set_error_handler_off();
+      size_t m;
+
+      status = 0;
+      for (m = 0; m < 4; m++)
+        {
+          if (tensor_set_isa(isa_names[m]) != GSL_SUCCESS)
+            continue;
+
+          FUNCTION(tensor, memcpy) (t, a);
+          FUNCTION(tensor, mul_elements) (t, b);
+          FUNCTION(tensor, add) (t, a);
+          FUNCTION(tensor, scale) (t, TEST_SCALE);
+
+          for (i = 0; i < t->size; i++)
+            {
+              BASE z = a->data[i] * b->data[i];
+              z += a->data[i];
+              z *= TEST_SCALE;
+              if (t->data[i] != z)
+                status = 1;
+            }
+        }
+
+      tensor_set_isa(isa);
+      gsl_set_error_handler(handler);
+
+      gsl_test(status, NAME(tensor) "_add, _mul_elements and _scale "
+               "with every instruction set");
+    }
+
     /* Tensor product */
     {
       size_t l, m, n;
@@ -472,6 +729,262 @@ FUNCTION(test, func) (void)
       FUNCTION(tensor, free) (t12);
     }
 
+    /* Index contraction of a rank 4 tensor */
+    {
+      size_t l, m;
+      size_t indices_4[4];
+      TYPE(tensor) * t4 = FUNCTION(tensor, alloc) (4, DIMENSION);
+      TYPE(tensor) * t4_12;
+      TYPE(tensor) * t4_03;
+
+      for (i = 0; i < t4->size; i++)
+        t4->data[i] = (BASE) (i % 17);
+
+      t4_12 = FUNCTION(tensor, contract) (t4, 2, 1);
+      t4_03 = FUNCTION(tensor, contract) (t4, 0, 3);
+
+      status = 0;
+      for (i = 0; i < DIMENSION; i++)
+        for (j = 0; j < DIMENSION; j++)
+          {
+            BASE sum12 = 0, sum03 = 0;
+            for (m = 0; m < DIMENSION; m++)
+              {
+                indices_4[0] = i;  indices_4[1] = m;
+                indices_4[2] = m;  indices_4[3] = j;
+                sum12 += FUNCTION(tensor, get) (t4, indices_4);
+                indices_4[0] = m;  indices_4[1] = i;
+                indices_4[2] = j;  indices_4[3] = m;
+                sum03 += FUNCTION(tensor, get) (t4, indices_4);
+              }
+            l = i * DIMENSION + j;
+            if (t4_12->data[l] != sum12 || t4_03->data[l] != sum03)
+              status = 1;
+          }
+
+      gsl_test(status, NAME(tensor) "_contract contracts rank 4 tensor");
+
+      {
+        size_t pairs[4] = {0, 2, 3, 1};
+        TYPE(tensor) * s = FUNCTION(tensor, contract_many) (t4, pairs, 2);
+        BASE trace = FUNCTION(tensor, trace_all) (t4);
+        BASE sum0213 = 0, sum0123 = 0;
+
+        for (i = 0; i < DIMENSION; i++)
+          for (j = 0; j < DIMENSION; j++)
+            {
+              indices_4[0] = i;  indices_4[1] = j;
+              indices_4[2] = i;  indices_4[3] = j;
+              sum0213 += FUNCTION(tensor, get) (t4, indices_4);
+              indices_4[0] = i;  indices_4[1] = i;
+              indices_4[2] = j;  indices_4[3] = j;
+              sum0123 += FUNCTION(tensor, get) (t4, indices_4);
+            }
+
+        gsl_test(s->rank != 0 || s->data[0] != sum0213,
+                 NAME(tensor) "_contract_many contracts several pairs");
+        gsl_test(trace != sum0123,
+                 NAME(tensor) "_trace_all contracts all indices");
+
+        FUNCTION(tensor, free) (s);
+      }
+
+      FUNCTION(tensor, free) (t4_12);
+      FUNCTION(tensor, free) (t4_03);
+      FUNCTION(tensor, free) (t4);
+    }
+
+    /* Contraction of two tensors */
+    {
+      size_t ia[2] = {0, 2};
+      size_t ib[2] = {1, 0};
+      size_t l, m;
+      size_t indices_c[2];
+
+      /* c_jk = sum_lm a_ljm * b_mlk */
+      TYPE(tensor) * c = FUNCTION(tensor, tensordot) (a, ia, b, ib, 2);
+
+      gsl_test(c->rank != 2 || c->dimension != DIMENSION,
+               NAME(tensor) "_tensordot returns valid rank and dimension");
+
+      status = 0;
+      for (j = 0; j < DIMENSION; j++)
+        for (k = 0; k < DIMENSION; k++)
+          {
+            BASE z = 0;
+            for (l = 0; l < DIMENSION; l++)
+              for (m = 0; m < DIMENSION; m++)
+                {
+                  indices[0] = l;  indices[1] = j;  indices[2] = m;
+                  BASE x = FUNCTION(tensor, get) (a, indices);
+                  indices[0] = m;  indices[1] = l;  indices[2] = k;
+                  BASE y = FUNCTION(tensor, get) (b, indices);
+                  z += x * y;
+                }
+            indices_c[0] = j;  indices_c[1] = k;
+            BASE r = FUNCTION(tensor, get) (c, indices_c);
+            if (FUNCTION(test, differ) (r, z))
+              status = 1;
+          }
+
+      gsl_test(status, NAME(tensor) "_tensordot contracts two tensors");
+
+      /* Same, with einsum and the result transposed */
+      {
+        TYPE(tensor) * ab[3];
+        TYPE(tensor) * e;
+
+        ab[0] = a;
+        ab[1] = b;
+        e = FUNCTION(tensor, einsum) ("ljm,mlk->kj", 2, ab);
+
+        status = (e->rank != 2 || e->dimension != DIMENSION);
+        for (j = 0; j < DIMENSION; j++)
+          for (k = 0; k < DIMENSION; k++)
+            {
+              indices_c[0] = j;  indices_c[1] = k;
+              BASE z = FUNCTION(tensor, get) (c, indices_c);
+              indices_c[0] = k;  indices_c[1] = j;
+              BASE r = FUNCTION(tensor, get) (e, indices_c);
+              if (FUNCTION(test, differ) (r, z))
+                status = 1;
+            }
+        gsl_test(status, NAME(tensor) "_einsum contracts two tensors");
+        FUNCTION(tensor, free) (e);
+
+        /* e_i = sum_jk c_jk * a_kji, with three operands */
+        ab[2] = a;
+        e = FUNCTION(tensor, einsum) ("ljm,mlk,kji->i", 3, ab);
+
+        status = (e->rank != 1 || e->dimension != DIMENSION);
+        for (i = 0; i < DIMENSION; i++)
+          {
+            BASE z = 0;
+            for (j = 0; j < DIMENSION; j++)
+              for (k = 0; k < DIMENSION; k++)
+                {
+                  indices_c[0] = j;  indices_c[1] = k;
+                  indices[0] = k;  indices[1] = j;  indices[2] = i;
+                  z += (FUNCTION(tensor, get) (c, indices_c) *
+                        FUNCTION(tensor, get) (a, indices));
+                }
+            BASE r = FUNCTION(tensor, get) (e, &i);
+            if (FUNCTION(test, differ) (r, z))
+              status = 1;
+          }
+        gsl_test(status, NAME(tensor) "_einsum contracts three tensors");
+        FUNCTION(tensor, free) (e);
+
+        /* Trace, e = sum_j c_jj */
+        e = FUNCTION(tensor, einsum) ("jj->", 1, &c);
+
+        status = (e == NULL || e->rank != 0);
+        if (e != NULL)
+          {
+            BASE z = 0;
+            for (j = 0; j < DIMENSION; j++)
+              {
+                indices_c[0] = j;  indices_c[1] = j;
+                z += FUNCTION(tensor, get) (c, indices_c);
+              }
+            if (FUNCTION(test, differ) (e->data[0], z))
+              status = 1;
+          }
+        gsl_test(status, NAME(tensor) "_einsum takes a trace");
+        FUNCTION(tensor, free) (e);
+
+        /* Sum over a label, e_j = sum_k c_jk */
+        e = FUNCTION(tensor, einsum) ("jk->j", 1, &c);
+
+        status = (e == NULL || e->rank != 1);
+        for (j = 0; status == 0 && j < DIMENSION; j++)
+          {
+            BASE z = 0;
+            for (k = 0; k < DIMENSION; k++)
+              {
+                indices_c[0] = j;  indices_c[1] = k;
+                z += FUNCTION(tensor, get) (c, indices_c);
+              }
+            if (FUNCTION(test, differ) (FUNCTION(tensor, get) (e, &j), z))
+              status = 1;
+          }
+        gsl_test(status, NAME(tensor) "_einsum sums over a label");
+        FUNCTION(tensor, free) (e);
+
+        /* Batch label, e_ijk = sum_l a_ijl * b_ilk */
+        e = FUNCTION(tensor, einsum) ("ijl,ilk->ijk", 2, ab);
+
+        status = (e == NULL || e->rank != 3);
+        for (i = 0; status == 0 && i < DIMENSION; i++)
+          for (j = 0; j < DIMENSION; j++)
+            for (k = 0; k < DIMENSION; k++)
+              {
+                size_t l;
+                BASE z = 0;
+                for (l = 0; l < DIMENSION; l++)
+                  {
+                    indices[0] = i;  indices[1] = j;  indices[2] = l;
+                    BASE x = FUNCTION(tensor, get) (a, indices);
+                    indices[0] = i;  indices[1] = l;  indices[2] = k;
+                    z += x * FUNCTION(tensor, get) (b, indices);
+                  }
+                indices[0] = i;  indices[1] = j;  indices[2] = k;
+                BASE r = FUNCTION(tensor, get) (e, indices);
+                if (FUNCTION(test, differ) (r, z))
+                  status = 1;
+              }
+        gsl_test(status, NAME(tensor) "_einsum keeps batch labels");
+        FUNCTION(tensor, free) (e);
+
+        /*
+         * Implicit output: the labels that appear once, in alphabetical
+         * order, so "kj,jl" is the matrix product c c.
+         */
+        {
+          TYPE(tensor) * cc[2];
+          size_t ic[1] = {1};
+          size_t jc[1] = {0};
+          TYPE(tensor) * p = FUNCTION(tensor, tensordot) (c, ic, c, jc, 1);
+
+          cc[0] = c;
+          cc[1] = c;
+          e = FUNCTION(tensor, einsum) ("kj,jl", 2, cc);
+
+          status = (e == NULL || e->rank != 2);
+          for (j = 0; status == 0 && j < DIMENSION; j++)
+            for (k = 0; k < DIMENSION; k++)
+              {
+                indices_c[0] = j;  indices_c[1] = k;
+                BASE z = FUNCTION(tensor, get) (p, indices_c);
+                BASE r = FUNCTION(tensor, get) (e, indices_c);
+                if (FUNCTION(test, differ) (r, z))
+                  status = 1;
+              }
+          gsl_test(status, NAME(tensor) "_einsum finds the implicit output");
+          FUNCTION(tensor, free) (e);
+          FUNCTION(tensor, free) (p);
+        }
+
+        /* Specifications that are rejected */
+        {
+          gsl_error_handler_t * handler = gsl_set_error_handler_off();
+
+          status = (FUNCTION(tensor, einsum) ("jj->j", 1, &c) != NULL);
+          status |= (FUNCTION(tensor, einsum) ("jk,kl->jz", 2, ab) != NULL);
+          status |= (FUNCTION(tensor, einsum) ("jk->jk", 1, ab) != NULL);
+          status |= (FUNCTION(tensor, einsum) ("j1k->", 1, ab) != NULL);
+          status |= (FUNCTION(tensor, einsum) ("jkl->jj", 1, ab) != NULL);
+          status |= (FUNCTION(tensor, einsum) ("jkl,klm->jm", 1, ab) != NULL);
+
+          gsl_set_error_handler(handler);
+
+          gsl_test(status, NAME(tensor) "_einsum rejects bad specifications");
+        }
+      }
+
+      FUNCTION(tensor, free) (c);
+    }
+
     /* Swap indices */
     {
       TYPE(tensor) * a_102 = FUNCTION(tensor, swap_indices) (a, 0, 1);
@@ -506,12 +1019,557 @@ FUNCTION(test, func) (void)
       FUNCTION(tensor, free) (a_021);
     }
 
+    /* Copies share the data until written */
+    {
+      TYPE(tensor) * a1 = FUNCTION(tensor, copy) (a);
+      TYPE(tensor) * a2 = FUNCTION(tensor, copy) (a1);
+      TYPE(tensor) * a_al = FUNCTION(tensor, alloc_aligned) (RANK, DIMENSION);
+      TYPE(tensor) * a3;
+      BASE x;
+
+      status = 0;
+      if (a1->data != a->data || a2->data != a->data ||
+          a->block->refcount != 3)
+        status = 1;
+
+      indices[0] = 1;  indices[1] = 2;  indices[2] = 3;
+      x = FUNCTION(tensor, get) (a, indices);
+      FUNCTION(tensor, set) (a1, indices, x + 1);
+      FUNCTION(tensor, scale) (a2, 2);
+
+      if (a1->data == a->data || a2->data == a->data ||
+          a->block->refcount != 1 ||
+          FUNCTION(tensor, get) (a, indices) != x ||
+          FUNCTION(tensor, get) (a1, indices) != x + 1 ||
+          FUNCTION(tensor, get) (a2, indices) != x + x)
+        status = 1;
+
+      FUNCTION(tensor, memcpy) (a_al, a);
+      a3 = FUNCTION(tensor, copy) (a_al);
+      FUNCTION(tensor, add) (a3, a);
+      FUNCTION(tensor, sub) (a3, a);
+      if (a3->tda != a_al->tda || a3->data == a_al->data ||
+          !FUNCTION(test, same) (a3, a))
+        status = 1;
+
+      gsl_test(status, NAME(tensor) "_copy shares the data until it is "
+               "written");
+
+      FUNCTION(tensor, free) (a1);
+      FUNCTION(tensor, free) (a2);
+      FUNCTION(tensor, free) (a_al);
+      FUNCTION(tensor, free) (a3);
+    }
+
+    /* Data that can be written without unsharing is not shared */
+    {
+      TYPE(tensor) * e1 = FUNCTION(tensor, calloc) (RANK, DIMENSION);
+      TYPE(tensor) * e2 = FUNCTION(tensor, calloc) (2, DIMENSION);
+      TYPE(tensor) * e3 = FUNCTION(tensor, calloc) (RANK, DIMENSION);
+      TYPE(tensor) * c1, * c2, * c3;
+      VIEW(tensor, view) v;
+      TYPE(gsl_matrix) * m;
+      BASE * p, x;
+
+      indices[0] = 1;  indices[1] = 2;  indices[2] = 3;
+      x = FUNCTION(tensor, get) (a, indices);
+
+      v = FUNCTION(tensor, view_tensor) (e1);
+      c1 = FUNCTION(tensor, copy) (e1);
+      FUNCTION(tensor, view_set) (&v, indices, x);
+
+      m = FUNCTION(tensor, 2matrix) (e2);
+      c2 = FUNCTION(tensor, copy) (e2);
+      m->data[1] = 9;
+
+      p = FUNCTION(tensor, ptr) (e3, indices);
+      c3 = FUNCTION(tensor, copy) (e3);
+      *p = x;
+
+      status = 0;
+      if (FUNCTION(tensor, isnull) (e1) || !FUNCTION(tensor, isnull) (c1) ||
+          FUNCTION(tensor, isnull) (e2) || !FUNCTION(tensor, isnull) (c2) ||
+          FUNCTION(tensor, isnull) (e3) || !FUNCTION(tensor, isnull) (c3))
+        status = 1;
+
+      gsl_test(status, NAME(tensor) "_copy does not share data written "
+               "through a view, a matrix or a pointer");
+
+      free(m);
+      FUNCTION(tensor, free) (e1);
+      FUNCTION(tensor, free) (e2);
+      FUNCTION(tensor, free) (e3);
+      FUNCTION(tensor, free) (c1);
+      FUNCTION(tensor, free) (c2);
+      FUNCTION(tensor, free) (c3);
+    }
+
+    /* Tensors of existing data */
+    {
+      ATOMIC data[DIMENSION * DIMENSION * DIMENSION];
+      TYPE(tensor) * v = FUNCTION(tensor, view_array) (data, RANK, DIMENSION);
+      TYPE(tensor) * v1 = FUNCTION(tensor, copy) (v);
+      TYPE(tensor) * d = FUNCTION(tensor, alloc_aligned) (2, DIMENSION);
+      TYPE(gsl_matrix) * m = FUNCTION(tensor, 2matrix) (d);
+      TYPE(tensor) * dm = FUNCTION(tensor, view_matrix) (m);
+
+      FUNCTION(tensor, memcpy) (v, a);
+      FUNCTION(tensor, memcpy) (v1, b);
+
+      status = 0;
+      for (i = 0; i < DIMENSION * DIMENSION * DIMENSION; i++)
+        if (data[i] != a->data[i])
+          status = 1;
+      if (v1->data == data || !FUNCTION(test, same) (v1, b))
+        status = 1;
+      if (dm->data != d->data || dm->tda != d->tda || dm->block != NULL)
+        status = 1;
+
+      gsl_test(status, NAME(tensor) "_view_array and _view_matrix use the "
+               "memory they are given");
+
+      FUNCTION(tensor, free) (v);
+      FUNCTION(tensor, free) (v1);
+      FUNCTION(tensor, free) (dm);
+      free(m);
+      FUNCTION(tensor, free) (d);
+    }
+
+    /* Swaps */
+    {
+      TYPE(tensor) * a1 = FUNCTION(tensor, copy) (a);
+      TYPE(tensor) * b1 = FUNCTION(tensor, alloc_aligned) (RANK, DIMENSION);
+      BASE * data1;
+
+      FUNCTION(tensor, memcpy) (b1, b);
+      FUNCTION(tensor, unshare) (a1);
+      data1 = a1->data;
+
+      status = 0;
+      FUNCTION(tensor, swap_data) (a1, b1);
+      if (b1->data != data1 || !FUNCTION(test, same) (a1, b) ||
+          !FUNCTION(test, same) (b1, a))
+        status = 1;
+
+      FUNCTION(tensor, swap) (a1, b1);
+      if (b1->data != data1 || !FUNCTION(test, same) (a1, a) ||
+          !FUNCTION(test, same) (b1, b))
+        status = 1;
+
+      gsl_test(status, NAME(tensor) "_swap_data and _swap exchange the "
+               "values");
+
+      FUNCTION(tensor, free) (a1);
+      FUNCTION(tensor, free) (b1);
+    }
+
+    /* Workspace */
+    {
+      tensor_workspace * w = tensor_workspace_alloc (0);
+      size_t ia[2] = {0, 2};
+      size_t ib[2] = {1, 0};
+      int round;
+
+      TYPE(tensor) * p = FUNCTION(tensor, product) (a, b);
+      TYPE(tensor) * c = FUNCTION(tensor, contract) (p, 1, 4);
+      TYPE(tensor) * s = FUNCTION(tensor, swap_indices) (a, 0, 2);
+      TYPE(tensor) * d = FUNCTION(tensor, tensordot) (a, ia, b, ib, 2);
+
+      status = 0;
+      for (round = 0; round < 3; round++)
+        {
+          TYPE(tensor) * p_ws = FUNCTION(tensor, product_ws) (a, b, w);
+          TYPE(tensor) * c_ws = FUNCTION(tensor, contract_ws) (p_ws, 1, 4, w);
+          TYPE(tensor) * s_ws = FUNCTION(tensor, swap_indices_ws) (a, 0, 2, w);
+          TYPE(tensor) * d_ws =
+            FUNCTION(tensor, tensordot_ws) (a, ia, b, ib, 2, w);
+          TYPE(tensor) * a_ws = FUNCTION(tensor, copy_ws) (a, w);
+
+          if (!FUNCTION(test, same) (p, p_ws) ||
+              !FUNCTION(test, same) (c, c_ws) ||
+              !FUNCTION(test, same) (s, s_ws) ||
+              !FUNCTION(test, same) (d, d_ws) ||
+              !FUNCTION(test, same) (a, a_ws))
+            status = 1;
+
+          /* After the first round everything fits in the block */
+          if (round > 0 && w->overflow != 0)
+            status = 1;
+
+          tensor_workspace_reset (w);
+        }
+
+      gsl_test(status, NAME(tensor) "_product_ws, _contract_ws, "
+               "_swap_indices_ws, _tensordot_ws and _copy_ws reuse "
+               "the workspace");
+
+      FUNCTION(tensor, free) (p);
+      FUNCTION(tensor, free) (c);
+      FUNCTION(tensor, free) (s);
+      FUNCTION(tensor, free) (d);
+      tensor_workspace_free (w);
+    }
+
+    /* Destination-passing forms */
+    {
+      gsl_error_handler_t * handler = gsl_set_error_handler_off();
+      size_t ia[2] = {0, 2};
+      size_t ib[2] = {1, 0};
+      TYPE(tensor) * p = FUNCTION(tensor, product) (a, b);
+      TYPE(tensor) * c = FUNCTION(tensor, contract) (p, 1, 4);
+      TYPE(tensor) * s = FUNCTION(tensor, swap_indices) (a, 0, 2);
+      TYPE(tensor) * d = FUNCTION(tensor, tensordot) (a, ia, b, ib, 2);
+      TYPE(tensor) * p_into = FUNCTION(tensor, alloc) (2 * RANK, DIMENSION);
+      TYPE(tensor) * c_into = FUNCTION(tensor, alloc) (2 * RANK - 2, DIMENSION);
+      TYPE(tensor) * s_into = FUNCTION(tensor, alloc) (RANK, DIMENSION);
+      TYPE(tensor) * d_into = FUNCTION(tensor, alloc) (2, DIMENSION);
+
+      status = 0;
+      if (FUNCTION(tensor, product_into) (p_into, a, b) != GSL_SUCCESS ||
+          FUNCTION(tensor, contract_into) (c_into, p_into, 1, 4) != GSL_SUCCESS ||
+          FUNCTION(tensor, swap_indices_into) (s_into, a, 0, 2) != GSL_SUCCESS ||
+          FUNCTION(tensor, tensordot_into) (d_into, a, ia, b, ib, 2) != GSL_SUCCESS)
+        status = 1;
+
+      if (!FUNCTION(test, same) (p, p_into) ||
+          !FUNCTION(test, same) (c, c_into) ||
+          !FUNCTION(test, same) (s, s_into) ||
+          !FUNCTION(test, same) (d, d_into))
+        status = 1;
+
+      gsl_test(status, NAME(tensor) "_product_into, _contract_into, "
+               "_swap_indices_into and _tensordot_into give the same "
+               "results");
+
+      status = 0;
+      if (FUNCTION(tensor, product_into) (s_into, a, b) != GSL_EBADLEN ||
+          FUNCTION(tensor, contract_into) (s_into, p, 1, 4) != GSL_EBADLEN ||
+          FUNCTION(tensor, swap_indices_into) (d_into, a, 0, 2) != GSL_EBADLEN ||
+          FUNCTION(tensor, tensordot_into) (s_into, a, ia, b, ib, 2) != GSL_EBADLEN ||
+          FUNCTION(tensor, swap_indices_into) (s_into, s_into, 0, 2) != GSL_EINVAL)
+        status = 1;
+
+      gsl_test(status, NAME(tensor) "_into functions check the destination");
+
+      FUNCTION(tensor, free) (p);
+      FUNCTION(tensor, free) (c);
+      FUNCTION(tensor, free) (s);
+      FUNCTION(tensor, free) (d);
+      FUNCTION(tensor, free) (p_into);
+      FUNCTION(tensor, free) (c_into);
+      FUNCTION(tensor, free) (s_into);
+      FUNCTION(tensor, free) (d_into);
+      gsl_set_error_handler(handler);
+    }
+
+    /* Aligned tensors, with padded rows */
+    {
+      size_t ia[2] = {0, 2};
+      size_t ib[2] = {1, 0};
+      TYPE(tensor) * p = FUNCTION(tensor, product) (a, b);
+      TYPE(tensor) * c = FUNCTION(tensor, contract) (p, 1, 4);
+      TYPE(tensor) * s = FUNCTION(tensor, swap_indices) (a, 0, 2);
+      TYPE(tensor) * d = FUNCTION(tensor, tensordot) (a, ia, b, ib, 2);
+      TYPE(tensor) * a_al = FUNCTION(tensor, alloc_aligned) (RANK, DIMENSION);
+      TYPE(tensor) * p_al = FUNCTION(tensor, alloc_aligned) (2 * RANK, DIMENSION);
+      TYPE(tensor) * c_al = FUNCTION(tensor, alloc_aligned) (2 * RANK - 2, DIMENSION);
+      TYPE(tensor) * s_al = FUNCTION(tensor, alloc_aligned) (RANK, DIMENSION);
+      TYPE(tensor) * d_al = FUNCTION(tensor, alloc_aligned) (2, DIMENSION);
+      TYPE(gsl_matrix) * m;
+
+      status = 0;
+      if (TENSOR_ALIGN % sizeof (ATOMIC) == 0 &&
+          ((a_al->tda * sizeof (ATOMIC)) % TENSOR_ALIGN != 0 ||
+           a_al->tda < DIMENSION))
+        status = 1;
+      if (a_al->stride[RANK-1] != 1 || a_al->stride[RANK-2] != a_al->tda ||
+          a_al->stride[0] != a_al->tda * DIMENSION)
+        status = 1;
+
+      gsl_test(status, NAME(tensor) "_alloc_aligned pads the rows");
+
+      status = 0;
+      FUNCTION(tensor, memcpy) (a_al, a);
+      if (!FUNCTION(test, same) (a, a_al))
+        status = 1;
+
+      if (FUNCTION(tensor, product_into) (p_al, a_al, b) != GSL_SUCCESS ||
+          FUNCTION(tensor, contract_into) (c_al, p_al, 1, 4) != GSL_SUCCESS ||
+          FUNCTION(tensor, swap_indices_into) (s_al, a_al, 0, 2) != GSL_SUCCESS ||
+          FUNCTION(tensor, tensordot_into) (d_al, a_al, ia, b, ib, 2) != GSL_SUCCESS)
+        status = 1;
+
+      if (!FUNCTION(test, same) (p, p_al) ||
+          !FUNCTION(test, same) (c, c_al) ||
+          !FUNCTION(test, same) (s, s_al) ||
+          !FUNCTION(test, same) (d, d_al))
+        status = 1;
+
+      FUNCTION(tensor, add) (s_al, a_al);
+      FUNCTION(tensor, add) (s, a);
+      if (!FUNCTION(test, same) (s, s_al))
+        status = 1;
+
+      m = FUNCTION(tensor, 2matrix) (d_al);
+      if (m->tda != d_al->tda)
+        status = 1;
+      free(m);
+
+#if !defined(BASE_COMPLEX_DOUBLE)
+      {
+        size_t imin[RANK], imax[RANK], jmin[RANK], jmax[RANK];
+
+        FUNCTION(tensor, minmax_index) (s, imin, imax);
+        FUNCTION(tensor, minmax_index) (s_al, jmin, jmax);
+        for (i = 0; i < RANK; i++)
+          if (imin[i] != jmin[i] || imax[i] != jmax[i])
+            status = 1;
+      }
+#endif
+
+      gsl_test(status, NAME(tensor) "_alloc_aligned tensors give the same "
+               "results");
+
+      FUNCTION(tensor, free) (p);
+      FUNCTION(tensor, free) (c);
+      FUNCTION(tensor, free) (s);
+      FUNCTION(tensor, free) (d);
+      FUNCTION(tensor, free) (a_al);
+      FUNCTION(tensor, free) (p_al);
+      FUNCTION(tensor, free) (c_al);
+      FUNCTION(tensor, free) (s_al);
+      FUNCTION(tensor, free) (d_al);
+    }
+
+    /* Views */
+    {
+      size_t offset[RANK];
+      size_t indices_v[RANK-1];
+
+      VIEW(tensor, view) s1 = FUNCTION(tensor, slice) (a, 1, 2);
+
+      gsl_test(s1.rank != RANK-1 || s1.dimension != DIMENSION,
+               NAME(tensor) "_slice returns valid rank and dimension");
+
+      status = 0;
+      for (i = 0; i < DIMENSION; i++)
+        for (k = 0; k < DIMENSION; k++)
+          {
+            indices[0] = i;  indices[1] = 2;  indices[2] = k;
+            indices_v[0] = i;  indices_v[1] = k;
+            if (FUNCTION(tensor, view_get) (&s1, indices_v) !=
+                FUNCTION(tensor, get) (a, indices))
+              status = 1;
+          }
+
+      gsl_test(status, NAME(tensor) "_slice fixes an index");
+
+      offset[0] = 1;  offset[1] = 0;  offset[2] = 2;
+      {
+        VIEW(tensor, view) sub = FUNCTION(tensor, subtensor) (a, offset, 3);
+        VIEW(tensor, view) sub1 = FUNCTION(tensor, view_slice) (&sub, 0, 1);
+        TYPE(tensor) * c = FUNCTION(tensor, view_copy) (&sub);
+
+        status = 0;
+        for (i = 0; i < 3; i++)
+          for (j = 0; j < 3; j++)
+            for (k = 0; k < 3; k++)
+              {
+                size_t indices_a[RANK];
+                indices[0] = i;  indices[1] = j;  indices[2] = k;
+                indices_a[0] = 1 + i;  indices_a[1] = j;  indices_a[2] = 2 + k;
+                BASE x = FUNCTION(tensor, get) (a, indices_a);
+                if (FUNCTION(tensor, view_get) (&sub, indices) != x)
+                  status = 1;
+                if (FUNCTION(tensor, get) (c, indices) != x)
+                  status = 1;
+                if (i == 1)
+                  {
+                    indices_v[0] = j;  indices_v[1] = k;
+                    if (FUNCTION(tensor, view_get) (&sub1, indices_v) != x)
+                      status = 1;
+                  }
+              }
+
+        gsl_test(status,
+                 NAME(tensor) "_subtensor and view_copy select a block");
+
+        indices[0] = 2;  indices[1] = 1;  indices[2] = 0;
+        FUNCTION(tensor, view_set) (&sub, indices, (BASE) 7);
+        indices[0] = 3;  indices[1] = 1;  indices[2] = 2;
+        gsl_test(FUNCTION(tensor, get) (a, indices) != (BASE) 7,
+                 NAME(tensor) "_view_set writes into parent tensor");
+
+        FUNCTION(tensor, free) (c);
+      }
+    }
+
+    /* Swapped indices of a view, and their copy in tiles */
+    {
+      const size_t d = 37;  /* more than one tile per index */
+      TYPE(tensor) * big = FUNCTION(tensor, alloc) (RANK, d);
+      TYPE(tensor) * big_210;
+      VIEW(tensor, view) v, v_210;
+
+      for (i = 0; i < big->size; i++)
+        big->data[i] = (BASE) (i % 101);
+
+      v = FUNCTION(tensor, view_tensor) (big);
+      v_210 = FUNCTION(tensor, view_swap_indices) (&v, 0, 2);
+      big_210 = FUNCTION(tensor, view_copy) (&v_210);
+
+      status = 0;
+      for (i = 0; i < d; i++)
+        for (j = 0; j < d; j++)
+          for (k = 0; k < d; k++)
+            {
+              indices[0] = i;  indices[1] = j;  indices[2] = k;
+              BASE x = FUNCTION(tensor, get) (big, indices);
+              indices[0] = k;  indices[1] = j;  indices[2] = i;
+              if (FUNCTION(tensor, view_get) (&v_210, indices) != x ||
+                  FUNCTION(tensor, get) (big_210, indices) != x)
+                status = 1;
+            }
+
+      gsl_test(status, NAME(tensor) "_view_swap_indices swaps indices");
+
+      {
+        size_t perm[RANK] = {1, 2, 0};  /* dest[i,j,k] = big[k,i,j] */
+        TYPE(tensor) * big_p = FUNCTION(tensor, alloc) (RANK, d);
+
+        FUNCTION(tensor, permute) (big_p, big, perm);
+
+        status = 0;
+        for (i = 0; i < d; i++)
+          for (j = 0; j < d; j++)
+            for (k = 0; k < d; k++)
+              {
+                indices[0] = k;  indices[1] = i;  indices[2] = j;
+                BASE x = FUNCTION(tensor, get) (big, indices);
+                indices[0] = i;  indices[1] = j;  indices[2] = k;
+                if (FUNCTION(tensor, get) (big_p, indices) != x)
+                  status = 1;
+              }
+
+        gsl_test(status, NAME(tensor) "_permute permutes indices");
+
+        FUNCTION(tensor, free) (big_p);
+      }
+
+      FUNCTION(tensor, free) (big_210);
+      FUNCTION(tensor, free) (big);
+    }
+
 
     FUNCTION(tensor, free) (a);
     FUNCTION(tensor, free) (b);
   }
 
 
+  {
+    /* Large enough to be split among the threads */
+    TYPE(tensor) * x = FUNCTION(tensor, alloc) (2, 512);
+    TYPE(tensor) * y = FUNCTION(tensor, alloc) (2, 512);
+    TYPE(tensor) * z = FUNCTION(tensor, alloc_aligned) (3, 70);
+    size_t indices[3] = {69, 69, 69};
+
+    tensor_set_num_threads (4);
+
+    for (i = 0; i < x->size; i++)
+      x->data[i] = (BASE) (i % 100 + 1);
+
+    FUNCTION(tensor, set_all) (y, (BASE) 2);
+    FUNCTION(tensor, add) (y, x);
+    FUNCTION(tensor, scale) (y, 2);
+
+    status = 0;
+    for (i = 0; i < y->size; i++)
+      if (y->data[i] != (BASE) (2 * (i % 100 + 3)))
+        status = 1;
+
+    gsl_test(status, NAME(tensor) "_add and _scale in several threads");
+
+    FUNCTION(tensor, set_zero) (z);
+    status = !FUNCTION(tensor, isnull) (z);
+    FUNCTION(tensor, set) (z, indices, (BASE) 1);
+    status |= FUNCTION(tensor, isnull) (z);
+
+    gsl_test(status, NAME(tensor) "_set_zero and _isnull in several threads");
+
+    {
+      TYPE(tensor) * q = FUNCTION(tensor, alloc) (4, 32);
+      TYPE(tensor) * c1[2], * c4[2];
+
+      for (i = 0; i < q->size; i++)
+        q->data[i] = (BASE) ((double) ((i * 7919) % 1013) / 7);
+
+      tensor_set_num_threads (1);
+      c1[0] = FUNCTION(tensor, contract) (q, 1, 3);
+      c1[1] = FUNCTION(tensor, contract) (q, 0, 1);
+      tensor_set_num_threads (4);
+      c4[0] = FUNCTION(tensor, contract) (q, 1, 3);
+      c4[1] = FUNCTION(tensor, contract) (q, 0, 1);
+
+      status = 0;
+      for (k = 0; k < 2; k++)
+        {
+          if (memcmp (c1[k]->data, c4[k]->data,
+                      c1[k]->size * sizeof (ATOMIC)) != 0)
+            status = 1;
+          FUNCTION(tensor, free) (c1[k]);
+          FUNCTION(tensor, free) (c4[k]);
+        }
+
+      gsl_test(status, NAME(tensor) "_contract in several threads");
+
+      FUNCTION(tensor, free) (q);
+    }
+
+    {
+      TYPE(tensor) * q = FUNCTION(tensor, alloc) (3, 64);
+      TYPE(tensor) * r1 = FUNCTION(tensor, alloc) (3, 64);
+      TYPE(tensor) * r4 = FUNCTION(tensor, alloc_aligned) (3, 64);
+      size_t perm[3] = {1, 2, 0};
+      size_t m;
+
+      for (i = 0; i < q->size; i++)
+        q->data[i] = (BASE) (i % 101);
+
+      status = 0;
+      for (m = 0; m < 3; m++)
+        {
+          tensor_set_num_threads (1);
+          if (m < 2)
+            FUNCTION(tensor, swap_indices_into) (r1, q, m, 2);
+          else
+            FUNCTION(tensor, permute) (r1, q, perm);
+
+          tensor_set_num_threads (4);
+          if (m < 2)
+            FUNCTION(tensor, swap_indices_into) (r4, q, m, 2);
+          else
+            FUNCTION(tensor, permute) (r4, q, perm);
+
+          if (!FUNCTION(test, same) (r1, r4))
+            status = 1;
+        }
+
+      gsl_test(status, NAME(tensor) "_swap_indices and _permute in "
+               "several threads");
+
+      FUNCTION(tensor, free) (q);
+      FUNCTION(tensor, free) (r1);
+      FUNCTION(tensor, free) (r4);
+    }
+
+    tensor_set_num_threads (0);
+
+    FUNCTION(tensor, free) (x);
+    FUNCTION(tensor, free) (y);
+    FUNCTION(tensor, free) (z);
+  }
+
+
   FUNCTION(tensor, free) (t);
 }
 
@@ -634,6 +1692,142 @@ FUNCTION(test, binary) (void)
     fclose(f);
     FUNCTION(tensor, free) (tt);
   }
+
+  {
+    FILE *f = fopen("test.dat", "rb");
+    TYPE(tensor) * tt = FUNCTION(tensor, alloc_aligned) (RANK, DIMENSION);
+
+    FUNCTION(tensor, fread) (f, tt);
+
+    gsl_test(!FUNCTION(test, same) (t, tt),
+             NAME (tensor) "_read into an aligned tensor");
+
+    fclose(f);
+    FUNCTION(tensor, free) (tt);
+  }
+
+  {
+    TYPE(tensor) * tm = FUNCTION(tensor, mmap) ("test.dat", RANK, DIMENSION,
+                                                TENSOR_MMAP_READ |
+                                                TENSOR_MMAP_SEQUENTIAL);
+    TYPE(tensor) * tw, * tc;
+
+    gsl_test(tm == NULL || !FUNCTION(test, same) (t, tm),
+             NAME (tensor) "_mmap maps the elements of a file");
+
+    /* Writes go to memory, not to the file */
+    FUNCTION(tensor, set_zero) (tm);
+    FUNCTION(tensor, free) (tm);
+
+    tw = FUNCTION(tensor, mmap) ("test_mmap.dat", RANK, DIMENSION,
+                                 TENSOR_MMAP_WRITE);
+    FUNCTION(tensor, memcpy) (tw, t);
+    FUNCTION(tensor, free) (tw);
+
+    tm = FUNCTION(tensor, mmap) ("test.dat", RANK, DIMENSION,
+                                 TENSOR_MMAP_RANDOM);
+    tw = FUNCTION(tensor, mmap) ("test_mmap.dat", RANK, DIMENSION,
+                                 TENSOR_MMAP_READ);
+
+    gsl_test(tm == NULL || tw == NULL ||
+             !FUNCTION(test, same) (t, tm) || !FUNCTION(test, same) (t, tw),
+             NAME (tensor) "_mmap writes into the file only if asked to");
+
+    FUNCTION(tensor, free) (tm);
+    FUNCTION(tensor, free) (tw);
+
+    /* A copy does not take the writes of the original away from the file */
+    tw = FUNCTION(tensor, mmap) ("test_mmap.dat", RANK, DIMENSION,
+                                 TENSOR_MMAP_WRITE);
+    tc = FUNCTION(tensor, copy) (tw);
+    FUNCTION(tensor, set_zero) (tw);
+    FUNCTION(tensor, free) (tw);
+
+    tm = FUNCTION(tensor, mmap) ("test_mmap.dat", RANK, DIMENSION,
+                                 TENSOR_MMAP_READ);
+
+    gsl_test(tm == NULL || tc == NULL || !FUNCTION(tensor, isnull) (tm) ||
+             !FUNCTION(test, same) (t, tc),
+             NAME (tensor) "_mmap writes into the file after a copy");
+
+    FUNCTION(tensor, free) (tm);
+    FUNCTION(tensor, free) (tc);
+    remove ("test_mmap.dat");
+  }
+
+  {
+    const char * name = "/" NAME (tensor) "_test";
+    TYPE(tensor) * ts = FUNCTION(tensor, shm_create) (name, RANK, DIMENSION);
+    TYPE(tensor) * tr, * tc;
+    unsigned long version;
+
+    FUNCTION(tensor, shm_write_begin) (ts);
+    FUNCTION(tensor, memcpy) (ts, t);
+    FUNCTION(tensor, shm_write_end) (ts);
+
+    tr = FUNCTION(tensor, shm_open) (name, TENSOR_MMAP_READ);
+
+    gsl_test(tr == NULL || tr->rank != RANK || tr->dimension != DIMENSION ||
+             !FUNCTION(test, same) (t, tr),
+             NAME (tensor) "_shm_open sees the data of _shm_create");
+
+    version = FUNCTION(tensor, shm_read_begin) (tr);
+    status = (version != 2 || FUNCTION(tensor, shm_read_retry) (tr, version));
+
+    FUNCTION(tensor, shm_write_begin) (ts);
+    FUNCTION(tensor, set_zero) (ts);
+    FUNCTION(tensor, shm_write_end) (ts);
+
+    status |= !FUNCTION(tensor, shm_read_retry) (tr, version);
+    status |= !FUNCTION(tensor, isnull) (tr);
+
+    gsl_test(status, NAME (tensor) "_shm_read_retry sees writes");
+
+    /* Writes after a copy still go to the shared memory */
+    tc = FUNCTION(tensor, copy) (ts);
+    FUNCTION(tensor, shm_write_begin) (ts);
+    FUNCTION(tensor, memcpy) (ts, t);
+    FUNCTION(tensor, shm_write_end) (ts);
+
+    status = (tc == NULL || tc->data == ts->data ||
+              !FUNCTION(tensor, isnull) (tc) ||
+              !FUNCTION(test, same) (t, tr) ||
+              (tensor_block_shm_header (tr->block)->version & 1));
+
+    gsl_test(status, NAME (tensor) "_shm_create writes into the shared "
+             "memory after a copy");
+
+    FUNCTION(tensor, free) (tc);
+
+    FUNCTION(tensor, free) (tr);
+    FUNCTION(tensor, free) (ts);
+    tensor_shm_unlink (name);
+  }
+
+  {
+    TYPE(tensor) * tn = FUNCTION(tensor, alloc) (2, 512);
+    TYPE(tensor) * tc;
+    int policy;
+
+    status = 0;
+    for (policy = TENSOR_NUMA_DEFAULT; policy <= TENSOR_NUMA_BIND; policy++)
+      {
+        status |= FUNCTION(tensor, set_numa_policy) (tn, policy, 0);
+        FUNCTION(tensor, set_all) (tn, (BASE) 3);
+
+        /* A copy keeps the policy when it gets data of its own */
+        tc = FUNCTION(tensor, copy) (tn);
+        FUNCTION(tensor, set_zero) (tc);
+        status |= (tc->block->numa_policy != policy);
+        status |= !FUNCTION(tensor, isnull) (tc);
+        status |= FUNCTION(tensor, isnull) (tn);
+        FUNCTION(tensor, free) (tc);
+      }
+
+    gsl_test(status, NAME (tensor) "_set_numa_policy keeps the data");
+
+    FUNCTION(tensor, free) (tn);
+  }
   
   FUNCTION(tensor, free) (t);
 }
@@ -749,3 +1943,5 @@ FUNCTION(test, trap) (void)
 
   FUNCTION(tensor, free) (t);
 }
+
+#undef TEST_SCALE
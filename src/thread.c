@@ -0,0 +1,333 @@
+/* tensor/thread.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * The threads that large operations are split among.
+ *
+ * There are as many threads as processors, unless the environment
+ * variable TENSOR_NUM_THREADS (or tensor_set_num_threads()) asks for
+ * another number. They are started the first time they are needed,
+ * and then wait for work: tensor_parallel_for() cuts a range of items
+ * into parts, and the threads, and the one that called it, take the
+ * parts one at a time until there are none left.
+ *
+ * Only one operation uses the threads at a time. Another one that
+ * starts meanwhile (from another thread of the program, or from one of
+ * the parts) does all its work in the thread that called it.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <gsl/gsl_errno.h>
+#include "tensor.h"
+#include "tensor_internal.h"
+
+/* Most threads, counting the one that calls tensor_parallel_for() */
+#define MAX_THREADS 1024
+
+static int num_threads = 0;  /* not chosen yet */
+
+static int deterministic = 1;
+
+
+static int
+threads_default (void)
+{
+  const char * env = getenv ("TENSOR_NUM_THREADS");
+  long n = (env != NULL) ? atol (env) : 0;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+  if (n <= 0)
+    n = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+
+  if (n <= 0)
+    n = 1;
+
+  return (n > MAX_THREADS) ? MAX_THREADS : (int) n;
+}
+
+
+#ifdef HAVE_LIBPTHREAD
+
+/*
+ * First and last + 1 of the items of part p, of the parts of n items.
+ */
+static void
+part_range (size_t n, size_t parts, size_t p, size_t * begin, size_t * end)
+{
+  const size_t q = n / parts, r = n % parts;
+
+  *begin = p * q + ((p < r) ? p : r);
+  *end = *begin + q + ((p < r) ? 1 : 0);
+}
+
+
+static struct
+{
+  pthread_mutex_t busy;    /* held by the operation that has the pool */
+  pthread_mutex_t lock;    /* for all that follows */
+  pthread_cond_t work;     /* there is a new job, or the threads quit */
+  pthread_cond_t done;     /* a thread finished its parts */
+  pthread_t * threads;
+  int n_threads;           /* started, not counting the caller */
+  int quit;
+  unsigned long job;       /* number of the current job */
+  tensor_parallel_fn fn;
+  void * arg;
+  size_t n, parts;
+  size_t next;             /* first part nobody took yet */
+  int running;             /* threads still working on the job */
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+           PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+           NULL, 0, 0, 0, NULL, NULL, 0, 0, 0, 0 };
+
+
+/*
+ * Does parts of the current job until there are none left. Called
+ * with pool.lock held, which it holds again when it returns.
+ */
+static void
+pool_take_parts (void)
+{
+  while (pool.next < pool.parts)
+    {
+      const size_t p = pool.next++;
+      size_t begin, end;
+
+      pthread_mutex_unlock (&pool.lock);
+
+      part_range (pool.n, pool.parts, p, &begin, &end);
+      pool.fn (pool.arg, begin, end);
+
+      pthread_mutex_lock (&pool.lock);
+    }
+}
+
+
+static void *
+pool_thread (void * unused)
+{
+  unsigned long job = 0;
+
+  (void) unused;
+
+  pthread_mutex_lock (&pool.lock);
+
+  for (;;)
+    {
+      while (!pool.quit && pool.job == job)
+        pthread_cond_wait (&pool.work, &pool.lock);
+
+      if (pool.quit)
+        break;
+
+      job = pool.job;
+      pool_take_parts ();
+
+      if (--pool.running == 0)
+        pthread_cond_signal (&pool.done);
+    }
+
+  pthread_mutex_unlock (&pool.lock);
+
+  return NULL;
+}
+
+
+/*
+ * Stops the threads. Called with pool.busy held.
+ */
+static void
+pool_stop (void)
+{
+  int i;
+
+  pthread_mutex_lock (&pool.lock);
+  pool.quit = 1;
+  pthread_cond_broadcast (&pool.work);
+  pthread_mutex_unlock (&pool.lock);
+
+  for (i = 0; i < pool.n_threads; i++)
+    pthread_join (pool.threads[i], NULL);
+
+  free (pool.threads);
+  pool.threads = NULL;
+  pool.n_threads = 0;
+  pool.quit = 0;
+}
+
+
+/*
+ * Starts the threads, but the one that calls. Called with pool.busy
+ * held. If not all of them can be started, it goes on with fewer.
+ */
+static void
+pool_start (int n)
+{
+  int i;
+
+  pool.threads = (pthread_t *) malloc (n * sizeof (pthread_t));
+
+  if (pool.threads == NULL)
+    return;
+
+  for (i = 0; i < n; i++)
+    {
+      if (pthread_create (&pool.threads[i], NULL, pool_thread, NULL) != 0)
+        break;
+      pool.n_threads++;
+    }
+}
+
+#endif /* HAVE_LIBPTHREAD */
+
+
+/*
+ * Calls fn(arg, begin, end) for ranges that cover the items 0 to n - 1,
+ * in several threads if there are at least two parts of "grain" items
+ * for them. fn must give the same results however the items are cut.
+ */
+void
+tensor_parallel_for (size_t n, size_t grain, tensor_parallel_fn fn,
+                     void * arg)
+{
+  size_t parts = (grain > 0) ? n / grain : n;
+  int threads = tensor_get_num_threads ();
+
+  if (parts > (size_t) threads)
+    parts = threads;
+
+  if (parts < 2)
+    {
+      if (n > 0)
+        fn (arg, 0, n);
+      return;
+    }
+
+#ifdef HAVE_LIBPTHREAD
+  if (pthread_mutex_trylock (&pool.busy) != 0)
+    {
+      fn (arg, 0, n);
+      return;
+    }
+
+  if (pool.threads == NULL)
+    pool_start (threads - 1);
+
+  pthread_mutex_lock (&pool.lock);
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.n = n;
+  pool.parts = parts;
+  pool.next = 0;
+  pool.running = pool.n_threads;
+  pool.job++;
+  pthread_cond_broadcast (&pool.work);
+
+  pool_take_parts ();
+
+  while (pool.running > 0)
+    pthread_cond_wait (&pool.done, &pool.lock);
+  pthread_mutex_unlock (&pool.lock);
+
+  pthread_mutex_unlock (&pool.busy);
+#else
+  fn (arg, 0, n);
+#endif
+}
+
+
+/*
+ * Number of threads that operations are split among.
+ */
+int
+tensor_get_num_threads (void)
+{
+  if (num_threads == 0)
+    num_threads = threads_default ();
+
+  return num_threads;
+}
+
+
+/*
+ * Splits operations among n threads from now on (counting the one
+ * that calls them), or as many as processors if n is 0. With n = 1
+ * everything is done in the thread that calls.
+ */
+int
+tensor_set_num_threads (int n)
+{
+  if (n < 0 || n > MAX_THREADS)
+    {
+      GSL_ERROR ("bad number of threads", GSL_EINVAL);
+    }
+
+  if (n == 0)
+    n = threads_default ();
+
+#ifdef HAVE_LIBPTHREAD
+  /* Wait for the operation in progress, if any */
+  pthread_mutex_lock (&pool.busy);
+
+  if (pool.threads != NULL)
+    pool_stop ();
+
+  num_threads = n;
+
+  pthread_mutex_unlock (&pool.busy);
+#else
+  num_threads = n;
+#endif
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * True (the default) if reductions give the same result to the last
+ * bit with any number of threads.
+ */
+int
+tensor_get_deterministic (void)
+{
+  return deterministic;
+}
+
+
+/*
+ * With on = 0, reductions (tensor_stats(), ...) are split in as few
+ * parts as there are threads, and sums of floating point numbers can
+ * then change in the last bits with the number of threads.
+ */
+int
+tensor_set_deterministic (int on)
+{
+  deterministic = (on != 0);
+
+  return GSL_SUCCESS;
+}
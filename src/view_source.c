@@ -0,0 +1,599 @@
+/* tensor/view_source.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * This code follows as close as possible that of view_source.c in
+ * the gsl/matrix directory: views are returned by value and never
+ * own the data they point to.
+ */
+
+
+/* ------ Construction ------ */
+
+/*
+ * View of a whole tensor. The data is unshared first (see
+ * tensor_unshare), as it can be written through the view, and later
+ * copies of t do not share it.
+ */
+VIEW (tensor, view)
+FUNCTION (tensor, view_tensor) (TYPE (tensor) * t)
+{
+  VIEW (tensor, view) view = NULL_TENSOR_VIEW;
+
+  if (FUNCTION (tensor, unshare) (t))
+    return view;
+
+  tensor_block_expose (t->block);
+
+  return FUNCTION (tensor, const_view_tensor) (t);
+}
+
+
+/*
+ * View of a whole tensor, only to read it: its data may be shared
+ * with copies of t.
+ */
+VIEW (tensor, view)
+FUNCTION (tensor, const_view_tensor) (const TYPE (tensor) * t)
+{
+  VIEW (tensor, view) view = NULL_TENSOR_VIEW;
+  unsigned int i;
+
+  if (t->rank > TENSOR_MAX_RANK)
+    {
+      GSL_ERROR_VAL ("tensor rank too large for a view", GSL_EINVAL, view);
+    }
+
+  view.rank = t->rank;
+  view.dimension = t->dimension;
+  view.size = t->size;
+  view.data = t->data;
+
+  for (i = 0; i < t->rank; i++)
+    view.stride[i] = t->stride[i];
+
+  return view;
+}
+
+
+/*
+ * Fixes index i of a view to the value k. The result has rank one
+ * less than v.
+ */
+VIEW (tensor, view)
+FUNCTION (tensor, view_slice) (const VIEW (tensor, view) * v,
+                               size_t i, size_t k)
+{
+  VIEW (tensor, view) view = NULL_TENSOR_VIEW;
+  unsigned int j;
+
+  if (i >= v->rank)
+    {
+      GSL_ERROR_VAL ("slice index out of range", GSL_EINVAL, view);
+    }
+
+  if (k >= v->dimension)
+    {
+      GSL_ERROR_VAL ("slice value out of range", GSL_EINVAL, view);
+    }
+
+  view.rank = v->rank - 1;
+  view.dimension = v->dimension;
+  view.size = v->size / v->dimension;
+  view.data = v->data + k * v->stride[i];
+
+  for (j = 0; j < i; j++)
+    view.stride[j] = v->stride[j];
+  for (j = i; j < view.rank; j++)
+    view.stride[j] = v->stride[j+1];
+
+  return view;
+}
+
+
+/*
+ * Restricts every index of a view to the range
+ * offset[i], ..., offset[i] + n - 1. The result has dimension n.
+ */
+VIEW (tensor, view)
+FUNCTION (tensor, view_subtensor) (const VIEW (tensor, view) * v,
+                                   const size_t * offset, size_t n)
+{
+  VIEW (tensor, view) view = NULL_TENSOR_VIEW;
+  unsigned int i;
+  size_t start;
+
+  if (n == 0)
+    {
+      GSL_ERROR_VAL ("subtensor dimension must be positive integer",
+                     GSL_EINVAL, view);
+    }
+
+  start = 0;
+  for (i = 0; i < v->rank; i++)
+    {
+      if (offset[i] + n > v->dimension)
+        {
+          GSL_ERROR_VAL ("subtensor out of range", GSL_EINVAL, view);
+        }
+
+      start += offset[i] * v->stride[i];
+      view.stride[i] = v->stride[i];
+    }
+
+  view.rank = v->rank;
+  view.dimension = n;
+  view.size = quick_pow(n, v->rank);
+  view.data = v->data + start;
+
+  return view;
+}
+
+
+/*
+ * Swaps indices i and j of a view: v'_.j.i. = v_.i.j.
+ *
+ * Only the stride table changes, so this is O(1) no matter how big
+ * the tensor is. Use tensor_view_memcpy() or tensor_view_copy() when
+ * the data is needed in the new order.
+ */
+VIEW (tensor, view)
+FUNCTION (tensor, view_swap_indices) (const VIEW (tensor, view) * v,
+                                      size_t i, size_t j)
+{
+  VIEW (tensor, view) view = *v;
+  size_t stride;
+
+  if (i >= v->rank || j >= v->rank)
+    {
+      VIEW (tensor, view) null_view = NULL_TENSOR_VIEW;
+      GSL_ERROR_VAL ("bad indices in swap_indices request", GSL_EINVAL,
+                     null_view);
+    }
+
+  stride = view.stride[i];
+  view.stride[i] = view.stride[j];
+  view.stride[j] = stride;
+
+  return view;
+}
+
+
+VIEW (tensor, view)
+FUNCTION (tensor, slice) (TYPE (tensor) * t, size_t i, size_t k)
+{
+  VIEW (tensor, view) whole = FUNCTION (tensor, view_tensor) (t);
+
+  return FUNCTION (tensor, view_slice) (&whole, i, k);
+}
+
+
+VIEW (tensor, view)
+FUNCTION (tensor, subtensor) (TYPE (tensor) * t,
+                              const size_t * offset, size_t n)
+{
+  VIEW (tensor, view) whole = FUNCTION (tensor, view_tensor) (t);
+
+  return FUNCTION (tensor, view_subtensor) (&whole, offset, n);
+}
+
+
+
+/* ------ Element access ------ */
+
+/*
+ * Position of an element relative to v->data, or BAD_VIEW_POSITION if
+ * an index is out of range (and range checking is on). Unlike for
+ * tensors, v->size can not be used for that, as a view may span more
+ * memory than the number of elements it has.
+ */
+static size_t
+FUNCTION (tensor, view_position) (const size_t * indices,
+                                  const VIEW (tensor, view) * v)
+{
+  size_t position;
+  unsigned int i;
+
+  position = 0;
+  for (i = 0; i < v->rank; i++)
+    {
+      if (gsl_check_range)
+        if (indices[i] >= v->dimension)
+          return BAD_VIEW_POSITION;
+
+      position += v->stride[i] * indices[i];
+    }
+
+  return position;
+}
+
+
+BASE
+FUNCTION (tensor, view_get) (const VIEW (tensor, view) * v,
+                             const size_t * indices)
+{
+  size_t position;
+
+  position = FUNCTION (tensor, view_position) (indices, v);
+  if (gsl_check_range)
+    if (position == BAD_VIEW_POSITION)
+      GSL_ERROR_VAL ("index out of range", GSL_EINVAL, 0);
+
+  return v->data[position];
+}
+
+
+void
+FUNCTION (tensor, view_set) (VIEW (tensor, view) * v,
+                             const size_t * indices, const BASE x)
+{
+  size_t position;
+
+  position = FUNCTION (tensor, view_position) (indices, v);
+  if (gsl_check_range)
+    if (position == BAD_VIEW_POSITION)
+      GSL_ERROR_VOID ("index out of range", GSL_EINVAL);
+
+  v->data[position] = x;
+}
+
+
+BASE *
+FUNCTION (tensor, view_ptr) (VIEW (tensor, view) * v,
+                             const size_t * indices)
+{
+  size_t position;
+
+  position = FUNCTION (tensor, view_position) (indices, v);
+  if (gsl_check_range)
+    if (position == BAD_VIEW_POSITION)
+      GSL_ERROR_NULL ("index out of range", GSL_EINVAL);
+
+  return (BASE *) (v->data + position);
+}
+
+
+const BASE *
+FUNCTION (tensor, view_const_ptr) (const VIEW (tensor, view) * v,
+                                   const size_t * indices)
+{
+  size_t position;
+
+  position = FUNCTION (tensor, view_position) (indices, v);
+  if (gsl_check_range)
+    if (position == BAD_VIEW_POSITION)
+      GSL_ERROR_NULL ("index out of range", GSL_EINVAL);
+
+  return (const BASE *) (v->data + position);
+}
+
+
+
+/* ------ Copies ------ */
+
+/*
+ * Micro-transposes for the innermost part of a tile, for the types
+ * whose elements fit exactly in SSE registers. They are only used
+ * when the tile is a plain transposition (contiguous in both src and
+ * dest, along different indices), which is what permutations of a
+ * tensor that move its last index produce.
+ */
+#if defined(__SSE2__) && (defined(BASE_FLOAT) || defined(BASE_INT) || defined(BASE_UINT))
+#define MICRO_TILE 4
+static inline void
+FUNCTION (tensor, micro_transpose) (ATOMIC * to, size_t dq,
+                                    const ATOMIC * from, size_t sp)
+{
+  __m128 r0 = _mm_loadu_ps ((const float *) (from));
+  __m128 r1 = _mm_loadu_ps ((const float *) (from + sp));
+  __m128 r2 = _mm_loadu_ps ((const float *) (from + 2 * sp));
+  __m128 r3 = _mm_loadu_ps ((const float *) (from + 3 * sp));
+
+  _MM_TRANSPOSE4_PS (r0, r1, r2, r3);
+
+  _mm_storeu_ps ((float *) (to), r0);
+  _mm_storeu_ps ((float *) (to + dq), r1);
+  _mm_storeu_ps ((float *) (to + 2 * dq), r2);
+  _mm_storeu_ps ((float *) (to + 3 * dq), r3);
+}
+#elif defined(__SSE2__) && defined(BASE_DOUBLE)
+#define MICRO_TILE 2
+static inline void
+FUNCTION (tensor, micro_transpose) (ATOMIC * to, size_t dq,
+                                    const ATOMIC * from, size_t sp)
+{
+  __m128d r0 = _mm_loadu_pd (from);
+  __m128d r1 = _mm_loadu_pd (from + sp);
+
+  _mm_storeu_pd (to, _mm_unpacklo_pd (r0, r1));
+  _mm_storeu_pd (to + dq, _mm_unpackhi_pd (r0, r1));
+}
+#endif
+
+
+/*
+ * Copies a tile of nq x np elements, with
+ *   to[iq * dq + ip] = from[iq * sq + ip * sp]
+ */
+static void
+FUNCTION (tensor, view_tile) (ATOMIC * to, size_t dq,
+                              const ATOMIC * from, size_t sq, size_t sp,
+                              size_t nq, size_t np)
+{
+  size_t iq, ip;
+
+#ifdef MICRO_TILE
+  if (sq == 1)
+    {
+      const size_t mq = nq - nq % MICRO_TILE;
+      const size_t mp = np - np % MICRO_TILE;
+
+      for (iq = 0; iq < mq; iq += MICRO_TILE)
+        for (ip = 0; ip < mp; ip += MICRO_TILE)
+          FUNCTION (tensor, micro_transpose) (to + iq * dq + ip, dq,
+                                              from + iq + ip * sp, sp);
+
+      /* Leftovers at the edges */
+      for (iq = 0; iq < nq; iq++)
+        for (ip = (iq < mq ? mp : 0); ip < np; ip++)
+          to[iq * dq + ip] = from[iq + ip * sp];
+
+      return;
+    }
+#endif
+
+  for (iq = 0; iq < nq; iq++)
+    for (ip = 0; ip < np; ip++)
+      to[iq * dq + ip] = from[iq * sq + ip * sp];
+}
+
+#ifdef MICRO_TILE
+#undef MICRO_TILE
+#endif
+
+
+/* A copy of a view into a tensor, split among the threads */
+typedef struct
+{
+  TYPE (tensor) * dest;
+  const VIEW (tensor, view) * src;
+  unsigned int q;    /* see tensor_view_memcpy_blocked() */
+  int split_q;       /* the parts are ranges of index q, not planes */
+} TYPE (view_copy_job);
+
+
+/*
+ * Copies src into dest one plane at a time, where a plane is spanned
+ * by the last index p of dest (contiguous in dest) and the index q of
+ * src with the smallest stride (contiguous, or nearly so, in src).
+ *
+ * Each plane is done in square tiles of TENSOR_BLOCK x TENSOR_BLOCK
+ * elements, so the lines read from src stay in cache while the tile
+ * is written to dest, whichever way the indices are permuted.
+ *
+ * This does the planes from begin to end - 1 or, if q is the first
+ * index, the values of q from begin to end - 1 in all the planes. In
+ * both cases that is a slab of consecutive memory of dest.
+ */
+static void
+FUNCTION (tensor, view_memcpy_blocked) (void * arg, size_t begin, size_t end)
+{
+  const TYPE (view_copy_job) * job = (const TYPE (view_copy_job) *) arg;
+  TYPE (tensor) * const dest = job->dest;
+  const VIEW (tensor, view) * const src = job->src;
+  const unsigned int rank = src->rank;
+  const unsigned int p = rank - 1;
+  const unsigned int q = job->q;
+  const size_t dimension = src->dimension;
+  const size_t sp = src->stride[p];
+  const size_t sq = src->stride[q];
+  const size_t * const dstride = dest->stride;
+  const size_t dq = dstride[q];
+  const size_t q_begin = job->split_q ? begin : 0;
+  const size_t q_end = job->split_q ? end : dimension;
+  size_t counter[TENSOR_MAX_RANK];
+  size_t plane, plane_end, rest;
+  size_t dest_pos, src_pos;
+  size_t bq, bp, eq, ep;
+  unsigned int i;
+
+  plane = job->split_q ? 0 : begin;
+  plane_end = job->split_q ? dest->size / (dimension * dimension) : end;
+
+  /* Indices (other than p and q) of the first plane */
+  dest_pos = 0;
+  src_pos = 0;
+  rest = plane;
+  for (i = rank; i > 0; i--)
+    {
+      counter[i-1] = 0;
+      if (i-1 == p || i-1 == q)
+        continue;
+      counter[i-1] = rest % dimension;
+      rest /= dimension;
+      dest_pos += counter[i-1] * dstride[i-1];
+      src_pos += counter[i-1] * src->stride[i-1];
+    }
+
+  for (; plane < plane_end; plane++)
+    {
+      ATOMIC * to = dest->data + dest_pos;
+      const ATOMIC * from = src->data + src_pos;
+
+      for (bq = q_begin; bq < q_end; bq += TENSOR_BLOCK)
+        {
+          eq = GSL_MIN (bq + TENSOR_BLOCK, q_end);
+          for (bp = 0; bp < dimension; bp += TENSOR_BLOCK)
+            {
+              ep = GSL_MIN (bp + TENSOR_BLOCK, dimension);
+              FUNCTION (tensor, view_tile) (to + bq * dq + bp, dq,
+                                            from + bq * sq + bp * sp,
+                                            sq, sp, eq - bq, ep - bp);
+            }
+        }
+
+      /* Advance the counter of the indices other than p and q */
+      for (i = rank; i > 0; i--)
+        {
+          if (i-1 == p || i-1 == q)
+            continue;
+          dest_pos += dstride[i-1];
+          src_pos += src->stride[i-1];
+          if (++counter[i-1] < dimension)
+            break;
+          dest_pos -= dimension * dstride[i-1];
+          src_pos -= dimension * src->stride[i-1];
+          counter[i-1] = 0;
+        }
+    }
+}
+
+
+/*
+ * Copies the rows of dest from begin to end - 1 from src, whose last
+ * index runs fastest in memory, walking src with a counter over all
+ * other indices so no divisions are needed to find where each row
+ * starts (but for the first).
+ */
+static void
+FUNCTION (tensor, view_memcpy_rows) (void * arg, size_t begin, size_t end)
+{
+  const TYPE (view_copy_job) * job = (const TYPE (view_copy_job) *) arg;
+  TYPE (tensor) * const dest = job->dest;
+  const VIEW (tensor, view) * const src = job->src;
+  const unsigned int rank = src->rank;
+  const size_t dimension = src->dimension;
+  const size_t inner_stride = src->stride[rank - 1];
+  size_t counter[TENSOR_MAX_RANK];
+  size_t r, k, rest;
+  const ATOMIC * row;
+  ATOMIC * to;
+  unsigned int i;
+
+  row = src->data;
+  rest = begin;
+  for (i = rank - 1; i > 0; i--)
+    {
+      counter[i-1] = rest % dimension;
+      rest /= dimension;
+      row += counter[i-1] * src->stride[i-1];
+    }
+
+  to = dest->data + begin * dest->tda;
+
+  for (r = begin; r < end; r++)
+    {
+      for (k = 0; k < dimension; k++)
+        to[k] = row[k * inner_stride];
+
+      to += dest->tda;
+
+      /* Advance the counter of the outer indices */
+      for (i = rank - 1; i > 0; i--)
+        {
+          row += src->stride[i-1];
+          if (++counter[i-1] < dimension)
+            break;
+          row -= dimension * src->stride[i-1];
+          counter[i-1] = 0;
+        }
+    }
+}
+
+
+/*
+ * Overwrites the tensor dest with the contents of the view src.
+ *
+ * If the last index of src is the one that runs fastest in memory,
+ * the destination is written row by row. Otherwise (e.g. for a view
+ * with swapped indices) the copy is done in cache-sized tiles.
+ *
+ * Either way, the threads get consecutive slabs of dest to write, so
+ * the pages of a new tensor are first touched by (and, on a NUMA
+ * machine, placed near) the threads that write them.
+ */
+int
+FUNCTION (tensor, view_memcpy) (TYPE (tensor) * dest,
+                                const VIEW (tensor, view) * src)
+{
+  const unsigned int rank = src->rank;
+  const size_t dimension = src->dimension;
+  TYPE (view_copy_job) job;
+  size_t items, work;
+  unsigned int i, q;
+
+  if (dest->rank != rank || dest->dimension != dimension)
+    {
+      GSL_ERROR ("tensor sizes are different", GSL_EBADLEN);
+    }
+
+  if (FUNCTION (tensor, unshare) (dest))
+    return GSL_ENOMEM;
+
+  if (rank == 0)
+    {
+      dest->data[0] = src->data[0];
+      return GSL_SUCCESS;
+    }
+
+  q = rank - 1;
+  for (i = 0; i < rank - 1; i++)
+    if (src->stride[i] < src->stride[q])
+      q = i;
+
+  job.dest = dest;
+  job.src = src;
+  job.q = q;
+  job.split_q = (q == 0);
+
+  if (q != rank - 1 && dimension > 1)
+    {
+      /* Planes, or values of q if it is the first index */
+      items = job.split_q ? dimension : dest->size / (dimension * dimension);
+      work = dest->size / items;
+
+      tensor_parallel_for (items, (PARALLEL_MIN_COPY + work - 1) / work,
+                           FUNCTION (tensor, view_memcpy_blocked), &job);
+      return GSL_SUCCESS;
+    }
+
+  items = dest->size / dimension;
+  tensor_parallel_for (items, (PARALLEL_MIN_COPY + dimension - 1) / dimension,
+                       FUNCTION (tensor, view_memcpy_rows), &job);
+
+  return GSL_SUCCESS;
+}
+
+
+/*
+ * Creates a new tensor with the contents of view v.
+ */
+TYPE (tensor) *
+FUNCTION (tensor, view_copy) (const VIEW (tensor, view) * v)
+{
+  TYPE (tensor) * t = FUNCTION (tensor, alloc) (v->rank, v->dimension);
+
+  if (t == 0)
+    return NULL;
+
+  FUNCTION (tensor, view_memcpy) (t, v);
+
+  return t;
+}
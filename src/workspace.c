@@ -0,0 +1,173 @@
+/* tensor/workspace.c
+ *
+ * Copyright (C) 2010 Jordi Burguet-Castell
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to:
+ *   Free Software Foundation, Inc.
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA.
+ */
+
+/*
+ * Workspaces: memory for temporary tensors that is given in order
+ * and released all at once (see tensor_workspace.h).
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <gsl/gsl_errno.h>
+#include "tensor_workspace.h"
+
+/*
+ * Everything given is aligned to this many bytes, enough for any
+ * element type (long double, complex double).
+ */
+#define WORKSPACE_ALIGN 16
+
+#define ROUND_UP(n) (((n) + WORKSPACE_ALIGN - 1) & ~((size_t) WORKSPACE_ALIGN - 1))
+
+
+/*
+ * Creates a workspace with a block of "size" bytes, which can be 0 to
+ * let it grow as it is used.
+ */
+tensor_workspace *
+tensor_workspace_alloc (size_t size)
+{
+  tensor_workspace * w;
+
+  w = (tensor_workspace *) malloc (sizeof (tensor_workspace));
+
+  if (w == 0)
+    {
+      GSL_ERROR_VAL ("failed to allocate space for workspace struct",
+                     GSL_ENOMEM, 0);
+    }
+
+  size = ROUND_UP (size);
+
+  w->block = NULL;
+  if (size > 0)
+    {
+      w->block = (char *) malloc (size);
+
+      if (w->block == 0)
+        {
+          free (w);
+          GSL_ERROR_VAL ("failed to allocate space for workspace block",
+                         GSL_ENOMEM, 0);
+        }
+    }
+
+  w->size = size;
+  w->used = 0;
+  w->overflow = 0;
+  w->chunks = NULL;
+
+  return w;
+}
+
+
+/*
+ * Frees the pieces of memory given from outside of the block.
+ */
+static void
+workspace_free_chunks (tensor_workspace * w)
+{
+  while (w->chunks != NULL)
+    {
+      void * next = *(void **) w->chunks;
+
+      free (w->chunks);
+      w->chunks = next;
+    }
+}
+
+
+/*
+ * Frees a workspace, and so all the tensors in it.
+ */
+void
+tensor_workspace_free (tensor_workspace * w)
+{
+  workspace_free_chunks (w);
+  free (w->block);
+  free (w);
+}
+
+
+/*
+ * Releases everything given by the workspace. If its block was too
+ * small since the last reset, it is replaced by one big enough.
+ */
+void
+tensor_workspace_reset (tensor_workspace * w)
+{
+  if (w->overflow > 0)
+    {
+      const size_t size = w->size + w->overflow;
+      char * block;
+
+      workspace_free_chunks (w);
+
+      block = (char *) malloc (size);
+
+      /* If that fails, the old block is still good */
+      if (block != NULL)
+        {
+          free (w->block);
+          w->block = block;
+          w->size = size;
+        }
+
+      w->overflow = 0;
+    }
+
+  w->used = 0;
+}
+
+
+/*
+ * Returns n bytes of memory from the workspace, aligned for any type
+ * of tensor element.
+ */
+void *
+tensor_workspace_get (tensor_workspace * w, size_t n)
+{
+  char * chunk;
+
+  n = ROUND_UP (n);
+
+  if (w->size - w->used >= n)
+    {
+      void * p = w->block + w->used;
+
+      w->used += n;
+
+      return p;
+    }
+
+  /* From the heap until the next reset, after a link to the others */
+  chunk = (char *) malloc (WORKSPACE_ALIGN + n);
+
+  if (chunk == 0)
+    {
+      GSL_ERROR_NULL ("failed to allocate space in workspace", GSL_ENOMEM);
+    }
+
+  *(void **) chunk = w->chunks;
+  w->chunks = chunk;
+  w->overflow += n;
+
+  return chunk + WORKSPACE_ALIGN;
+}